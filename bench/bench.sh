@@ -0,0 +1,73 @@
+#!/bin/bash
+
+# Runs create and restore for each change pattern and buffer size, and prints
+# the results as tab-separated values. The throughput is of the image for both
+# the operations.
+
+PROGRAM_EXEC="$1"
+BENCHTOOL="$2"
+SIZE_MIB="$3"
+BUFFER_SIZES="$4"
+PATTERNS="$5"
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+BASE="$WORK_DIR/base"
+INPUT="$WORK_DIR/input"
+DIFF="$WORK_DIR/diff"
+OUTPUT="$WORK_DIR/output"
+
+IMAGE_SIZE=$(( SIZE_MIB * 1024 * 1024 ))
+
+# The number of the records is in the trailer at the end of the diff file
+function record_count()
+{
+    tail -c 8 "$1" | od -An -tu8 --endian=big | tr -d ' '
+}
+
+# Prints the result line of the operation from the output of the run
+function report()
+{
+    local pattern="$1" operation="$2" buffer_size="$3" bytes="$4" records="$5"
+    local diff_size="$6" seconds="$7" max_rss_kib="$8"
+
+    awk -v p="$pattern" -v o="$operation" -v b="$buffer_size" -v n="$bytes" \
+        -v r="$records" -v d="$diff_size" -v s="$seconds" -v m="$max_rss_kib" \
+        'BEGIN {
+            printf "%s\t%s\t%s\t%s\t%.6f\t%.3f\t%s\t%.0f\t%s\t%s\n",
+                   p, o, b, n, s, (n / s) / 1e9, r, r / s, d, m
+        }'
+}
+
+printf "pattern\toperation\tbuffer_size\tbytes\tseconds\tgb_per_s"
+printf "\trecords\trecords_per_s\tdiff_size\tmax_rss_kib\n"
+
+for pattern in $PATTERNS; do
+    if ! "$BENCHTOOL" generate "$pattern" "$IMAGE_SIZE" "$BASE" "$INPUT"; then
+        exit 1
+    fi
+
+    for buffer_size in $BUFFER_SIZES; do
+        if ! result=$("$BENCHTOOL" run "$PROGRAM_EXEC" create \
+                      -B "$buffer_size" -i "$INPUT" -b "$BASE" -o "$DIFF"); then
+            exit 1
+        fi
+        records=$(record_count "$DIFF")
+        diff_size=$(stat -c %s "$DIFF")
+        report "$pattern" create "$buffer_size" "$IMAGE_SIZE" "$records" \
+               "$diff_size" $result
+
+        cp "$BASE" "$OUTPUT"
+        if ! result=$("$BENCHTOOL" run "$PROGRAM_EXEC" restore \
+                      -B "$buffer_size" -d "$DIFF" -o "$OUTPUT"); then
+            exit 1
+        fi
+        if ! cmp -s "$OUTPUT" "$INPUT"; then
+            echo "restored image differs for $pattern $buffer_size" >&2
+            exit 1
+        fi
+        report "$pattern" restore "$buffer_size" "$IMAGE_SIZE" "$records" \
+               "$diff_size" $result
+    done
+done
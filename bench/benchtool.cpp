@@ -0,0 +1,196 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Helper of the benchmark. It generates the images and runs the commands
+// measuring their time and peak memory, which the shell cannot do portably.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+
+// Deterministic, so the same images are generated for every commit
+class Random
+{
+  public:
+    explicit Random(uint64_t seed) : m_state{seed} {};
+
+    uint64_t next()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 7;
+        m_state ^= m_state << 17;
+        return m_state;
+    };
+
+    uint64_t below(uint64_t limit) { return next() % limit; };
+
+    void fill(char *data, size_t size)
+    {
+        while (size > 0) {
+            const uint64_t value{next()};
+            const size_t n{std::min(size, sizeof(value))};
+            memcpy(data, &value, n);
+            data += n;
+            size -= n;
+        }
+    };
+
+  private:
+    uint64_t m_state;
+};
+
+// Writes the random data of the size at random offsets until about the
+// fraction of the image is covered
+void
+writeRandomRuns(std::vector<char> &image, Random &random, size_t max_run,
+                double fraction)
+{
+    const size_t target{static_cast<size_t>(image.size() * fraction)};
+    for (size_t covered = 0; covered < target;) {
+        const size_t run{1 + random.below(max_run)};
+        const size_t offset{random.below(image.size() - run)};
+        random.fill(image.data() + offset, run);
+        covered += run;
+    }
+}
+
+int
+generate(const std::string &pattern, size_t size, const char *base_path,
+         const char *input_path)
+{
+    Random random{0x9e3779b97f4a7c15ULL};
+    std::vector<char> image(size);
+    random.fill(image.data(), image.size());
+
+    std::ofstream base{base_path, std::ios_base::binary};
+    if (!base.write(image.data(), image.size())) {
+        std::cerr << "cannot write base image" << std::endl;
+        return 1;
+    }
+
+    if (pattern == "uniform") {
+        // Short runs spread over the whole image
+        writeRandomRuns(image, random, 64, 0.01);
+    } else if (pattern == "clustered") {
+        // Dense writes in a few regions of 1/64 of the image
+        const size_t region_size{std::max<size_t>(size / 64, 1)};
+        for (int i = 0; i < 4; ++i) {
+            const size_t start{random.below(size - region_size + 1)};
+            std::vector<char> region(image.begin() + start,
+                                     image.begin() + start + region_size);
+            writeRandomRuns(region, random, 4096, 0.5);
+            std::copy(region.begin(), region.end(), image.begin() + start);
+        }
+    } else if (pattern == "zero") {
+        // Regions of 1 MiB set to zeros, covering about a tenth of the image
+        const size_t region_size{std::min<size_t>(1024 * 1024, size)};
+        for (size_t i = 0; i < std::max<size_t>(size / region_size / 10, 1);
+             ++i) {
+            const size_t start{random.below(size - region_size + 1)};
+            memset(image.data() + start, 0, region_size);
+        }
+    } else if (pattern == "flip") {
+        // Single bytes changed, one in 64 KiB on average
+        for (size_t i = 0; i < std::max<size_t>(size / (64 * 1024), 1); ++i) {
+            image[random.below(size)] ^= 0xFF;
+        }
+    } else {
+        std::cerr << "unknown pattern " << pattern << std::endl;
+        return 1;
+    }
+
+    std::ofstream input{input_path, std::ios_base::binary};
+    if (!input.write(image.data(), image.size())) {
+        std::cerr << "cannot write input image" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Prints the wall time in seconds and the peak resident set size in KiB of
+// the command
+int
+run(char **argv)
+{
+    const auto start{std::chrono::steady_clock::now()};
+
+    const pid_t pid{fork()};
+    if (pid < 0) {
+        std::cerr << "cannot fork" << std::endl;
+        return 1;
+    } else if (pid == 0) {
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        std::cerr << "cannot wait for the command" << std::endl;
+        return 1;
+    }
+    const std::chrono::duration<double> elapsed{
+        std::chrono::steady_clock::now() - start};
+
+    if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+        std::cerr << "command failed" << std::endl;
+        return 1;
+    }
+
+    printf("%.6f %ld\n", elapsed.count(), usage.ru_maxrss);
+    return 0;
+}
+
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+    if ((argc == 6) && (strcmp(argv[1], "generate") == 0)) {
+        return generate(argv[2], std::strtoull(argv[3], nullptr, 0), argv[4],
+                        argv[5]);
+    } else if ((argc >= 3) && (strcmp(argv[1], "run") == 0)) {
+        return run(argv + 2);
+    }
+
+    std::cerr << "Usage: " << argv[0]
+              << " generate PATTERN SIZE BASEFILE INFILE" << std::endl;
+    std::cerr << "   Or: " << argv[0] << " run PROGRAM [ARGS...]" << std::endl;
+    return 1;
+}
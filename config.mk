@@ -5,4 +5,10 @@ PREFIX = /usr/local
 MANPREFIX = ${PREFIX}/share/man
 
 CXX=g++
-CXXFLAGS=-Wall -Wextra -Werror -std=c++17
+CXXFLAGS=-Wall -Wextra -Werror -std=c++17 -pthread
+
+# The zstd compression codec is built in if its header is found
+ifeq ($(shell printf '\043include <zstd.h>\n' | $(CXX) -E -x c++ - >/dev/null 2>&1 && echo yes),yes)
+CXXFLAGS += -DHAVE_ZSTD
+LDLIBS += -lzstd
+endif
@@ -26,6 +26,7 @@
 
 #include "buffered_stream.h"
 #include "exception.h"
+#include "stats.h"
 
 #include <algorithm>
 #include <cassert>
@@ -36,24 +37,56 @@
 namespace BufferedStream
 {
 
+AlignedBuffer
+allocateAlignedBuffer(size_t size)
+{
+    const size_t aligned_size{
+        ((size + BufferAlignment - 1) / BufferAlignment) * BufferAlignment};
+    char *p{static_cast<char *>(std::aligned_alloc(BufferAlignment,
+                                                   aligned_size))};
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return AlignedBuffer{p};
+}
+
 Reader::Reader(std::istream &istream, size_t buffer_capacity,
-               size_t buffer_count)
+               size_t buffer_count, size_t read_ahead_count,
+               uint64_t read_limit)
     : m_buffer_count(buffer_count), m_buffer_capacity(buffer_capacity),
-      m_istream(istream), m_buffers(buffer_count),
-      m_buffer_index(buffer_count - 1), m_buffer_offset(buffer_capacity),
-      m_buffer_size(buffer_capacity)
+      m_read_ahead_count(read_ahead_count), m_istream(istream),
+      m_read_left(read_limit), m_generation(0), m_buffer(nullptr),
+      m_buffer_offset(buffer_capacity), m_buffer_size(buffer_capacity),
+      m_filled_sizes(buffer_count + read_ahead_count), m_filled_count(0),
+      m_stop(false)
 {
-    for (size_t i = 0; i < m_buffer_count; ++i) {
+    for (size_t i = 0; i < (m_buffer_count + m_read_ahead_count); ++i) {
         try {
-            m_buffers[i] = std::shared_ptr<char[]>(new char[m_buffer_capacity]);
+            m_buffers.push_back(allocateAlignedBuffer(m_buffer_capacity));
         } catch (const std::bad_alloc &e) {
             throw Error("cannot allocate buffer for input stream data");
         }
     }
 
+    if (m_read_ahead_count > 0) {
+        m_read_ahead_thread = std::thread{&Reader::read_ahead, this};
+    }
+
     refill_next_buffer();
 };
 
+Reader::~Reader()
+{
+    if (m_read_ahead_thread.joinable()) {
+        {
+            const std::lock_guard<std::mutex> lock{m_mutex};
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        m_read_ahead_thread.join();
+    }
+};
+
 size_t
 Reader::read(size_t data_size, char *dest_buf)
 {
@@ -69,7 +102,7 @@ Reader::read(size_t data_size, char *dest_buf)
         }
 
         retry_count = 0;
-        memcpy(dest_buf + offset, dp.data.get(), dp.size);
+        memcpy(dest_buf + offset, dp.data, dp.size);
         offset += dp.size;
         to_read -= dp.size;
     }
@@ -85,7 +118,7 @@ Reader::readMultipart(size_t data_size)
     if (size_left == 0) {
         refill_next_buffer();
         if (m_buffer_size == 0) {
-            return DataPart{.size = 0, .data = std::shared_ptr<char[]>()};
+            return DataPart{.size = 0, .data = nullptr};
         }
     }
     // There is at least one byte in the buffer
@@ -97,20 +130,9 @@ Reader::readMultipart(size_t data_size)
 DataPart
 Reader::read_current_buffer(size_t data_size)
 {
-    DataPart dp;
-
-    // Set data
-    if (m_buffer_offset == 0) {
-        dp.data = std::shared_ptr<char[]>{m_buffers[m_buffer_index]};
-    } else {
-        dp.data = std::shared_ptr<char[]>{
-            m_buffers[m_buffer_index],
-            static_cast<char *>(m_buffers[m_buffer_index].get()) +
-                m_buffer_offset};
-    }
-
     const size_t size_left{m_buffer_size - m_buffer_offset};
-    dp.size = std::min(data_size, size_left);
+    const DataPart dp{.size = std::min(data_size, size_left),
+                      .data = m_buffer + m_buffer_offset};
     m_buffer_offset += dp.size;
     return dp;
 };
@@ -126,37 +148,140 @@ Reader::refill_next_buffer()
     // Current buffer must be completely read before filling the next one
     assert(m_buffer_offset == m_buffer_size);
 
-    m_buffer_index = (m_buffer_index + 1) % m_buffer_count;
-    auto buf = m_buffers[m_buffer_index];
-    // Buffer for new data must not in use
-    assert(buf.use_count() == 2);
+    // The buffer of the next generation was last used by the generation no
+    // longer valid after taking it
+    char *const buf{m_buffers[m_generation % m_buffers.size()].get()};
+    size_t size;
+    {
+        // Time of waiting for the data counts as the I/O time, whether it is
+        // read here or by the read-ahead thread
+        const Stats::IoTimer timer;
+        if (m_read_ahead_count > 0) {
+            size = take_filled_buffer();
+        } else {
+            size = read_stream(buf, m_buffer_capacity);
+            ++m_generation;
+        }
+    }
 
-    m_buffer_size = read_stream(buf, m_buffer_capacity);
+    m_buffer = buf;
+    m_buffer_size = size;
     m_buffer_offset = 0;
 };
 
+// Returns the size of the data in the buffer of the next generation
+size_t
+Reader::take_filled_buffer()
+{
+    size_t size;
+    {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_cond.wait(lock, [this] {
+            return (m_filled_count > m_generation) || m_read_ahead_error;
+        });
+
+        if (m_filled_count == m_generation) {
+            // The buffers read before the error have been already consumed
+            std::rethrow_exception(m_read_ahead_error);
+        }
+
+        size = m_filled_sizes[m_generation % m_buffers.size()];
+        ++m_generation;
+    }
+    // The buffer of the oldest generation can be filled now
+    m_cond.notify_all();
+    return size;
+};
+
+void
+Reader::read_ahead()
+{
+    try {
+        for (;;) {
+            {
+                // Only the buffers not referenced by the reading can be
+                // filled
+                std::unique_lock<std::mutex> lock{m_mutex};
+                m_cond.wait(lock, [this] {
+                    return m_stop || (m_filled_count <
+                                      (m_generation + m_read_ahead_count));
+                });
+                if (m_stop) {
+                    return;
+                }
+            }
+
+            const size_t index{m_filled_count % m_buffers.size()};
+            const size_t size{
+                read_stream(m_buffers[index].get(), m_buffer_capacity)};
+            {
+                const std::lock_guard<std::mutex> lock{m_mutex};
+                m_filled_sizes[index] = size;
+                ++m_filled_count;
+            }
+            m_cond.notify_all();
+
+            if (size == 0) {
+                // End of the stream. There is nothing more to read.
+                return;
+            }
+        }
+    } catch (...) {
+        {
+            const std::lock_guard<std::mutex> lock{m_mutex};
+            m_read_ahead_error = std::current_exception();
+        }
+        m_cond.notify_all();
+    }
+};
+
 size_t
-Reader::read_stream(std::shared_ptr<char[]> data, size_t data_size)
+Reader::read_stream(char *data, size_t data_size)
 {
-    m_istream.read(data.get(), data_size);
+    const size_t to_read{
+        static_cast<size_t>(std::min<uint64_t>(data_size, m_read_left))};
+    m_istream.read(data, to_read);
 
     if (!m_istream.good() && !m_istream.eof()) {
         throw Error("cannot read from stream");
     }
 
+    m_read_left -= m_istream.gcount();
     return m_istream.gcount();
 };
 
 Writer::Writer(std::ostream &ostream, size_t buffer_capacity)
-    : m_ostream(ostream), m_buffer_size(0), m_buffer_capacity(buffer_capacity)
+    : m_ostream(ostream), m_gather_stream(nullptr), m_data(nullptr),
+      m_buffer_size(0), m_buffer_capacity(buffer_capacity)
 {
+    Fd::Stream *const fd_stream{dynamic_cast<Fd::Stream *>(&ostream)};
+    if (fd_stream != nullptr) {
+        m_splice_buffer = fd_stream->createSpliceBuffer(m_buffer_capacity);
+    }
+    if (m_splice_buffer) {
+        // The data are copied to the spliced buffers instead of the gather
+        // writes
+        m_data = m_splice_buffer->getData();
+        return;
+    }
+    m_gather_stream = fd_stream;
+
     try {
-        m_buffer = std::make_unique<char[]>(m_buffer_capacity);
+        m_buffer = allocateAlignedBuffer(m_buffer_capacity);
     } catch (const std::bad_alloc &e) {
         throw Error("cannot allocate buffer for output stream data");
     }
+    m_data = m_buffer.get();
+};
+Writer::~Writer()
+{
+    // The errors must be reported by flush() called before. Here the writer
+    // may be destroyed by an exception from a failed write.
+    try {
+        flush_buffer();
+    } catch (const DiffddError &e) {
+    }
 };
-Writer::~Writer() { flush_buffer(); };
 
 void
 Writer::write(const char *data, size_t data_size)
@@ -178,28 +303,89 @@ Writer::write(const char *data, size_t data_size)
     }
 };
 
+void
+Writer::writeVector(const struct iovec *parts, size_t count)
+{
+    size_t parts_size{0};
+    for (size_t i = 0; i < count; ++i) {
+        parts_size += parts[i].iov_len;
+    }
+
+    if ((m_gather_stream == nullptr) || (parts_size < GatherMinSize)) {
+        for (size_t i = 0; i < count; ++i) {
+            write(static_cast<const char *>(parts[i].iov_base),
+                  parts[i].iov_len);
+        }
+        return;
+    }
+
+    // The buffered data go first
+    m_gather_parts.clear();
+    m_gather_parts.push_back(iovec{m_data, m_buffer_size});
+    m_gather_parts.insert(m_gather_parts.end(), parts, parts + count);
+    {
+        const Stats::IoTimer timer;
+        m_gather_stream->writeVector(m_gather_parts.data(),
+                                     m_gather_parts.size());
+    }
+    Stats::add(Stats::Counter::BytesWritten, m_buffer_size + parts_size);
+    m_buffer_size = 0;
+};
+
+void
+Writer::flush()
+{
+    flush_buffer();
+};
+
 void
 Writer::write_buffer(const char *data, size_t data_size)
 {
-    memcpy(reinterpret_cast<char *>(m_buffer.get()) + m_buffer_size, data,
-           data_size);
+    memcpy(m_data + m_buffer_size, data, data_size);
     m_buffer_size += data_size;
 };
 
 void
 Writer::flush_buffer()
 {
-    write_stream(m_buffer.get(), m_buffer_size);
+    // The data are dropped even if the write fails, so they are not written
+    // again
+    const size_t size{m_buffer_size};
     m_buffer_size = 0;
+    if (m_splice_buffer) {
+        splice_buffer(size);
+    } else {
+        write_stream(m_data, size);
+    }
 };
 
 void
 Writer::write_stream(const char *data, size_t data_size)
 {
-    m_ostream.write(data, data_size);
+    {
+        const Stats::IoTimer timer;
+        m_ostream.write(data, data_size);
+    }
     if (!m_ostream) {
         throw Error("cannot write to output stream");
     }
+    Stats::add(Stats::Counter::BytesWritten, data_size);
+};
+
+void
+Writer::splice_buffer(size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+
+    {
+        const Stats::IoTimer timer;
+        m_splice_buffer->splice(size);
+    }
+    // The next buffer of the rotation
+    m_data = m_splice_buffer->getData();
+    Stats::add(Stats::Counter::BytesWritten, size);
 };
 
 } // namespace BufferedStream
@@ -27,10 +27,17 @@
 #pragma once
 
 #include "exception.h"
+#include "fd_stream.h"
 
+#include <condition_variable>
+#include <cstdlib>
 #include <cstring>
+#include <exception>
 #include <filesystem>
 #include <fstream>
+#include <limits>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace BufferedStream
@@ -42,34 +49,87 @@ class Error : public DiffddError
     explicit Error(const std::string &message) : DiffddError(message) {}
 };
 
+// The buffers are aligned for direct I/O on devices with logical block size
+// up to this
+const size_t BufferAlignment{4096};
+
+struct FreeDeleter {
+    void operator()(char *p) const { std::free(p); }
+};
+
+using AlignedBuffer = std::unique_ptr<char[], FreeDeleter>;
+
+// Throws std::bad_alloc
+AlignedBuffer allocateAlignedBuffer(size_t size);
+
+// The data part does not own the data. It points to a buffer of the reader.
 struct DataPart {
     size_t size;
-    std::shared_ptr<char[]> data;
+    const char *data;
 };
 
 class Reader
 {
   public:
-    Reader(std::istream &istream, size_t buffer_capacity, size_t buffer_count);
-    virtual ~Reader() = default;
+    static const uint64_t NoReadLimit{std::numeric_limits<uint64_t>::max()};
+
+    // With a non-zero read-ahead count, the stream is read by a background
+    // thread keeping up to that many filled buffers ahead of the reading. No
+    // more than the read limit bytes are read from the stream.
+    Reader(std::istream &istream, size_t buffer_capacity, size_t buffer_count,
+           size_t read_ahead_count = 0, uint64_t read_limit = NoReadLimit);
+    virtual ~Reader();
 
     size_t read(size_t data_size, char *dest_buf);
+    // The data part stays valid until the buffer count more buffers are
+    // taken. Its generation is the current generation of the reader.
     DataPart readMultipart(size_t data_size);
 
+    // Number of the buffers taken so far
+    uint64_t getGeneration() const { return m_generation; };
+    // Whether the buffer of the generation can still be referenced
+    bool isValid(uint64_t generation) const
+    {
+        return (generation + m_buffer_count) > m_generation;
+    };
+
   private:
     const size_t m_buffer_count;
     const size_t m_buffer_capacity;
+    const size_t m_read_ahead_count;
     std::istream &m_istream;
-    std::vector<std::shared_ptr<char[]>> m_buffers;
-    size_t m_buffer_index;
+    uint64_t m_read_left;
+    // The buffers are used in turn. The buffers of the last buffer count
+    // generations can be referenced by the returned data parts. The
+    // buffers after them are filled ahead.
+    std::vector<AlignedBuffer> m_buffers;
+    uint64_t m_generation;
+    // The current buffer
+    const char *m_buffer;
     size_t m_buffer_offset;
     size_t m_buffer_size;
 
+    std::thread m_read_ahead_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    // Sizes of the data in the buffers filled ahead
+    std::vector<size_t> m_filled_sizes;
+    uint64_t m_filled_count;
+    std::exception_ptr m_read_ahead_error;
+    bool m_stop;
+
     DataPart read_current_buffer(size_t data_size);
     void refill_next_buffer();
-    size_t read_stream(std::shared_ptr<char[]> data, size_t data_size);
+    size_t take_filled_buffer();
+    void read_ahead();
+    size_t read_stream(char *data, size_t data_size);
 };
 
+// Data of at least this size are written from their memory by a gather write,
+// when the stream supports it. Smaller data are copied to the buffer.
+const size_t GatherMinSize{64 * 1024};
+
+// When the stream is a pipe, the full buffers are spliced to it
 class Writer
 {
   public:
@@ -77,16 +137,31 @@ class Writer
     virtual ~Writer();
 
     void write(const char *data, size_t data_size);
+    // Writes the parts one after another. The parts are not referenced after
+    // the call.
+    void writeVector(const struct iovec *parts, size_t count);
+    // Writes the buffered data to the stream
+    void flush();
 
   private:
     std::ostream &m_ostream;
-    std::unique_ptr<char[]> m_buffer;
+    AlignedBuffer m_buffer;
+    std::unique_ptr<Fd::SpliceBuffer> m_splice_buffer;
+    // Set when the stream supports the gather writes
+    Fd::Stream *m_gather_stream;
+    // Data of the buffer in use
+    char *m_data;
     size_t m_buffer_size;
     const size_t m_buffer_capacity;
+    // The vector of a gather write, with the buffered data first. It is kept
+    // for the next writes, so it is allocated only for more parts than
+    // before.
+    std::vector<struct iovec> m_gather_parts;
 
     void write_buffer(const char *data, size_t data_size);
     void flush_buffer();
     void write_stream(const char *data, size_t data_size);
+    void splice_buffer(size_t size);
 };
 
 } // namespace BufferedStream
@@ -0,0 +1,297 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "compression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace Compression
+{
+
+namespace
+{
+
+// The LZ data are sequences of literals followed by a match. A sequence
+// starts with a token. Its high nibble is the number of the literals, and its
+// low nibble is the length of the match minus the minimal length. The value
+// 15 is extended by the following bytes, which are added to it until a byte
+// other than 255. Then the literals follow. The match is stored as a two-byte
+// little-endian distance back to the data already decompressed, and the
+// extension of its length. The last sequence has only the literals.
+const size_t LzMinMatch{4};
+const size_t LzMaxDistance{65535};
+const size_t LzMaxHashLog{16};
+// Smaller data are not worth compressing
+const size_t LzMinInputSize{32};
+// The Zstandard level with a speed close to the LZ codec
+const int ZstdLevel{1};
+
+uint32_t
+read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Returns false if there is no space for the length
+bool
+writeLength(size_t length, uint8_t *&op, const uint8_t *op_end)
+{
+    for (; length >= 255; length -= 255) {
+        if (op >= op_end) {
+            return false;
+        }
+        *op++ = 255;
+    }
+    if (op >= op_end) {
+        return false;
+    }
+    *op++ = static_cast<uint8_t>(length);
+    return true;
+}
+
+// Returns false if the sequence does not fit
+bool
+writeSequence(const uint8_t *literals, size_t literal_count, size_t distance,
+              size_t match_length, uint8_t *&op, const uint8_t *op_end)
+{
+    if (op >= op_end) {
+        return false;
+    }
+    const size_t match_code{(match_length > 0) ? (match_length - LzMinMatch)
+                                               : 0};
+    *op++ = static_cast<uint8_t>((std::min<size_t>(literal_count, 15) << 4) |
+                                 std::min<size_t>(match_code, 15));
+
+    if ((literal_count >= 15) && !writeLength(literal_count - 15, op, op_end)) {
+        return false;
+    }
+    if (static_cast<size_t>(op_end - op) < literal_count) {
+        return false;
+    }
+    memcpy(op, literals, literal_count);
+    op += literal_count;
+
+    if (match_length == 0) {
+        return true;
+    }
+    if ((op_end - op) < 2) {
+        return false;
+    }
+    *op++ = static_cast<uint8_t>(distance);
+    *op++ = static_cast<uint8_t>(distance >> 8);
+    return (match_code < 15) || writeLength(match_code - 15, op, op_end);
+}
+
+size_t
+compressLz(const char *src, size_t src_size, char *dest, size_t capacity)
+{
+    if (src_size < LzMinInputSize) {
+        return 0;
+    }
+
+    // The table is not larger than needed for the data, so its clearing does
+    // not dominate for small records
+    size_t hash_log{8};
+    while ((hash_log < LzMaxHashLog) && ((1UL << hash_log) < src_size)) {
+        ++hash_log;
+    }
+    thread_local std::vector<uint32_t> table;
+    table.assign(1UL << hash_log, 0);
+
+    const uint8_t *const in{reinterpret_cast<const uint8_t *>(src)};
+    uint8_t *op{reinterpret_cast<uint8_t *>(dest)};
+    const uint8_t *const op_end{op + capacity};
+
+    // The match must not read beyond the input
+    const size_t match_limit{src_size - LzMinMatch};
+    size_t anchor{0};
+    size_t ip{0};
+    while (ip <= match_limit) {
+        const uint32_t seq{read32(in + ip)};
+        const size_t h{(seq * 2654435761U) >> (32 - hash_log)};
+        const size_t ref{table[h]};
+        table[h] = static_cast<uint32_t>(ip);
+
+        if ((ref >= ip) || ((ip - ref) > LzMaxDistance) ||
+            (read32(in + ref) != seq)) {
+            // The step grows in data without matches, so incompressible data
+            // are skipped fast
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        size_t length{LzMinMatch};
+        while (((ip + length) < src_size) &&
+               (in[ref + length] == in[ip + length])) {
+            ++length;
+        }
+        if (!writeSequence(in + anchor, ip - anchor, ip - ref, length, op,
+                           op_end)) {
+            return 0;
+        }
+        ip += length;
+        anchor = ip;
+    }
+
+    if (!writeSequence(in + anchor, src_size - anchor, 0, 0, op, op_end)) {
+        return 0;
+    }
+    return op - reinterpret_cast<uint8_t *>(dest);
+}
+
+// Returns false if the length is truncated
+bool
+readLength(size_t &length, const uint8_t *&ip, const uint8_t *ip_end)
+{
+    uint8_t b;
+    do {
+        if (ip >= ip_end) {
+            return false;
+        }
+        b = *ip++;
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+void
+decompressLz(const char *src, size_t src_size, char *dest, size_t dest_size)
+{
+    const uint8_t *ip{reinterpret_cast<const uint8_t *>(src)};
+    const uint8_t *const ip_end{ip + src_size};
+    uint8_t *const out{reinterpret_cast<uint8_t *>(dest)};
+    size_t op{0};
+
+    while (ip < ip_end) {
+        const uint8_t token{*ip++};
+
+        size_t literal_count{static_cast<size_t>(token >> 4)};
+        if ((literal_count == 15) && !readLength(literal_count, ip, ip_end)) {
+            throw Error("corrupted compressed data");
+        }
+        if ((literal_count > static_cast<size_t>(ip_end - ip)) ||
+            (literal_count > (dest_size - op))) {
+            throw Error("corrupted compressed data");
+        }
+        memcpy(out + op, ip, literal_count);
+        ip += literal_count;
+        op += literal_count;
+
+        if (ip == ip_end) {
+            // The last sequence
+            break;
+        }
+
+        if ((ip_end - ip) < 2) {
+            throw Error("corrupted compressed data");
+        }
+        const size_t distance{static_cast<size_t>(ip[0]) |
+                              (static_cast<size_t>(ip[1]) << 8)};
+        ip += 2;
+        size_t length{static_cast<size_t>(token & 0x0F)};
+        if ((length == 15) && !readLength(length, ip, ip_end)) {
+            throw Error("corrupted compressed data");
+        }
+        length += LzMinMatch;
+        if ((distance == 0) || (distance > op) || (length > (dest_size - op))) {
+            throw Error("corrupted compressed data");
+        }
+
+        // The match can overlap the data being copied. Copying whole periods
+        // of the repeated data keeps the source behind the destination.
+        size_t period{distance};
+        while (length > 0) {
+            const size_t n{std::min(length, period)};
+            memcpy(out + op, out + op - period, n);
+            op += n;
+            length -= n;
+            period *= 2;
+        }
+    }
+
+    if (op != dest_size) {
+        throw Error("corrupted compressed data");
+    }
+}
+
+} // namespace
+
+bool
+isAvailable(Codec codec)
+{
+#ifdef HAVE_ZSTD
+    return (codec == Codec::Lz) || (codec == Codec::Zstd);
+#else
+    return codec == Codec::Lz;
+#endif
+}
+
+size_t
+compress(Codec codec, const char *src, size_t src_size, char *dest,
+         size_t capacity)
+{
+    if (codec == Codec::Lz) {
+        return compressLz(src, src_size, dest, capacity);
+    }
+#ifdef HAVE_ZSTD
+    if (codec == Codec::Zstd) {
+        const size_t size{
+            ZSTD_compress(dest, capacity, src, src_size, ZstdLevel)};
+        return ZSTD_isError(size) ? 0 : size;
+    }
+#endif
+    throw Error("compression codec is not available");
+}
+
+void
+decompress(Codec codec, const char *src, size_t src_size, char *dest,
+           size_t dest_size)
+{
+    if (codec == Codec::Lz) {
+        decompressLz(src, src_size, dest, dest_size);
+        return;
+    }
+#ifdef HAVE_ZSTD
+    if (codec == Codec::Zstd) {
+        const size_t size{ZSTD_decompress(dest, dest_size, src, src_size)};
+        if (ZSTD_isError(size) || (size != dest_size)) {
+            throw Error("corrupted compressed data");
+        }
+        return;
+    }
+#endif
+    throw Error("compression codec is not available");
+}
+
+} // namespace Compression
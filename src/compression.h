@@ -0,0 +1,65 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "exception.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Compression
+{
+
+class Error : public DiffddError
+{
+  public:
+    explicit Error(const std::string &message) : DiffddError(message) {}
+};
+
+// The values are stored in the compressed records
+enum class Codec : uint8_t {
+    None = 0,
+    // Built-in fast LZ77 codec
+    Lz = 1,
+    // Available only if zstd is found at build time
+    Zstd = 2,
+};
+
+// Returns false if the codec is not built in
+bool isAvailable(Codec codec);
+
+// Compresses the data to at most capacity bytes. Returns the size of the
+// compressed data, or 0 if it does not fit.
+size_t compress(Codec codec, const char *src, size_t src_size, char *dest,
+                size_t capacity);
+
+// The data must decompress to exactly dest_size bytes
+void decompress(Codec codec, const char *src, size_t src_size, char *dest,
+                size_t dest_size);
+
+} // namespace Compression
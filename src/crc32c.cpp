@@ -0,0 +1,216 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "crc32c.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace Crc32c
+{
+
+namespace
+{
+
+// Reversed Castagnoli polynomial
+const uint32_t Polynomial{0x82F63B78};
+
+// The functions extend the CRC register, not the final CRC value
+using Extend = uint32_t (*)(uint32_t crc, const uint8_t *data, size_t size);
+
+using ByteTable = std::array<uint32_t, 256>;
+
+ByteTable
+makeByteTable()
+{
+    ByteTable table;
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t crc{n};
+        for (size_t k = 0; k < 8; ++k) {
+            crc = (crc & 1) ? ((crc >> 1) ^ Polynomial) : (crc >> 1);
+        }
+        table[n] = crc;
+    }
+    return table;
+}
+
+const ByteTable byte_table{makeByteTable()};
+
+uint32_t
+portableExtend(uint32_t crc, const uint8_t *data, size_t size)
+{
+    for (; size > 0; --size) {
+        crc = byte_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+
+// The CRC instruction has a latency of three cycles, but a throughput of one
+// per cycle. Three blocks are computed at once, and their CRCs are combined
+// by shifting them over the zeros of the following blocks.
+const size_t LongBlockSize{8192};
+const size_t ShortBlockSize{256};
+
+// Operator of 32x32 bits appending zeros to the CRC register
+using Operator = std::array<uint32_t, 32>;
+
+uint32_t
+multiply(const Operator &op, uint32_t vec)
+{
+    uint32_t sum{0};
+    for (size_t i = 0; vec != 0; ++i, vec >>= 1) {
+        if (vec & 1) {
+            sum ^= op[i];
+        }
+    }
+    return sum;
+}
+
+Operator
+square(const Operator &op)
+{
+    Operator sq;
+    for (size_t i = 0; i < 32; ++i) {
+        sq[i] = multiply(op, op[i]);
+    }
+    return sq;
+}
+
+// Tables of the operator for the four bytes of the register
+using ShiftTable = std::array<ByteTable, 4>;
+
+// The size must be a power of two
+ShiftTable
+makeShiftTable(size_t size)
+{
+    // Operator of one zero bit
+    Operator op;
+    op[0] = Polynomial;
+    for (size_t i = 1; i < 32; ++i) {
+        op[i] = 1U << (i - 1);
+    }
+    // Squared to one zero byte, and then to the size
+    for (size_t bits = 1; bits < (8 * size); bits *= 2) {
+        op = square(op);
+    }
+
+    ShiftTable table;
+    for (uint32_t n = 0; n < 256; ++n) {
+        for (size_t b = 0; b < 4; ++b) {
+            table[b][n] = multiply(op, n << (8 * b));
+        }
+    }
+    return table;
+}
+
+const ShiftTable long_shift_table{makeShiftTable(LongBlockSize)};
+const ShiftTable short_shift_table{makeShiftTable(ShortBlockSize)};
+
+uint32_t
+shift(const ShiftTable &table, uint32_t crc)
+{
+    return table[0][crc & 0xFF] ^ table[1][(crc >> 8) & 0xFF] ^
+           table[2][(crc >> 16) & 0xFF] ^ table[3][crc >> 24];
+}
+
+uint64_t
+load64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+__attribute__((target("sse4.2"))) uint32_t
+extendBlocks(const ShiftTable &table, size_t block_size, uint32_t crc,
+             const uint8_t *&data, size_t &size)
+{
+    while (size >= (3 * block_size)) {
+        uint64_t crc0{crc};
+        uint64_t crc1{0};
+        uint64_t crc2{0};
+        for (const uint8_t *end = data + block_size; data < end; data += 8) {
+            crc0 = _mm_crc32_u64(crc0, load64(data));
+            crc1 = _mm_crc32_u64(crc1, load64(data + block_size));
+            crc2 = _mm_crc32_u64(crc2, load64(data + (2 * block_size)));
+        }
+        crc = shift(table, static_cast<uint32_t>(crc0)) ^
+              static_cast<uint32_t>(crc1);
+        crc = shift(table, crc) ^ static_cast<uint32_t>(crc2);
+        data += 2 * block_size;
+        size -= 3 * block_size;
+    }
+    return crc;
+}
+
+__attribute__((target("sse4.2"))) uint32_t
+sse42Extend(uint32_t crc, const uint8_t *data, size_t size)
+{
+    crc = extendBlocks(long_shift_table, LongBlockSize, crc, data, size);
+    crc = extendBlocks(short_shift_table, ShortBlockSize, crc, data, size);
+
+    uint64_t crc64{crc};
+    for (; size >= 8; size -= 8, data += 8) {
+        crc64 = _mm_crc32_u64(crc64, load64(data));
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; size > 0; --size) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+
+#endif
+
+Extend
+selectExtend()
+{
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return sse42Extend;
+    }
+#endif
+    return portableExtend;
+}
+
+const Extend extend_register{selectExtend()};
+
+} // namespace
+
+uint32_t
+extend(uint32_t crc, const char *data, size_t size)
+{
+    return ~extend_register(~crc, reinterpret_cast<const uint8_t *>(data),
+                            size);
+}
+
+} // namespace Crc32c
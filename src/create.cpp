@@ -26,366 +26,1055 @@
 
 #include "create.h"
 #include "buffered_stream.h"
-#include "format_v2.h"
+#include "compression.h"
+#include "diff_finder.h"
+#include "file_stream.h"
+#include "format_v3.h"
+#include "mapped_file.h"
+#include "scan.h"
+#include "sha256.h"
+#include "signature_format.h"
+#include "sparse.h"
+#include "stats.h"
 
 #include <algorithm>
 #include <array>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
 #include <vector>
 
-class Page
-{
-    friend bool operator==(const Page &lhs, const Page &rhs);
+const uint64_t StreamEnd{BufferedStream::Reader::NoReadLimit};
 
+// The pages point directly to the memory mapping of the file, so no data is
+// copied from the kernel
+class MappedFileReader : public PageReader
+{
   public:
-    Page() : m_start(0), m_end(0){};
+    MappedFileReader(const std::filesystem::path &path, size_t page_size_bytes,
+                     uint64_t start_offset, uint64_t end_offset)
+        : m_reader(path, page_size_bytes, start_offset, end_offset),
+          m_pos_bytes(start_offset)
+    {
+    }
 
-    Page(std::shared_ptr<char[]> data, uint64_t start, uint64_t end)
-        : m_data(data), m_start(start), m_end(end)
+    Page getNextPage() override
     {
-        assert(m_start <= m_end);
-    };
+        const BufferedStream::DataPart dp{m_reader.readPart()};
+
+        m_pos_bytes += dp.size;
 
-    std::shared_ptr<char[]> getData() const { return m_data; };
-    uint64_t getStart() const { return m_start; };
-    uint64_t getEnd() const { return m_end; };
-    size_t getSize() const { return m_end - m_start; };
-    bool isEmpty() const { return getSize() == 0; };
+        return Page{dp.data, m_pos_bytes - dp.size, m_pos_bytes,
+                    m_reader.getGeneration()};
+    }
+
+    bool isValid(const Page &page) const override
+    {
+        return m_reader.isValid(page.getGeneration());
+    }
 
   private:
-    std::shared_ptr<char[]> m_data;
-    uint64_t m_start;
-    uint64_t m_end;
+    MappedFile::Reader m_reader;
+    uint64_t m_pos_bytes;
 };
 
-bool
-operator==(const Page &lhs, const Page &rhs)
+// The stream is used when the file cannot be mapped
+std::unique_ptr<PageReader>
+openPageReader(const Options::Create &opts, size_t page_size,
+               const std::filesystem::path &path, std::istream &istr,
+               uint64_t start_offset, uint64_t end_offset)
+{
+    if (opts.getMmap() && MappedFile::isMappable(path)) {
+        return std::make_unique<MappedFileReader>(path, page_size,
+                                                  start_offset, end_offset);
+    }
+    return std::make_unique<PagedStreamReader>(
+        istr, page_size, opts.getReadAheadCount(), start_offset, end_offset);
+}
+
+// Runs of zeros in the diffs of at least this size are written as zero
+// records. The data is checked for zeros in aligned units. With a larger
+// granularity, both are the granularity, so the records stay aligned.
+const size_t MinZeroRunSize{4096};
+const size_t ZeroCheckUnitSize{512};
+
+// Adds the part of the page data to the record data. Continuous parts of the
+// same page are joined.
+void
+appendRecordData(FormatV3::RecordDataParts &data, const char *part,
+                 size_t size)
+{
+    if (!data.empty() && ((data.back().data + data.back().size) == part)) {
+        data.back().size += size;
+    } else {
+        data.push_back(FormatV3::RecordData{size, part});
+    }
+}
+
+size_t
+getRecordDataSize(const FormatV3::RecordDataParts &data)
 {
-    return (lhs.m_data == rhs.m_data) && (lhs.m_start == rhs.m_start) &&
-           (lhs.m_end == rhs.m_end);
+    size_t size{0};
+    for (const FormatV3::RecordData &rd : data) {
+        size += rd.size;
+    }
+    return size;
 }
 
-class PagedStreamReader
+// Compresses the data records by a pool of threads. The records are written
+// in the order they are passed in. Without a codec, they are written
+// directly.
+//
+// The data records which can be continued by the next ones are joined with
+// them up to the maximum record size. Their data are copied, as the records
+// can be larger than the buffers. The copy is held in chunks of the buffer
+// size, so it is not moved when it grows, and the uncompressed records are
+// written from the chunks.
+class RecordEncoder
 {
   public:
-    PagedStreamReader(std::istream &istr, size_t page_size_bytes)
-        : m_page_size_bytes(page_size_bytes),
-          m_reader(istr, page_size_bytes, 2), m_stream_pos_bytes(0){};
+    RecordEncoder(FormatV3::Writer &writer, Compression::Codec codec,
+                  uint32_t thread_count, uint64_t max_record_size,
+                  size_t chunk_size)
+        : m_writer(writer), m_codec(codec), m_max_pending(2 * thread_count),
+          m_max_record_size(max_record_size), m_chunk_size(chunk_size),
+          m_joined_offset(0), m_joined_size(0), m_stop(false)
+    {
+        if (m_codec == Compression::Codec::None) {
+            return;
+        }
+        for (uint32_t i = 0; i < thread_count; ++i) {
+            m_workers.emplace_back(&RecordEncoder::worker, this);
+        }
+    };
+
+    RecordEncoder(const RecordEncoder &) = delete;
+    RecordEncoder &operator=(const RecordEncoder &) = delete;
+
+    virtual ~RecordEncoder()
+    {
+        {
+            const std::lock_guard<std::mutex> lock{m_mutex};
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        for (auto &w : m_workers) {
+            w.join();
+        }
+    };
 
-    Page getNextPage()
+    // The record may be continued by the next one if the next diff can
+    // follow it directly
+    void writeDataRecord(uint64_t offset, size_t size,
+                         const FormatV3::RecordDataParts &data,
+                         bool may_continue)
     {
-        const BufferedStream::DataPart dp{
-            m_reader.readMultipart(m_page_size_bytes)};
+        if (m_joined_size > 0) {
+            if ((offset == (m_joined_offset + m_joined_size)) &&
+                (size <= (m_max_record_size - m_joined_size))) {
+                appendJoined(data);
+                if (!may_continue) {
+                    flushJoined();
+                }
+                return;
+            }
+            flushJoined();
+        }
 
-        m_stream_pos_bytes += dp.size;
+        if (may_continue && (size < m_max_record_size)) {
+            m_joined_offset = offset;
+            appendJoined(data);
+            return;
+        }
 
-        return Page{dp.data, m_stream_pos_bytes - dp.size, m_stream_pos_bytes};
-    }
+        if (m_codec == Compression::Codec::None) {
+            m_writer.writeDataRecord(offset, size, data);
+            return;
+        }
+
+        // The data can be in the page buffers reused for the next pages
+        std::vector<char> copy;
+        copy.reserve(size);
+        for (const FormatV3::RecordData &rd : data) {
+            copy.insert(copy.end(), rd.data, rd.data + rd.size);
+        }
+        submitDataRecord(offset, std::move(copy));
+    };
+
+    void writeZeroRecord(uint64_t offset, uint64_t size)
+    {
+        flushJoined();
+        if (m_codec == Compression::Codec::None) {
+            m_writer.writeZeroRecord(offset, size);
+            return;
+        }
+
+        const std::shared_ptr<Job> job{std::make_shared<Job>()};
+        job->type = FormatV3::RecordType::Zero;
+        job->offset = offset;
+        job->size = size;
+        job->done = true;
+        submit(job);
+    };
+
+    // Writes the records still being compressed, and the end record
+    void writeEndRecord()
+    {
+        flushJoined();
+        writeFinished(0);
+        m_writer.writeEndRecord();
+    };
 
   private:
-    const size_t m_page_size_bytes;
-    BufferedStream::Reader m_reader;
-    uint64_t m_stream_pos_bytes;
-};
+    struct Job {
+        FormatV3::RecordType type;
+        uint64_t offset;
+        uint64_t size;
+        std::vector<char> data;
+        // Empty if the data cannot be compressed enough
+        std::vector<char> compressed;
+        bool done;
+    };
+
+    FormatV3::Writer &m_writer;
+    const Compression::Codec m_codec;
+    const size_t m_max_pending;
+    const uint64_t m_max_record_size;
+    const size_t m_chunk_size;
+    std::vector<std::thread> m_workers;
+    // The data record waiting for the next one. The chunks are kept for the
+    // next records.
+    uint64_t m_joined_offset;
+    uint64_t m_joined_size;
+    std::vector<std::vector<char>> m_joined;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    // The records not written yet, in order
+    std::deque<std::shared_ptr<Job>> m_pending;
+    // The records not taken by a worker yet
+    std::deque<std::shared_ptr<Job>> m_queued;
+    std::exception_ptr m_error;
+    bool m_stop;
+
+    // All the chunks except the last one are full
+    void appendJoined(const FormatV3::RecordDataParts &data)
+    {
+        for (const FormatV3::RecordData &rd : data) {
+            for (size_t done = 0; done < rd.size;) {
+                const size_t chunk{
+                    static_cast<size_t>(m_joined_size / m_chunk_size)};
+                if (chunk == m_joined.size()) {
+                    try {
+                        m_joined.emplace_back();
+                        m_joined.back().reserve(m_chunk_size);
+                    } catch (const std::bad_alloc &e) {
+                        throw CreateError(
+                            "cannot allocate memory for record data");
+                    }
+                }
+
+                std::vector<char> &c{m_joined[chunk]};
+                const size_t size{
+                    std::min(rd.size - done, m_chunk_size - c.size())};
+                c.insert(c.end(), rd.data + done, rd.data + done + size);
+                done += size;
+                m_joined_size += size;
+            }
+        }
+    };
+
+    void flushJoined()
+    {
+        if (m_joined_size == 0) {
+            return;
+        }
+
+        const size_t chunk_count{static_cast<size_t>(
+            (m_joined_size + m_chunk_size - 1) / m_chunk_size)};
+        if ((m_codec != Compression::Codec::None) &&
+            (m_joined_size <= FormatV3::MaxRecordSize)) {
+            // The compression needs the data in one piece
+            std::vector<char> data;
+            try {
+                data.reserve(static_cast<size_t>(m_joined_size));
+            } catch (const std::bad_alloc &e) {
+                throw CreateError("cannot allocate memory for record data");
+            }
+            for (size_t i = 0; i < chunk_count; ++i) {
+                data.insert(data.end(), m_joined[i].begin(),
+                            m_joined[i].end());
+            }
+            submitDataRecord(m_joined_offset, std::move(data));
+        } else {
+            // The records still being compressed go first
+            writeFinished(0);
+            std::vector<FormatV3::RecordData> parts;
+            for (size_t i = 0; i < chunk_count; ++i) {
+                const std::vector<char> &c{m_joined[i]};
+                parts.push_back(FormatV3::RecordData{c.size(), c.data()});
+            }
+            m_writer.writeLargeDataRecord(m_joined_offset, m_joined_size,
+                                          parts);
+        }
+
+        for (size_t i = 0; i < chunk_count; ++i) {
+            m_joined[i].clear();
+        }
+        m_joined_size = 0;
+    };
+
+    void submitDataRecord(uint64_t offset, std::vector<char> data)
+    {
+        const std::shared_ptr<Job> job{std::make_shared<Job>()};
+        job->type = FormatV3::RecordType::Data;
+        job->offset = offset;
+        job->size = data.size();
+        job->data = std::move(data);
+        job->done = false;
+        submit(job);
+    };
+
+    void submit(const std::shared_ptr<Job> &job)
+    {
+        writeFinished(m_max_pending - 1);
+        {
+            const std::lock_guard<std::mutex> lock{m_mutex};
+            m_pending.push_back(job);
+            if (!job->done) {
+                m_queued.push_back(job);
+            }
+        }
+        m_cond.notify_all();
+    };
+
+    // Writes the finished records from the start of the pending ones. Waits
+    // until no more than the maximum of them remain.
+    void writeFinished(size_t max_pending)
+    {
+        for (;;) {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock{m_mutex};
+                m_cond.wait(lock, [this, max_pending] {
+                    return m_error || m_pending.empty() ||
+                           m_pending.front()->done ||
+                           (m_pending.size() <= max_pending);
+                });
+                if (m_error) {
+                    std::rethrow_exception(m_error);
+                } else if (m_pending.empty() || !m_pending.front()->done) {
+                    return;
+                }
+                job = std::move(m_pending.front());
+                m_pending.pop_front();
+            }
+            writeJob(job);
+        }
+    };
+
+    void writeJob(const std::shared_ptr<Job> &job)
+    {
+        if (job->type == FormatV3::RecordType::Zero) {
+            m_writer.writeZeroRecord(job->offset, job->size);
+        } else if (!job->compressed.empty()) {
+            m_writer.writeCompressedRecord(
+                job->offset, job->size, static_cast<uint8_t>(m_codec),
+                job->compressed.data(), job->compressed.size());
+        } else {
+            m_writer.writeDataRecord(
+                job->offset, job->size,
+                {FormatV3::RecordData{job->size, job->data.data()}});
+        }
+    };
+
+    void worker()
+    {
+        for (;;) {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock{m_mutex};
+                m_cond.wait(lock,
+                            [this] { return m_stop || !m_queued.empty(); });
+                if (m_stop) {
+                    return;
+                }
+                job = std::move(m_queued.front());
+                m_queued.pop_front();
+            }
+
+            try {
+                compressJob(*job);
+            } catch (...) {
+                const std::lock_guard<std::mutex> lock{m_mutex};
+                if (!m_error) {
+                    m_error = std::current_exception();
+                }
+            }
+
+            {
+                const std::lock_guard<std::mutex> lock{m_mutex};
+                job->done = true;
+            }
+            m_cond.notify_all();
+        }
+    };
 
-enum class MergeState {
-    Finished,
-    Incomplete,
+    void compressJob(Job &job)
+    {
+        // The compressed record has a larger header. The data must be
+        // smaller by more than that.
+        // The records larger than the limit of the readers are not
+        // compressed.
+        const size_t header_growth{sizeof(uint8_t) +
+                                   FormatV3::getVarintSize(job.size)};
+        if ((job.size <= (header_growth + 1)) ||
+            (job.size > FormatV3::MaxRecordSize)) {
+            return;
+        }
+        job.compressed.resize(job.size - header_growth - 1);
+        const size_t size{Compression::compress(
+            m_codec, job.data.data(), job.size, job.compressed.data(),
+            job.compressed.size())};
+        job.compressed.resize(size);
+    };
 };
 
-class Diff
+// Writes the diff as data records, and zero records for the long runs of
+// zeros in it. The last data record may be continued by the next diff.
+void
+writeDiff(RecordEncoder &writer, uint64_t offset,
+          const FormatV3::RecordDataParts &data, size_t granularity,
+          bool may_continue)
 {
-    friend MergeState diffsTryMerge(Diff &diff_a, Diff &diff_b,
-                                    size_t max_merge_gap, size_t max_size);
+    const size_t min_zero_run_size{std::max(MinZeroRunSize, granularity)};
+    const size_t zero_check_unit_size{std::max(ZeroCheckUnitSize, granularity)};
 
+    // The data record is not written until the zero run after it is known to
+    // be long enough. A short zero run is added to the data record. The runs
+    // are in the same parts of the memory as the diff data, so they have no
+    // more parts than it.
+    uint64_t data_start{offset};
+    FormatV3::RecordDataParts data_run;
+    FormatV3::RecordDataParts zero_run;
+
+    const auto finishZeroRun{[&](bool last) {
+        const size_t zero_size{getRecordDataSize(zero_run)};
+        if (zero_size >= min_zero_run_size) {
+            const size_t data_size{getRecordDataSize(data_run)};
+            if (data_size > 0) {
+                writer.writeDataRecord(data_start, data_size, data_run, false);
+            }
+            writer.writeZeroRecord(data_start + data_size, zero_size);
+            data_start += data_size + zero_size;
+            data_run.clear();
+        } else {
+            for (const FormatV3::RecordData &rd : zero_run) {
+                appendRecordData(data_run, rd.data, rd.size);
+            }
+        }
+        zero_run.clear();
+
+        const size_t data_size{getRecordDataSize(data_run)};
+        if (last && (data_size > 0)) {
+            writer.writeDataRecord(data_start, data_size, data_run,
+                                   may_continue);
+        }
+    }};
+
+    uint64_t pos{offset};
+    for (const FormatV3::RecordData &rd : data) {
+        const char *const part_end{rd.data + rd.size};
+        for (const char *unit = rd.data; unit < part_end;) {
+            const size_t unit_size{static_cast<size_t>(std::min<uint64_t>(
+                zero_check_unit_size - (pos % zero_check_unit_size),
+                part_end - unit))};
+            const bool zero{Scan::findFirstNonZero(unit, unit_size) ==
+                            unit_size};
+
+            if (zero) {
+                appendRecordData(zero_run, unit, unit_size);
+            } else {
+                if (!zero_run.empty()) {
+                    finishZeroRun(false);
+                }
+                appendRecordData(data_run, unit, unit_size);
+            }
+
+            unit += unit_size;
+            pos += unit_size;
+        }
+    }
+    finishZeroRun(true);
+}
+
+// Compares the blocks of the input file with their digests from the signature
+// file, so the base file is not read at all. The diffs consist of whole
+// blocks.
+class SignatureDiffFinder : public DiffSource
+{
   public:
-    explicit Diff(uint64_t start_end)
-        : m_pages{}, m_start{start_end}, m_end{start_end}
+    // The pages must consist of whole blocks, except the last one. The start
+    // offset must be at a block boundary. The diffs are not larger than the
+    // maximum size, unless it is smaller than a block.
+    SignatureDiffFinder(std::istream &signature_stream, uint32_t block_size,
+                        size_t buffer_size,
+                        std::unique_ptr<PageReader> new_page_reader,
+                        uint64_t start_offset, size_t max_diff_size)
+        : m_signature_reader(
+              seekToBlock(signature_stream, start_offset / block_size),
+              buffer_size),
+          m_new_page_reader(std::move(new_page_reader)),
+          m_block_size(block_size), m_max_diff_size(max_diff_size),
+          m_offset_in_stream(start_offset)
     {
-        assert(m_start <= m_end);
+        assert((start_offset % block_size) == 0);
     };
-    Diff(Page page, uint64_t start, uint64_t end)
-        : m_pages{page}, m_start{start}, m_end{end}
-    {
-        assert(m_start <= m_end);
-    };
-    uint64_t getStart() const { return m_start; };
-    uint64_t getEnd() const { return m_end; };
-    size_t getSize() const { return m_end - m_start; };
-    bool isEmpty() const { return getSize() == 0; };
 
-    std::vector<FormatV2::RecordData> getData() const
+    Diff findNextDiff() override
     {
-        std::vector<FormatV2::RecordData> data{};
-
-        if (!m_pages[0].isEmpty() && m_pages[1].isEmpty()) {
-            // Only the first page
-            assert((m_start >= m_pages[0].getStart()) &&
-                   (m_start <= m_pages[0].getEnd()) &&
-                   (m_end >= m_pages[0].getStart()) &&
-                   (m_end <= m_pages[0].getEnd()));
-
-            const uint64_t offset{m_start - m_pages[0].getStart()};
-            auto data_first{std::shared_ptr<char[]>{
-                m_pages[0].getData(),
-                static_cast<char *>(m_pages[0].getData().get()) + offset}};
-            data.push_back(FormatV2::RecordData{getSize(), data_first});
-        } else if (!m_pages[0].isEmpty() && !m_pages[1].isEmpty()) {
-            // Both pages
-            assert((m_start >= m_pages[0].getStart()) &&
-                   (m_start <= m_pages[0].getEnd()) &&
-                   (m_end >= m_pages[1].getStart()) &&
-                   (m_end <= m_pages[1].getEnd()));
-
-            size_t size{m_pages[0].getEnd() - m_start};
-            const uint64_t offset{m_start - m_pages[0].getStart()};
-            auto data_first{std::shared_ptr<char[]>{
-                m_pages[0].getData(),
-                static_cast<char *>(m_pages[0].getData().get()) + offset}};
-            data.push_back(FormatV2::RecordData{size, data_first});
-
-            size = m_end - m_pages[1].getStart();
-            data.push_back(FormatV2::RecordData{size, m_pages[1].getData()});
-        }
-
-        return data;
+        for (;;) {
+            if (m_new_page.isEmpty() ||
+                (m_offset_in_stream == m_new_page.getEnd())) {
+                m_new_page = m_new_page_reader->getNextPage();
+                if (m_new_page.isEmpty()) {
+                    return Diff{m_offset_in_stream};
+                }
+                assert(m_new_page.getStart() == m_offset_in_stream);
+                Stats::add(Stats::Counter::InputBytesRead,
+                           m_new_page.getSize());
+                Stats::add(Stats::Counter::BytesCompared,
+                           m_new_page.getSize());
+                // The signature stands for the base data. The digests of all
+                // the blocks of the page are compared.
+                const uint64_t block_count{
+                    (m_new_page.getSize() + m_block_size - 1) / m_block_size};
+                Stats::add(Stats::Counter::BaseBytesRead,
+                           block_count * Sha256::DigestSize);
+            }
+
+            // Find the first different block and the first same block after
+            // it. The diff does not continue to the next page.
+            bool different{false};
+            uint64_t diff_start{m_offset_in_stream};
+            while (m_offset_in_stream < m_new_page.getEnd()) {
+                const uint64_t block_start{m_offset_in_stream};
+                const bool same{compareNextBlock()};
+                if (!same && !different) {
+                    different = true;
+                    diff_start = block_start;
+                } else if (same && different) {
+                    return Diff{m_new_page, diff_start, block_start};
+                }
+                if (different &&
+                    ((m_offset_in_stream - diff_start) >= m_max_diff_size)) {
+                    return Diff{m_new_page, diff_start, m_offset_in_stream};
+                }
+            }
+            if (different) {
+                return Diff{m_new_page, diff_start, m_new_page.getEnd()};
+            }
+        }
     };
 
   private:
-    std::array<Page, 2> m_pages;
-    uint64_t m_start;
-    uint64_t m_end;
+    SignatureFormat::Reader m_signature_reader;
+    std::unique_ptr<PageReader> m_new_page_reader;
+    const uint32_t m_block_size;
+    const size_t m_max_diff_size;
+    Page m_new_page;
+    uint64_t m_offset_in_stream;
 
-    bool hasPage(size_t i) // cppcheck-suppress unusedPrivateFunction
+    static std::istream &seekToBlock(std::istream &signature_stream,
+                                     uint64_t block)
     {
-        return (i < m_pages.size()) && (m_pages[i].getData() != nullptr);
+        signature_stream.clear();
+        const uint64_t offset{SignatureFormat::HeaderSize +
+                              (block * Sha256::DigestSize)};
+        if (!signature_stream.seekg(offset, std::ios_base::beg)) {
+            throw CreateError("cannot seek in the signature file");
+        }
+        return signature_stream;
+    };
+
+    bool compareNextBlock()
+    {
+        const uint64_t block_end{std::min<uint64_t>(
+            m_offset_in_stream + m_block_size, m_new_page.getEnd())};
+        const char *const data{m_new_page.getData() +
+                               (m_offset_in_stream - m_new_page.getStart())};
+        const Sha256::Digest digest{
+            Sha256::compute(data, block_end - m_offset_in_stream)};
+        m_offset_in_stream = block_end;
+        return digest == m_signature_reader.readDigest();
     };
 };
 
-MergeState
-diffsTryMerge(Diff &diff_a, Diff &diff_b, size_t max_merge_gap, size_t max_size)
+FileStream::Config
+getFileStreamConfig(const Options::Create &opts)
 {
-    if (diff_a.isEmpty()) {
-        // Do not merge to an empty diff
-        return MergeState::Finished;
-    }
+    return FileStream::Config{opts.getIoBackend(), opts.getBufferSize(),
+                              opts.getQueueDepth()};
+}
 
-    if (diff_b.isEmpty()) {
-        // Nothing to merge from an empty diff
-        return MergeState::Finished;
+std::unique_ptr<std::istream>
+openInStream(const Options::Create &opts)
+{
+    std::unique_ptr<std::istream> in_istream{
+        FileStream::openInput(opts.getInFilePath(), getFileStreamConfig(opts))};
+    if (!*in_istream) {
+        throw BufferedStream::Error("cannot open input file");
     }
+    return in_istream;
+}
 
-    assert(diff_a.getEnd() <= diff_b.getStart());
-    const size_t gap{diff_b.getStart() - diff_a.getEnd()};
-    if (gap > max_merge_gap) {
-        // B is too far away
-        return MergeState::Finished;
+// Opens the signature file, if used, instead of the base file
+std::unique_ptr<std::istream>
+openOldStream(const Options::Create &opts)
+{
+    if (!opts.getSignatureFilePath().empty()) {
+        std::unique_ptr<std::istream> sig_istream{FileStream::openInput(
+            opts.getSignatureFilePath(), getFileStreamConfig(opts))};
+        if (!*sig_istream) {
+            throw BufferedStream::Error("cannot open signature file");
+        }
+        return sig_istream;
     }
 
-    if ((diff_a.getSize() + gap) >= max_size) {
-        // No space in A
-        return MergeState::Finished;
+    std::unique_ptr<std::istream> base_istream{FileStream::openInput(
+        opts.getBaseFilePath(), getFileStreamConfig(opts))};
+    if (!*base_istream) {
+        throw BufferedStream::Error("cannot open base file");
     }
+    return base_istream;
+}
 
-    // Can be merged
+// The diffs are in at most two pages, so they are not larger than a page.
+// With a smaller maximum record size, they are not larger than it, rounded
+// down to whole blocks of the granularity or of the signature.
+size_t
+getMaxDiffSize(const Options::Create &opts, size_t page_size,
+               uint32_t signature_block_size)
+{
+    const size_t unit{(signature_block_size > 0) ? signature_block_size
+                                                 : opts.getGranularity()};
+    const size_t size{static_cast<size_t>(
+        std::min<uint64_t>(page_size, opts.getMaxRecordSize()))};
+    return std::max(size - (size % unit), unit);
+}
 
-    // Adjust the diff start and end offsets
+// Whether the next diff can start at the end of the diff. The diff sources end
+// the diffs at their maximum size, and at the ends of the pages.
+bool
+mayContinue(uint64_t end, size_t size, size_t page_size, size_t max_diff_size)
+{
+    return (size >= max_diff_size) || ((end % page_size) == 0);
+}
 
-    // There is always at least 1 byte free in A here
-    const size_t free{max_size - (diff_a.getSize() + gap)};
-    const size_t to_merge{std::min(free, diff_b.getSize())};
-    // There is always at least 1 byte to merge from B here
+// The old stream is the base file stream, or the signature file stream when
+// the signature block size is not 0
+std::unique_ptr<DiffSource>
+openDiffSource(const Options::Create &opts, size_t page_size,
+               uint32_t signature_block_size, std::istream &old_stream,
+               std::istream &new_stream, uint64_t start_offset,
+               uint64_t end_offset)
+{
+    std::unique_ptr<PageReader> new_page_reader{
+        openPageReader(opts, page_size, opts.getInFilePath(), new_stream,
+                       start_offset, end_offset)};
+    const size_t max_diff_size{
+        getMaxDiffSize(opts, page_size, signature_block_size)};
 
-    // Enlarge A
-    diff_a.m_end += gap + to_merge;
-    // Shrink B
-    diff_b.m_start += to_merge;
+    if (signature_block_size > 0) {
+        return std::make_unique<SignatureDiffFinder>(
+            old_stream, signature_block_size, opts.getBufferSize(),
+            std::move(new_page_reader), start_offset, max_diff_size);
+    }
 
-    // Add B's page to A if needed
+    // The diffs closer than the header of a fixed-size record are merged. It
+    // is about the size of a compact record header with its checksum and its
+    // index entry.
+    return std::make_unique<DiffFinder>(
+        openPageReader(opts, page_size, opts.getBaseFilePath(), old_stream,
+                       start_offset, end_offset),
+        std::move(new_page_reader), max_diff_size, FormatV3::RecordHeaderSize,
+        start_offset, opts.getGranularity());
+}
 
-    // Non-empty A must have only the first, or both pages
-    assert(diff_a.hasPage(0));
-    // Non-empty B must have only the first page
-    assert(diff_b.hasPage(0) && !diff_b.hasPage(1));
+// Ranges of the files with data in at least one of them, extended to page
+// boundaries. The ranges between them are holes in both files, which are the
+// same, so they are not read at all. The holes are not detected in the
+// signature mode, and in files that are not regular.
+std::vector<Sparse::Extent>
+findSearchRanges(const Options::Create &opts, size_t page_size,
+                 uint32_t signature_block_size, uint64_t start, uint64_t end)
+{
+    if ((signature_block_size > 0) || (end == StreamEnd) ||
+        !Sparse::isRegularFile(opts.getBaseFilePath()) ||
+        !Sparse::isRegularFile(opts.getInFilePath())) {
+        return {Sparse::Extent{start, end}};
+    }
+
+    std::vector<Sparse::Extent> extents{
+        Sparse::findDataExtents(opts.getBaseFilePath(), start, end)};
+    for (const Sparse::Extent &e :
+         Sparse::findDataExtents(opts.getInFilePath(), start, end)) {
+        extents.push_back(e);
+    }
+    std::sort(extents.begin(), extents.end(),
+              [](const Sparse::Extent &a, const Sparse::Extent &b) {
+                  return a.start < b.start;
+              });
 
-    // If A has both pages, B's page must only be the same as A's second
-    // page. No setting of pages in A is needed in this case
-    assert(!diff_a.hasPage(1) || (diff_b.m_pages[0] == diff_a.m_pages[1]));
-    if (!diff_a.hasPage(1)) {
-        // If A has only the first page, B's page must only be the same as the
-        // A's first page or following it
-        const bool b_follows{
-            (diff_b.m_pages[0].getData() != diff_a.m_pages[0].getData()) &&
-            (diff_b.m_pages[0].getStart() == diff_a.m_pages[0].getEnd())};
-        assert((diff_b.m_pages[0] == diff_a.m_pages[0]) || b_follows);
-        if (b_follows) {
-            diff_a.m_pages[1] = diff_b.m_pages[0];
+    // The start offset is at a page boundary
+    std::vector<Sparse::Extent> ranges;
+    for (const Sparse::Extent &e : extents) {
+        const uint64_t range_start{e.start - ((e.start - start) % page_size)};
+        const uint64_t range_end{std::min(
+            end, e.end + ((page_size - ((e.end - start) % page_size)) %
+                          page_size))};
+        if (!ranges.empty() && (range_start <= ranges.back().end)) {
+            ranges.back().end = std::max(ranges.back().end, range_end);
+        } else {
+            ranges.push_back(Sparse::Extent{range_start, range_end});
         }
     }
+    return ranges;
+}
 
-    return (diff_a.getSize() >= max_size) ? MergeState::Finished
-                                          : MergeState::Incomplete;
+// The signature stream is positioned by its diff source
+void
+seekStreams(std::istream &old_stream, std::istream &new_stream,
+            uint32_t signature_block_size, uint64_t offset)
+{
+    std::vector<std::istream *> streams{&new_stream};
+    if (signature_block_size == 0) {
+        streams.push_back(&old_stream);
+    }
+    for (std::istream *s : streams) {
+        s->clear();
+        if (!s->seekg(offset, std::ios_base::beg)) {
+            throw CreateError("cannot seek in the input files");
+        }
+    }
 }
 
-class DiffFinder
+// Number of pages in one range of the files searched by a worker thread. The
+// ranges start at page boundaries. The diff sources never merge diffs across
+// them, so the ranges can be searched independently and their diffs just
+// concatenated.
+const uint64_t RangeBufferCount{8};
+
+class ParallelDiffFinder
 {
   public:
-    DiffFinder(std::istream &old_stream, std::istream &new_stream,
-               uint32_t buffer_size, size_t max_merge_gap)
-        : m_old_page_reader(old_stream, buffer_size),
-          m_new_page_reader(new_stream, buffer_size),
-          m_diff_max_size(buffer_size), m_max_merge_gap(max_merge_gap),
-          m_offset_in_stream(0), m_diff(0),
-          m_search_state(SearchState::ReadPages){};
-
-    Diff findNextDiff()
+    ParallelDiffFinder(const Options::Create &opts, uint64_t stream_size,
+                       size_t page_size, uint32_t signature_block_size)
+        : m_opts(opts), m_page_size(page_size),
+          m_signature_block_size(signature_block_size),
+          m_max_diff_size(
+              getMaxDiffSize(opts, page_size, signature_block_size)),
+          m_range_size(RangeBufferCount * page_size),
+          m_range_count((stream_size + m_range_size - 1) / m_range_size),
+          m_stream_size(stream_size), m_next_range(0), m_written_ranges(0),
+          m_abort(false){};
+
+    void run(RecordEncoder &writer)
     {
-        for (;;) {
-            if (m_search_state == SearchState::ReadPages) {
-                m_old_page = m_old_page_reader.getNextPage();
-                m_new_page = m_new_page_reader.getNextPage();
-                assert(m_old_page.getStart() == m_new_page.getStart());
-
-                if (m_old_page.getSize() != m_new_page.getSize()) {
-                    throw CreateError(
-                        "cannot read the same amount of data from both files");
-                }
+        std::vector<std::thread> workers;
+        for (uint32_t i = 0; i < m_opts.getThreadCount(); ++i) {
+            workers.emplace_back(&ParallelDiffFinder::worker, this);
+        }
 
-                const bool end_of_stream{m_old_page.isEmpty() &&
-                                         m_new_page.isEmpty()};
-                if (end_of_stream) {
-                    const Diff return_diff{m_diff};
-                    m_diff = Diff{m_offset_in_stream};
-                    return return_diff;
-                }
+        try {
+            writeRanges(writer);
+        } catch (...) {
+            setError(std::current_exception());
+        }
 
-                m_search_state = SearchState::FindDiff;
+        for (auto &w : workers) {
+            w.join();
+        }
 
-            } else if (m_search_state == SearchState::FindDiff) {
-                Diff diff{findDiffInPages(m_old_page, m_new_page,
-                                          m_offset_in_stream)};
-                m_offset_in_stream = diff.getEnd();
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+    };
 
-                if (diff.isEmpty()) {
-                    // End of pages. On the next call, read new pages.
-                    m_old_page = Page{};
-                    m_new_page = Page{};
-                    m_search_state = SearchState::ReadPages;
-                }
+  private:
+    struct Record {
+        uint64_t offset;
+        size_t size;
+        size_t data_offset;
+    };
 
-                const MergeState merge_state{diffsTryMerge(
-                    m_diff, diff, m_max_merge_gap, m_diff_max_size)};
+    struct RangeDiffs {
+        std::vector<Record> records;
+        std::vector<char> data;
+    };
 
-                if (merge_state == MergeState::Finished) {
-                    const Diff return_diff{m_diff};
-                    m_diff = diff;
-                    if (!return_diff.isEmpty()) {
-                        return return_diff;
-                    }
+    const Options::Create &m_opts;
+    const size_t m_page_size;
+    const uint32_t m_signature_block_size;
+    const size_t m_max_diff_size;
+    const uint64_t m_range_size;
+    const uint64_t m_range_count;
+    const uint64_t m_stream_size;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    uint64_t m_next_range;
+    uint64_t m_written_ranges;
+    std::map<uint64_t, RangeDiffs> m_found_ranges;
+    std::exception_ptr m_error;
+    bool m_abort;
+
+    void setError(std::exception_ptr error)
+    {
+        const std::lock_guard<std::mutex> lock{m_mutex};
+        if (!m_error) {
+            m_error = error;
+        }
+        m_abort = true;
+        m_cond.notify_all();
+    };
+
+    void writeRanges(RecordEncoder &writer)
+    {
+        for (uint64_t range = 0; range < m_range_count; ++range) {
+            RangeDiffs diffs;
+            {
+                std::unique_lock<std::mutex> lock{m_mutex};
+                m_cond.wait(lock, [this, range] {
+                    return m_abort || (m_found_ranges.count(range) > 0);
+                });
+                if (m_abort) {
+                    return;
                 }
+                diffs = std::move(m_found_ranges[range]);
+                m_found_ranges.erase(range);
+                ++m_written_ranges;
+            }
+            m_cond.notify_all();
 
-            } else {
-                assert(false);
+            for (const Record &r : diffs.records) {
+                writeDiff(writer, r.offset,
+                          {FormatV3::RecordData{
+                              r.size, diffs.data.data() + r.data_offset}},
+                          m_opts.getGranularity(),
+                          mayContinue(r.offset + r.size, r.size, m_page_size,
+                                      m_max_diff_size));
             }
         }
     };
 
-  private:
-    enum class SearchState { ReadPages, FindDiff };
+    void worker()
+    {
+        try {
+            const std::unique_ptr<std::istream> in_istream{
+                openInStream(m_opts)};
+            const std::unique_ptr<std::istream> old_istream{
+                openOldStream(m_opts)};
 
-    PagedStreamReader m_old_page_reader;
-    PagedStreamReader m_new_page_reader;
-    const size_t m_diff_max_size;
-    const size_t m_max_merge_gap;
-    Page m_old_page;
-    Page m_new_page;
-    uint64_t m_offset_in_stream;
-    Diff m_diff;
-    SearchState m_search_state;
+            for (;;) {
+                uint64_t range;
+                {
+                    // Do not get too far ahead of the writing. The diffs of
+                    // the found ranges are held in memory until written.
+                    std::unique_lock<std::mutex> lock{m_mutex};
+                    m_cond.wait(lock, [this] {
+                        return m_abort || (m_next_range >= m_range_count) ||
+                               (m_next_range <
+                                m_written_ranges +
+                                    (2 * m_opts.getThreadCount()));
+                    });
+                    if (m_abort || (m_next_range >= m_range_count)) {
+                        return;
+                    }
+                    range = m_next_range++;
+                }
 
-    Diff findDiffInPages(Page old_page, Page new_page,
-                         uint64_t offset_in_stream)
+                RangeDiffs diffs{findRangeDiffs(*old_istream, *in_istream,
+                                                range * m_range_size)};
+                {
+                    const std::lock_guard<std::mutex> lock{m_mutex};
+                    m_found_ranges[range] = std::move(diffs);
+                }
+                m_cond.notify_all();
+            }
+        } catch (...) {
+            setError(std::current_exception());
+        }
+    };
+
+    RangeDiffs findRangeDiffs(std::istream &old_stream,
+                              std::istream &new_stream, uint64_t start)
     {
-        const char *old_data{old_page.getData().get()};
-        const char *new_data{new_page.getData().get()};
-        const uint64_t data_size_bytes{old_page.getSize()};
+        const uint64_t end{std::min(start + m_range_size, m_stream_size)};
 
-        assert(offset_in_stream >= new_page.getStart());
-        size_t offset_in_pages{offset_in_stream - new_page.getStart()};
+        RangeDiffs diffs;
+        for (const Sparse::Extent &r :
+             findSearchRanges(m_opts, m_page_size, m_signature_block_size,
+                              start, end)) {
+            seekStreams(old_stream, new_stream, m_signature_block_size,
+                        r.start);
+            const std::unique_ptr<DiffSource> diff_source{
+                openDiffSource(m_opts, m_page_size, m_signature_block_size,
+                               old_stream, new_stream, r.start, r.end)};
+            for (;;) {
+                const Diff diff{diff_source->findNextDiff()};
+                if (diff.isEmpty()) {
+                    break;
+                }
 
-        // Find offset of the first different byte
-        for (; offset_in_pages < data_size_bytes; ++offset_in_pages) {
-            if (new_data[offset_in_pages] != old_data[offset_in_pages]) {
-                break;
+                // The page buffers of the finder are reused for the next
+                // pages. Copy the data.
+                diffs.records.push_back(Record{diff.getStart(), diff.getSize(),
+                                               diffs.data.size()});
+                for (const FormatV3::RecordData &rd : diff.getData()) {
+                    diffs.data.insert(diffs.data.end(), rd.data,
+                                      rd.data + rd.size);
+                }
             }
         }
-        const size_t start_in_pages{offset_in_pages};
 
-        if (offset_in_pages < data_size_bytes) {
-            // Different byte found. Start searching for a same byte immediately
-            // after.
-            ++offset_in_pages;
+        return diffs;
+    };
+};
+
+uint64_t
+getStreamSize(std::istream &istream)
+{
+    const int64_t size{FileStream::getStreamSize(istream)};
+    if (size < 0) {
+        throw CreateError("cannot get size of the input files");
+    }
+    return static_cast<uint64_t>(size);
+}
+
+// Finds the diffs sequentially
+void
+findDiffs(const Options::Create &opts, std::istream &old_istream,
+          std::istream &in_istream, size_t page_size,
+          uint32_t signature_block_size, RecordEncoder &diff_writer)
+{
+    // Holes can be skipped only in files of a known size
+    uint64_t end{StreamEnd};
+    if ((signature_block_size == 0) &&
+        Sparse::isRegularFile(opts.getBaseFilePath()) &&
+        Sparse::isRegularFile(opts.getInFilePath())) {
+        end = getStreamSize(in_istream);
+        if (getStreamSize(old_istream) != end) {
+            throw CreateError(
+                "cannot read the same amount of data from both files");
         }
+    }
 
-        // Find offset of the first same byte
-        for (; offset_in_pages < data_size_bytes; ++offset_in_pages) {
-            if (new_data[offset_in_pages] == old_data[offset_in_pages]) {
-                break;
-            }
+    const size_t max_diff_size{
+        getMaxDiffSize(opts, page_size, signature_block_size)};
+    for (const Sparse::Extent &r : findSearchRanges(
+             opts, page_size, signature_block_size, 0, end)) {
+        if (r.start > 0) {
+            seekStreams(old_istream, in_istream, signature_block_size,
+                        r.start);
         }
-        const size_t end_in_pages{offset_in_pages};
+        const std::unique_ptr<DiffSource> diff_source{
+            openDiffSource(opts, page_size, signature_block_size,
+                           old_istream, in_istream, r.start, r.end)};
 
-        // In the case when no different byte is found, the end offset will be
-        // the same as the start offset
+        for (;;) {
+            const Diff diff{diff_source->findNextDiff()};
+            if (diff.isEmpty()) {
+                break;
+            }
 
-        const uint64_t start_in_stream{new_page.getStart() + start_in_pages};
-        const uint64_t end_in_stream{new_page.getStart() + end_in_pages};
-        if (start_in_stream == end_in_stream) {
-            return Diff{start_in_stream};
-        } else {
-            return Diff{new_page, start_in_stream, end_in_stream};
+            // The data of the diff stay valid only until the next diff is
+            // found
+            writeDiff(diff_writer, diff.getStart(), diff.getData(),
+                      opts.getGranularity(),
+                      mayContinue(diff.getEnd(), diff.getSize(), page_size,
+                                  max_diff_size));
         }
     }
-};
+}
 
 void
 create(const Options::Create &opts)
 {
-    std::ifstream in_istream{opts.getInFilePath(),
-                             std::ifstream::in | std::ifstream::binary};
-    if (!in_istream) {
-        throw BufferedStream::Error("cannot open input file");
-    }
+    const std::unique_ptr<std::istream> in_istream{openInStream(opts)};
+    const std::unique_ptr<std::istream> old_istream{openOldStream(opts)};
 
-    std::ifstream base_istream{opts.getBaseFilePath(),
-                               std::ifstream::in | std::ifstream::binary};
-    if (!base_istream) {
-        throw BufferedStream::Error("cannot open base file");
-    }
+    // The progress is measured in the compared bytes of the input
+    Stats::Reporter reporter{
+        "create",
+        opts.getStats(),
+        opts.getProgress(),
+        opts.getStatsJsonPath(),
+        Stats::Counter::BytesCompared,
+        static_cast<uint64_t>(
+            std::max<int64_t>(FileStream::getStreamSize(*in_istream), 0))};
 
     // When backing up, the output file is truncated to hold the new data
-    std::ofstream out_ostream{opts.getOutFilePath(), std::ofstream::out |
-                                                         std::ofstream::trunc |
-                                                         std::ofstream::binary};
-    if (!out_ostream) {
+    const std::unique_ptr<std::ostream> out_ostream{FileStream::openOutput(
+        opts.getOutFilePath(), true, getFileStreamConfig(opts))};
+    if (!*out_ostream) {
         throw BufferedStream::Error("cannot open output file");
     }
 
-    DiffFinder diff_finder(base_istream, in_istream, opts.getBufferSize(),
-                           FormatV2::RecordHeaderSize);
-    FormatV2::Writer diff_writer(out_ostream, opts.getBufferSize());
+    size_t page_size{opts.getBufferSize()};
+    uint32_t signature_block_size{0};
+    if (!opts.getSignatureFilePath().empty()) {
+        const SignatureFormat::Header header{
+            SignatureFormat::readHeader(*old_istream)};
+        signature_block_size = header.block_size;
+        if (signature_block_size > opts.getMaxRecordSize()) {
+            throw CreateError(
+                "signature block size larger than the maximum record size");
+        }
+        // The pages must consist of whole blocks
+        page_size -= page_size % signature_block_size;
+        page_size = std::max<size_t>(page_size, signature_block_size);
 
-    for (;;) {
-        const Diff diff{diff_finder.findNextDiff()};
-        if (diff.isEmpty()) {
-            break;
+        if (getStreamSize(*in_istream) != header.image_size) {
+            throw CreateError("input file size does not match the signature");
         }
+    } else {
+        // The pages must consist of whole blocks of the granularity, so the
+        // diffs in them are aligned
+        const size_t granularity{opts.getGranularity()};
+        page_size -= page_size % granularity;
+        page_size = std::max<size_t>(page_size, granularity);
+    }
 
-        diff_writer.writeDiffRecord(diff.getStart(), diff.getSize(),
-                                    diff.getData());
+    const Compression::Codec codec{opts.getCompressionCodec()};
+    FormatV3::Writer format_writer(
+        *out_ostream, opts.getBufferSize(),
+        (codec != Compression::Codec::None) ? FormatV3::FeatureCompression : 0,
+        opts.getGranularity());
+    RecordEncoder diff_writer(format_writer, codec, opts.getThreadCount(),
+                              opts.getMaxRecordSize(), opts.getBufferSize());
 
-        // Here, the diff is destructed and page data reference counters
-        // decremented
+    if (opts.getThreadCount() > 1) {
+        const uint64_t in_size{getStreamSize(*in_istream)};
+        if ((signature_block_size == 0) &&
+            (getStreamSize(*old_istream) != in_size)) {
+            throw CreateError(
+                "cannot read the same amount of data from both files");
+        }
+
+        ParallelDiffFinder diff_finder(opts, in_size, page_size,
+                                       signature_block_size);
+        diff_finder.run(diff_writer);
+    } else {
+        findDiffs(opts, *old_istream, *in_istream, page_size,
+                  signature_block_size, diff_writer);
     }
+
+    diff_writer.writeEndRecord();
+    reporter.finish();
 }
@@ -0,0 +1,453 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "buffered_stream.h"
+#include "create.h"
+#include "format_v3.h"
+#include "scan.h"
+#include "stats.h"
+
+#include <array>
+#include <cassert>
+#include <memory>
+
+// Finding of the differences of two files page by page
+
+class Page
+{
+    friend bool operator==(const Page &lhs, const Page &rhs);
+
+  public:
+    Page() : m_data(nullptr), m_start(0), m_end(0), m_generation(0){};
+
+    // The data are owned by the page reader. The generation tells the reader
+    // which of its buffers holds them.
+    Page(const char *data, uint64_t start, uint64_t end,
+         uint64_t generation = 0)
+        : m_data(data), m_start(start), m_end(end), m_generation(generation)
+    {
+        assert(m_start <= m_end);
+    };
+
+    const char *getData() const { return m_data; };
+    uint64_t getStart() const { return m_start; };
+    uint64_t getEnd() const { return m_end; };
+    size_t getSize() const { return m_end - m_start; };
+    bool isEmpty() const { return getSize() == 0; };
+    uint64_t getGeneration() const { return m_generation; };
+
+  private:
+    const char *m_data;
+    uint64_t m_start;
+    uint64_t m_end;
+    uint64_t m_generation;
+};
+
+inline bool
+operator==(const Page &lhs, const Page &rhs)
+{
+    return (lhs.m_data == rhs.m_data) && (lhs.m_start == rhs.m_start) &&
+           (lhs.m_end == rhs.m_end);
+}
+
+class PageReader
+{
+  public:
+    virtual ~PageReader() = default;
+
+    // Returns an empty page at the end. The data of the page stay valid until
+    // two more pages are read.
+    virtual Page getNextPage() = 0;
+    // Whether the data of the page are still valid
+    virtual bool isValid(const Page &page) const = 0;
+};
+
+class PagedStreamReader : public PageReader
+{
+  public:
+    // The stream must be already positioned at the start offset. No data is
+    // read from the end offset on.
+    PagedStreamReader(std::istream &istr, size_t page_size_bytes,
+                      size_t read_ahead_count, uint64_t start_offset,
+                      uint64_t end_offset)
+        : m_page_size_bytes(page_size_bytes),
+          m_reader(istr, page_size_bytes, 2, read_ahead_count,
+                   end_offset - start_offset),
+          m_stream_pos_bytes(start_offset), m_stream_end_bytes(end_offset)
+    {
+        assert(m_stream_pos_bytes <= m_stream_end_bytes);
+    };
+
+    Page getNextPage() override
+    {
+        if (m_stream_pos_bytes == m_stream_end_bytes) {
+            return Page{nullptr, m_stream_pos_bytes, m_stream_pos_bytes};
+        }
+
+        const size_t to_read{static_cast<size_t>(std::min<uint64_t>(
+            m_page_size_bytes, m_stream_end_bytes - m_stream_pos_bytes))};
+        const BufferedStream::DataPart dp{m_reader.readMultipart(to_read)};
+
+        m_stream_pos_bytes += dp.size;
+
+        return Page{dp.data, m_stream_pos_bytes - dp.size, m_stream_pos_bytes,
+                    m_reader.getGeneration()};
+    }
+
+    bool isValid(const Page &page) const override
+    {
+        return m_reader.isValid(page.getGeneration());
+    }
+
+  private:
+    const size_t m_page_size_bytes;
+    BufferedStream::Reader m_reader;
+    uint64_t m_stream_pos_bytes;
+    const uint64_t m_stream_end_bytes;
+};
+
+enum class MergeState {
+    Finished,
+    Incomplete,
+};
+
+class Diff
+{
+    friend MergeState diffsTryMerge(Diff &diff_a, Diff &diff_b,
+                                    size_t max_merge_gap, size_t max_size);
+
+  public:
+    explicit Diff(uint64_t start_end)
+        : m_pages{}, m_start{start_end}, m_end{start_end}
+    {
+        assert(m_start <= m_end);
+    };
+    Diff(Page page, uint64_t start, uint64_t end)
+        : m_pages{page}, m_start{start}, m_end{end}
+    {
+        assert(m_start <= m_end);
+    };
+    uint64_t getStart() const { return m_start; };
+    uint64_t getEnd() const { return m_end; };
+    size_t getSize() const { return m_end - m_start; };
+    bool isEmpty() const { return getSize() == 0; };
+
+    // The parts point to the data of the pages
+    FormatV3::RecordDataParts getData() const
+    {
+        FormatV3::RecordDataParts data{};
+
+        if (!m_pages[0].isEmpty() && m_pages[1].isEmpty()) {
+            // Only the first page
+            assert((m_start >= m_pages[0].getStart()) &&
+                   (m_start <= m_pages[0].getEnd()) &&
+                   (m_end >= m_pages[0].getStart()) &&
+                   (m_end <= m_pages[0].getEnd()));
+
+            const uint64_t offset{m_start - m_pages[0].getStart()};
+            data.push_back(FormatV3::RecordData{
+                getSize(), m_pages[0].getData() + offset});
+        } else if (!m_pages[0].isEmpty() && !m_pages[1].isEmpty()) {
+            // Both pages
+            assert((m_start >= m_pages[0].getStart()) &&
+                   (m_start <= m_pages[0].getEnd()) &&
+                   (m_end >= m_pages[1].getStart()) &&
+                   (m_end <= m_pages[1].getEnd()));
+
+            size_t size{m_pages[0].getEnd() - m_start};
+            const uint64_t offset{m_start - m_pages[0].getStart()};
+            data.push_back(
+                FormatV3::RecordData{size, m_pages[0].getData() + offset});
+
+            size = m_end - m_pages[1].getStart();
+            data.push_back(FormatV3::RecordData{size, m_pages[1].getData()});
+        }
+
+        return data;
+    };
+
+    // Whether the data of the pages read by the reader are still valid
+    bool hasValidPages(const PageReader &reader) const
+    {
+        for (const Page &page : m_pages) {
+            if (!page.isEmpty() && !reader.isValid(page)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+  private:
+    std::array<Page, 2> m_pages;
+    uint64_t m_start;
+    uint64_t m_end;
+
+    bool hasPage(size_t i) // cppcheck-suppress unusedPrivateFunction
+    {
+        return (i < m_pages.size()) && (m_pages[i].getData() != nullptr);
+    };
+};
+
+inline MergeState
+diffsTryMerge(Diff &diff_a, Diff &diff_b, size_t max_merge_gap, size_t max_size)
+{
+    if (diff_a.isEmpty()) {
+        // Do not merge to an empty diff
+        return MergeState::Finished;
+    }
+
+    if (diff_b.isEmpty()) {
+        // Nothing to merge from an empty diff
+        return MergeState::Finished;
+    }
+
+    assert(diff_a.getEnd() <= diff_b.getStart());
+    const size_t gap{diff_b.getStart() - diff_a.getEnd()};
+    if (gap > max_merge_gap) {
+        // B is too far away
+        return MergeState::Finished;
+    }
+
+    if ((diff_a.getSize() + gap) >= max_size) {
+        // No space in A
+        return MergeState::Finished;
+    }
+
+    // Can be merged
+
+    // Adjust the diff start and end offsets
+
+    // There is always at least 1 byte free in A here
+    const size_t free{max_size - (diff_a.getSize() + gap)};
+    const size_t to_merge{std::min(free, diff_b.getSize())};
+    // There is always at least 1 byte to merge from B here
+
+    // Enlarge A
+    diff_a.m_end += gap + to_merge;
+    // Shrink B
+    diff_b.m_start += to_merge;
+
+    // Add B's page to A if needed
+
+    // Non-empty A must have only the first, or both pages
+    assert(diff_a.hasPage(0));
+    // Non-empty B must have only the first page
+    assert(diff_b.hasPage(0) && !diff_b.hasPage(1));
+
+    // If A has both pages, B's page must only be the same as A's second
+    // page. No setting of pages in A is needed in this case
+    assert(!diff_a.hasPage(1) || (diff_b.m_pages[0] == diff_a.m_pages[1]));
+    if (!diff_a.hasPage(1)) {
+        // If A has only the first page, B's page must only be the same as the
+        // A's first page or following it
+        const bool b_follows{
+            (diff_b.m_pages[0].getData() != diff_a.m_pages[0].getData()) &&
+            (diff_b.m_pages[0].getStart() == diff_a.m_pages[0].getEnd())};
+        assert((diff_b.m_pages[0] == diff_a.m_pages[0]) || b_follows);
+        if (b_follows) {
+            diff_a.m_pages[1] = diff_b.m_pages[0];
+        }
+    }
+
+    return (diff_a.getSize() >= max_size) ? MergeState::Finished
+                                          : MergeState::Incomplete;
+}
+
+class DiffSource
+{
+  public:
+    virtual ~DiffSource() = default;
+
+    // Returns an empty diff at the end
+    virtual Diff findNextDiff() = 0;
+};
+
+class DiffFinder : public DiffSource
+{
+  public:
+    // With a granularity above 1, the pages and the start offset must be
+    // aligned to it
+    DiffFinder(std::unique_ptr<PageReader> old_page_reader,
+               std::unique_ptr<PageReader> new_page_reader,
+               uint32_t max_diff_size, size_t max_merge_gap,
+               uint64_t start_offset = 0, size_t granularity = 1)
+        : m_old_page_reader(std::move(old_page_reader)),
+          m_new_page_reader(std::move(new_page_reader)),
+          m_diff_max_size(max_diff_size), m_max_merge_gap(max_merge_gap),
+          m_granularity(granularity), m_offset_in_stream(start_offset),
+          m_diff(start_offset), m_search_state(SearchState::ReadPages),
+          m_merge_count(0)
+    {
+        assert((start_offset % m_granularity) == 0);
+    };
+
+    Diff findNextDiff() override
+    {
+        for (;;) {
+            if (m_search_state == SearchState::ReadPages) {
+                m_old_page = m_old_page_reader->getNextPage();
+                m_new_page = m_new_page_reader->getNextPage();
+                assert(m_old_page.getStart() == m_new_page.getStart());
+
+                if (m_old_page.getSize() != m_new_page.getSize()) {
+                    throw CreateError(
+                        "cannot read the same amount of data from both files");
+                }
+                Stats::add(Stats::Counter::BaseBytesRead,
+                           m_old_page.getSize());
+                Stats::add(Stats::Counter::InputBytesRead,
+                           m_new_page.getSize());
+                Stats::add(Stats::Counter::BytesCompared,
+                           m_new_page.getSize());
+                // The merges are counted per page, not per diff
+                Stats::add(Stats::Counter::Merges, m_merge_count);
+                m_merge_count = 0;
+                // The diff waiting for the merge must not be in a reused page
+                assert(m_diff.hasValidPages(*m_new_page_reader));
+
+                const bool end_of_stream{m_old_page.isEmpty() &&
+                                         m_new_page.isEmpty()};
+                if (end_of_stream) {
+                    const Diff return_diff{m_diff};
+                    m_diff = Diff{m_offset_in_stream};
+                    return return_diff;
+                }
+
+                m_search_state = SearchState::FindDiff;
+
+            } else if (m_search_state == SearchState::FindDiff) {
+                Diff diff{findDiffInPages(m_old_page, m_new_page,
+                                          m_offset_in_stream, m_granularity)};
+                m_offset_in_stream = diff.getEnd();
+
+                if (diff.isEmpty()) {
+                    // End of pages. On the next call, read new pages.
+                    m_old_page = Page{};
+                    m_new_page = Page{};
+                    m_search_state = SearchState::ReadPages;
+                }
+
+                const uint64_t end_before_merge{m_diff.getEnd()};
+                const MergeState merge_state{diffsTryMerge(
+                    m_diff, diff, m_max_merge_gap, m_diff_max_size)};
+                if (m_diff.getEnd() != end_before_merge) {
+                    ++m_merge_count;
+                }
+
+                if (merge_state == MergeState::Finished) {
+                    const Diff return_diff{m_diff};
+                    m_diff = diff;
+                    if (!return_diff.isEmpty()) {
+                        return return_diff;
+                    }
+                }
+
+            } else {
+                assert(false);
+            }
+        }
+    };
+
+    // Returns the first diff in the pages from the offset, or an empty diff at
+    // the end of the pages. With a granularity above 1, the diff consists of
+    // whole blocks of that size counted from the page start, except the last
+    // block of the pages.
+    static Diff findDiffInPages(Page old_page, Page new_page,
+                                uint64_t offset_in_stream,
+                                size_t granularity = 1)
+    {
+        const char *old_data{old_page.getData()};
+        const char *new_data{new_page.getData()};
+        const uint64_t data_size_bytes{old_page.getSize()};
+
+        assert(offset_in_stream >= new_page.getStart());
+        size_t offset_in_pages{offset_in_stream - new_page.getStart()};
+
+        // Find offset of the first different byte
+        offset_in_pages += Scan::findFirstDifferent(
+            old_data + offset_in_pages, new_data + offset_in_pages,
+            data_size_bytes - offset_in_pages);
+
+        if (granularity > 1) {
+            if (offset_in_pages < data_size_bytes) {
+                // Different byte found. The diff starts at its block and
+                // continues until the first same block.
+                const size_t start_in_pages{
+                    offset_in_pages - (offset_in_pages % granularity)};
+                offset_in_pages = std::min<size_t>(
+                    start_in_pages + granularity, data_size_bytes);
+                offset_in_pages += Scan::findFirstSameBlock(
+                    old_data + offset_in_pages, new_data + offset_in_pages,
+                    data_size_bytes - offset_in_pages, granularity);
+                return Diff{new_page, new_page.getStart() + start_in_pages,
+                            new_page.getStart() + offset_in_pages};
+            }
+            return Diff{new_page.getStart() + offset_in_pages};
+        }
+
+        const size_t start_in_pages{offset_in_pages};
+
+        if (offset_in_pages < data_size_bytes) {
+            // Different byte found. Start searching for a same byte immediately
+            // after.
+            ++offset_in_pages;
+        }
+
+        // Find offset of the first same byte
+        offset_in_pages += Scan::findFirstSame(
+            old_data + offset_in_pages, new_data + offset_in_pages,
+            data_size_bytes - offset_in_pages);
+        const size_t end_in_pages{offset_in_pages};
+
+        // In the case when no different byte is found, the end offset will be
+        // the same as the start offset
+
+        const uint64_t start_in_stream{new_page.getStart() + start_in_pages};
+        const uint64_t end_in_stream{new_page.getStart() + end_in_pages};
+        if (start_in_stream == end_in_stream) {
+            return Diff{start_in_stream};
+        } else {
+            return Diff{new_page, start_in_stream, end_in_stream};
+        }
+    }
+
+  private:
+    enum class SearchState { ReadPages, FindDiff };
+
+    std::unique_ptr<PageReader> m_old_page_reader;
+    std::unique_ptr<PageReader> m_new_page_reader;
+    const size_t m_diff_max_size;
+    const size_t m_max_merge_gap;
+    const size_t m_granularity;
+    Page m_old_page;
+    Page m_new_page;
+    uint64_t m_offset_in_stream;
+    Diff m_diff;
+    SearchState m_search_state;
+    uint64_t m_merge_count;
+};
@@ -0,0 +1,459 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "direct_stream.h"
+#include "buffered_stream.h"
+#include "file_stream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Direct
+{
+
+namespace
+{
+
+const size_t DefaultBlockSize{4096};
+
+} // namespace
+
+size_t
+getLogicalBlockSize(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return DefaultBlockSize;
+    }
+
+    size_t size{DefaultBlockSize};
+    if (S_ISBLK(st.st_mode)) {
+        int block_size;
+        if (ioctl(fd, BLKSSZGET, &block_size) == 0) {
+            size = static_cast<size_t>(block_size);
+        }
+    } else if (st.st_blksize > 0) {
+        // File system block size is a multiple of the logical block size of
+        // the underlying device
+        size = static_cast<size_t>(st.st_blksize);
+    }
+
+    const bool power_of_two{(size & (size - 1)) == 0};
+    return ((size > 0) && power_of_two) ? size : DefaultBlockSize;
+}
+
+namespace
+{
+
+// In input mode, the get area holds the data read from the file. In output
+// mode, the buffer is a window of the file starting at a block boundary and
+// the put area starts at the data not yet written.
+class FileBuf : public std::streambuf
+{
+  public:
+    FileBuf(int fd, bool output, size_t buffer_size)
+        : m_fd(fd), m_output(output), m_block_size(getLogicalBlockSize(fd)),
+          m_capacity(alignUp(buffer_size)), m_buffer_offset(0),
+          m_read_offset(0), m_read_skip(0), m_eof(false), m_valid_size(0)
+    {
+        try {
+            m_buffer = BufferedStream::allocateAlignedBuffer(m_capacity);
+            m_block = BufferedStream::allocateAlignedBuffer(m_block_size);
+        } catch (const std::bad_alloc &) {
+            close(m_fd);
+            throw Error("cannot allocate buffer for direct I/O");
+        }
+
+        struct stat st;
+        m_is_regular_file = (fstat(m_fd, &st) == 0) && S_ISREG(st.st_mode);
+        if (m_output) {
+            setp(m_buffer.get(), m_buffer.get() + m_capacity);
+        } else {
+            setg(m_buffer.get(), m_buffer.get(), m_buffer.get());
+        }
+    };
+
+    ~FileBuf() override
+    {
+        if (m_output) {
+            try {
+                flush();
+            } catch (const Error &) {
+            }
+        }
+        close(m_fd);
+    };
+
+  protected:
+    int_type underflow() override
+    {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        if (m_output || m_eof) {
+            return traits_type::eof();
+        }
+
+        char *buf{m_buffer.get()};
+        const size_t r{readFull(buf, m_capacity, m_read_offset)};
+        m_read_offset += r;
+        m_eof = (r < m_capacity);
+        const size_t skip{std::min(m_read_skip, r)};
+        m_read_skip = 0;
+        setg(buf, buf + skip, buf + r);
+
+        return (gptr() < egptr()) ? traits_type::to_int_type(*gptr())
+                                  : traits_type::eof();
+    };
+
+    std::streamsize xsgetn(char *s, std::streamsize n) override
+    {
+        std::streamsize copied{0};
+        while (copied < n) {
+            const std::streamsize avail{egptr() - gptr()};
+            if (avail > 0) {
+                const std::streamsize c{std::min(avail, n - copied)};
+                memcpy(s + copied, gptr(), c);
+                setg(eback(), gptr() + c, egptr());
+                copied += c;
+                continue;
+            }
+            if (m_eof) {
+                break;
+            }
+
+            // Whole blocks are read directly to an aligned destination
+            const size_t direct{alignDown(static_cast<size_t>(n - copied))};
+            if ((direct > 0) && isAligned(s + copied) && (m_read_skip == 0)) {
+                const size_t r{readFull(s + copied, direct, m_read_offset)};
+                m_read_offset += r;
+                copied += r;
+                if (r < direct) {
+                    m_eof = true;
+                }
+                continue;
+            }
+
+            if (traits_type::eq_int_type(underflow(), traits_type::eof())) {
+                break;
+            }
+        }
+        return copied;
+    };
+
+    int_type overflow(int_type ch) override
+    {
+        if (!m_output) {
+            return traits_type::eof();
+        }
+
+        if (pptr() == epptr()) {
+            flush();
+            // Move the window right after the full buffer
+            m_buffer_offset += m_capacity;
+            m_valid_size = 0;
+            setp(m_buffer.get(), m_buffer.get() + m_capacity);
+        }
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    };
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override
+    {
+        if (!m_output) {
+            return 0;
+        }
+
+        std::streamsize written{0};
+        while (written < n) {
+            // Whole blocks are written directly from an aligned source at the
+            // start of an empty window
+            const size_t direct{alignDown(static_cast<size_t>(n - written))};
+            const bool window_empty{(pptr() == m_buffer.get()) &&
+                                    (m_valid_size == 0)};
+            if ((direct > 0) && window_empty && isAligned(s + written)) {
+                writeFull(s + written, direct, m_buffer_offset);
+                m_buffer_offset += direct;
+                written += direct;
+                continue;
+            }
+
+            if (pptr() == epptr()) {
+                overflow(traits_type::eof());
+            }
+            const std::streamsize c{
+                std::min<std::streamsize>(epptr() - pptr(), n - written)};
+            memcpy(pptr(), s + written, c);
+            advancePut(static_cast<size_t>(c));
+            written += c;
+        }
+        return written;
+    };
+
+    int sync() override
+    {
+        if (m_output) {
+            flush();
+        }
+        return 0;
+    };
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode /* which */) override
+    {
+        uint64_t current;
+        if (m_output) {
+            current = m_buffer_offset + (pptr() - m_buffer.get());
+        } else {
+            current = m_read_offset + m_read_skip - (egptr() - gptr());
+        }
+
+        off_type target;
+        if (dir == std::ios_base::beg) {
+            target = off;
+        } else if (dir == std::ios_base::cur) {
+            target = static_cast<off_type>(current) + off;
+        } else {
+            if (m_output) {
+                flush();
+            }
+            const int64_t size{FileStream::getFileSize(m_fd)};
+            if (size < 0) {
+                return pos_type(off_type(-1));
+            }
+            target = size + off;
+        }
+        if (target < 0) {
+            return pos_type(off_type(-1));
+        }
+        if (static_cast<uint64_t>(target) == current) {
+            return pos_type(target);
+        }
+
+        const uint64_t block_start{alignDown(static_cast<uint64_t>(target))};
+        const size_t head{static_cast<size_t>(target - block_start)};
+        if (m_output) {
+            flush();
+            m_buffer_offset = block_start;
+            m_valid_size = 0;
+            if (head > 0) {
+                // The start of the block before the target must be kept
+                readBlock(m_buffer.get(), m_buffer_offset);
+                m_valid_size = m_block_size;
+            }
+            setp(m_buffer.get() + head, m_buffer.get() + m_capacity);
+        } else {
+            m_read_offset = block_start;
+            m_read_skip = head;
+            m_eof = false;
+            setg(m_buffer.get(), m_buffer.get(), m_buffer.get());
+        }
+        return pos_type(target);
+    };
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+    {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    };
+
+  private:
+    const int m_fd;
+    const bool m_output;
+    const size_t m_block_size;
+    const size_t m_capacity;
+    BufferedStream::AlignedBuffer m_buffer;
+    BufferedStream::AlignedBuffer m_block;
+    bool m_is_regular_file;
+
+    // Output: offset in the file of the start of the buffer
+    uint64_t m_buffer_offset;
+    // Input: offset in the file of the next read, and number of bytes to skip
+    // from there
+    uint64_t m_read_offset;
+    size_t m_read_skip;
+    bool m_eof;
+    // Output: size of the data at the buffer start which is the same as in
+    // the file, or is to be written to it
+    size_t m_valid_size;
+
+    template <typename T> T alignDown(T value) const
+    {
+        return value - (value % m_block_size);
+    };
+
+    template <typename T> T alignUp(T value) const
+    {
+        return alignDown(value + m_block_size - 1);
+    };
+
+    bool isAligned(const char *p) const
+    {
+        return (reinterpret_cast<uintptr_t>(p) % m_block_size) == 0;
+    };
+
+    void advancePut(size_t size)
+    {
+        while (size > 0) {
+            const int step{static_cast<int>(std::min<size_t>(size, INT_MAX))};
+            pbump(step);
+            size -= step;
+        }
+    };
+
+    size_t readFull(char *dest, size_t size, uint64_t offset)
+    {
+        size_t done{0};
+        while (done < size) {
+            const ssize_t r{
+                pread(m_fd, dest + done, size - done, offset + done)};
+            if (r < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw Error("cannot read from file");
+            } else if (r == 0) {
+                break;
+            }
+            done += static_cast<size_t>(r);
+        }
+        return done;
+    };
+
+    void writeFull(const char *src, size_t size, uint64_t offset)
+    {
+        size_t done{0};
+        while (done < size) {
+            const ssize_t r{
+                pwrite(m_fd, src + done, size - done, offset + done)};
+            if (r < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw Error("cannot write to file");
+            } else if (r == 0) {
+                throw Error("cannot write to file");
+            }
+            done += static_cast<size_t>(r);
+        }
+    };
+
+    // Beyond the end of the file, the block is filled with zeros
+    void readBlock(char *dest, uint64_t offset)
+    {
+        const size_t r{readFull(dest, m_block_size, offset)};
+        memset(dest + r, 0, m_block_size - r);
+    };
+
+    // Writes the put area. The buffer window stays, so writing can continue.
+    void flush()
+    {
+        char *buf{m_buffer.get()};
+        const size_t start{static_cast<size_t>(pbase() - buf)};
+        const size_t end{static_cast<size_t>(pptr() - buf)};
+        if (start == end) {
+            return;
+        }
+
+        const size_t aligned_start{alignDown(start)};
+        const size_t aligned_end{alignUp(end)};
+        if ((end < aligned_end) && (alignDown(end) >= m_valid_size)) {
+            // Read-modify-write of the last partial block
+            readBlock(m_block.get(), m_buffer_offset + alignDown(end));
+            const size_t tail{end - alignDown(end)};
+            memcpy(buf + end, m_block.get() + tail, m_block_size - tail);
+        }
+        // The file can be changed also by others, so its size is not cached
+        const int64_t size_before{
+            m_is_regular_file ? FileStream::getFileSize(m_fd) : 0};
+        writeFull(buf + aligned_start, aligned_end - aligned_start,
+                  m_buffer_offset + aligned_start);
+        m_valid_size = std::max(m_valid_size, aligned_end);
+
+        const uint64_t size{
+            std::max(static_cast<uint64_t>(std::max<int64_t>(0, size_before)),
+                     m_buffer_offset + end)};
+        if (m_is_regular_file && ((m_buffer_offset + aligned_end) > size)) {
+            // Remove the padding of the last block
+            if (ftruncate(m_fd, size) != 0) {
+                throw Error("cannot write to file");
+            }
+        }
+
+        setp(pptr(), epptr());
+    };
+};
+
+} // namespace
+
+Stream::Stream(std::unique_ptr<std::streambuf> buf)
+    : std::iostream(buf.get()), m_buf(std::move(buf))
+{
+}
+
+Stream::~Stream() = default;
+
+std::unique_ptr<Stream>
+Stream::open(const std::filesystem::path &path, std::ios_base::openmode mode,
+             size_t buffer_size)
+{
+    const bool output{(mode & std::ios_base::out) != 0};
+    // The output file is also read for the read-modify-write
+    int flags{O_CLOEXEC};
+    if (!output) {
+        flags |= O_RDONLY;
+    } else if ((mode & std::ios_base::trunc) != 0) {
+        flags |= O_RDWR | O_CREAT | O_TRUNC;
+    } else {
+        flags |= O_RDWR;
+    }
+
+    int fd{::open(path.c_str(), flags | O_DIRECT, 0666)};
+    if ((fd < 0) && (errno == EINVAL)) {
+        // The file system does not support direct I/O. The aligned I/O works
+        // through the page cache.
+        fd = ::open(path.c_str(), flags, 0666);
+    }
+    if (fd < 0) {
+        // Without a stream buffer the stream is in the failed state
+        return std::unique_ptr<Stream>(new Stream(nullptr));
+    }
+
+    return std::unique_ptr<Stream>(
+        new Stream(std::make_unique<FileBuf>(fd, output, buffer_size)));
+}
+
+} // namespace Direct
@@ -0,0 +1,66 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "exception.h"
+
+#include <filesystem>
+#include <iostream>
+#include <memory>
+
+namespace Direct
+{
+
+class Error : public DiffddError
+{
+  public:
+    explicit Error(const std::string &message) : DiffddError(message) {}
+};
+
+// The direct I/O of the file must be aligned to this size
+size_t getLogicalBlockSize(int fd);
+
+// Stream of a file opened for direct I/O, bypassing the page cache. All the
+// I/O is aligned to the logical block size of the file. Unaligned data at the
+// ends of writes is merged with the blocks read from the file.
+class Stream : public std::iostream
+{
+  public:
+    // If the file cannot be opened, the stream is returned in the failed
+    // state. Output mode without truncation does not create the file.
+    static std::unique_ptr<Stream> open(const std::filesystem::path &path,
+                                        std::ios_base::openmode mode,
+                                        size_t buffer_size);
+    ~Stream() override;
+
+  private:
+    explicit Stream(std::unique_ptr<std::streambuf> buf);
+
+    std::unique_ptr<std::streambuf> m_buf;
+};
+
+} // namespace Direct
@@ -0,0 +1,255 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "extract.h"
+#include "compression.h"
+#include "format_v3.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace
+{
+
+// A diff file of the chain. Only its records covering the extracted range are
+// read.
+class ExtractInput
+{
+  public:
+    explicit ExtractInput(const std::filesystem::path &path)
+        : m_stream{path, std::ios_base::in | std::ios_base::binary},
+          m_loaded_entry{NoEntry}, m_loaded_start{0}, m_loaded_end{0}
+    {
+        if (!m_stream) {
+            throw ExtractError("cannot open diff file");
+        }
+        m_reader = std::make_unique<FormatV3::SeekableReader>(m_stream);
+        m_entries = m_reader->readEntries();
+    };
+
+    ExtractInput(const ExtractInput &) = delete;
+    ExtractInput &operator=(const ExtractInput &) = delete;
+
+    const std::vector<FormatV3::IndexEntry> &getEntries() const
+    {
+        return m_entries;
+    };
+
+    // Returns the data of the record of the entry at the start of the range,
+    // or null for a zero record. Only the range is read from a data record.
+    // The last record is kept, as more pieces of it may follow.
+    const char *getRecordData(size_t entry, uint64_t start, uint64_t end)
+    {
+        if ((entry != m_loaded_entry) || (start < m_loaded_start) ||
+            (end > m_loaded_end)) {
+            loadRecord(entry, start, end);
+        }
+        return (m_loaded_type == FormatV3::RecordType::Zero)
+                   ? nullptr
+                   : (m_record_data->data() + (start - m_loaded_start));
+    };
+
+  private:
+    static const size_t NoEntry{static_cast<size_t>(-1)};
+
+    std::ifstream m_stream;
+    std::unique_ptr<FormatV3::SeekableReader> m_reader;
+    std::vector<FormatV3::IndexEntry> m_entries;
+    size_t m_loaded_entry;
+    FormatV3::RecordType m_loaded_type;
+    // The range of the image held in the record data
+    uint64_t m_loaded_start;
+    uint64_t m_loaded_end;
+    std::vector<char> m_stored;
+    std::vector<char> m_decompressed;
+    const std::vector<char> *m_record_data;
+
+    void loadRecord(size_t entry, uint64_t start, uint64_t end)
+    {
+        const FormatV3::IndexEntry &e{m_entries[entry]};
+        const uint64_t previous_end{
+            (entry > 0) ? (m_entries[entry - 1].offset +
+                           m_entries[entry - 1].size)
+                        : 0};
+        const FormatV3::RecordHeader header{m_reader->readRecordSlice(
+            e.position, previous_end, start - e.offset, end - start,
+            m_stored)};
+        if ((header.offset != e.offset) || (header.size != e.size)) {
+            throw ExtractError("index does not match the records");
+        }
+
+        m_record_data = &m_stored;
+        m_loaded_start = header.offset;
+        m_loaded_end = header.offset + header.size;
+        if (header.type == FormatV3::RecordType::Data) {
+            m_loaded_start = start;
+            m_loaded_end = end;
+        } else if (header.type == FormatV3::RecordType::Compressed) {
+            try {
+                m_decompressed.resize(header.size);
+            } catch (const std::bad_alloc &e) {
+                throw ExtractError("cannot allocate buffer for record data");
+            }
+            Compression::decompress(
+                static_cast<Compression::Codec>(header.codec), m_stored.data(),
+                m_stored.size(), m_decompressed.data(), m_decompressed.size());
+            m_record_data = &m_decompressed;
+        }
+        m_loaded_type = header.type;
+        m_loaded_entry = entry;
+    };
+};
+
+// A part of the extracted range taken from the base file or from a record of
+// a diff file
+struct Piece {
+    uint64_t end;
+    // Null for the base file
+    ExtractInput *input;
+    size_t entry;
+};
+
+// The pieces are keyed by their starts. The new piece replaces the parts of
+// the pieces it overlaps.
+void
+overlayPiece(std::map<uint64_t, Piece> &pieces, uint64_t start,
+             const Piece &piece)
+{
+    auto it{pieces.lower_bound(start)};
+    if (it != pieces.begin()) {
+        Piece &prev{std::prev(it)->second};
+        if (prev.end > piece.end) {
+            pieces.emplace(piece.end, Piece{prev.end, prev.input, prev.entry});
+        }
+        prev.end = std::min(prev.end, start);
+    }
+
+    while ((it != pieces.end()) && (it->first < piece.end)) {
+        if (it->second.end > piece.end) {
+            const Piece rest{it->second};
+            pieces.erase(it);
+            pieces.emplace(piece.end, rest);
+            break;
+        }
+        it = pieces.erase(it);
+    }
+
+    pieces.emplace(start, piece);
+}
+
+void
+writeOutput(const char *data, size_t size)
+{
+    if (!std::cout.write(data, size)) {
+        throw ExtractError("cannot write to output");
+    }
+}
+
+} // namespace
+
+void
+extract(const Options::Extract &opts)
+{
+    const uint64_t start{opts.getOffset()};
+    const uint64_t end{start + opts.getLength()};
+
+    std::ifstream base_stream{opts.getBaseFilePath(),
+                              std::ios_base::in | std::ios_base::binary};
+    if (!base_stream) {
+        throw ExtractError("cannot open base file");
+    }
+
+    std::vector<std::unique_ptr<ExtractInput>> inputs;
+    for (const std::filesystem::path &path : opts.getDiffFilePaths()) {
+        inputs.push_back(std::make_unique<ExtractInput>(path));
+    }
+
+    // The later diffs overwrite the pieces of the earlier ones. The records
+    // of a diff are in ascending order and do not overlap, so those covering
+    // the range are found by a binary search.
+    std::map<uint64_t, Piece> pieces;
+    pieces.emplace(start, Piece{end, nullptr, 0});
+    for (const auto &input : inputs) {
+        const std::vector<FormatV3::IndexEntry> &entries{input->getEntries()};
+        auto it{std::partition_point(
+            entries.begin(), entries.end(),
+            [start](const FormatV3::IndexEntry &e) {
+                return (e.offset + e.size) <= start;
+            })};
+        for (; (it != entries.end()) && (it->offset < end); ++it) {
+            const uint64_t piece_start{std::max(it->offset, start)};
+            const uint64_t piece_end{std::min(it->offset + it->size, end)};
+            overlayPiece(pieces, piece_start,
+                         Piece{piece_end, input.get(),
+                               static_cast<size_t>(it - entries.begin())});
+        }
+    }
+
+    const size_t buffer_size{opts.getBufferSize()};
+    const std::unique_ptr<char[]> buffer{new char[buffer_size]()};
+    for (const auto &[piece_start, piece] : pieces) {
+        if (piece.input != nullptr) {
+            // The data records are not limited in size, so they are read in
+            // parts of the buffer size
+            for (uint64_t pos = piece_start; pos < piece.end;) {
+                const size_t size{static_cast<size_t>(
+                    std::min<uint64_t>(piece.end - pos, buffer_size))};
+                const char *data{
+                    piece.input->getRecordData(piece.entry, pos, pos + size)};
+                if (data == nullptr) {
+                    // The zero record
+                    std::fill_n(buffer.get(), size, 0);
+                    data = buffer.get();
+                }
+                writeOutput(data, size);
+                pos += size;
+            }
+            continue;
+        }
+
+        if (!base_stream.seekg(piece_start, std::ios_base::beg)) {
+            throw ExtractError("cannot seek in base file");
+        }
+        for (uint64_t pos = piece_start; pos < piece.end;) {
+            const size_t size{static_cast<size_t>(
+                std::min<uint64_t>(piece.end - pos, buffer_size))};
+            if (!base_stream.read(buffer.get(), size)) {
+                throw ExtractError("cannot read base file");
+            }
+            writeOutput(buffer.get(), size);
+            pos += size;
+        }
+    }
+
+    if (!std::cout.flush()) {
+        throw ExtractError("cannot write to output");
+    }
+}
@@ -0,0 +1,315 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "fd_stream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace Fd
+{
+
+namespace
+{
+
+const size_t InputBufferSize{64 * 1024};
+
+// How often the pipe is checked when a spliced buffer is still in it
+const std::chrono::microseconds ReaderWaitInterval{100};
+
+// In input mode, the get area holds the data read from the file. The output
+// goes directly to the file.
+class FdBuf : public std::streambuf
+{
+  public:
+    FdBuf(int fd, bool output) : m_fd(fd)
+    {
+        if (!output) {
+            m_buffer = std::make_unique<char[]>(InputBufferSize);
+            setg(m_buffer.get(), m_buffer.get(), m_buffer.get());
+        }
+    };
+
+  protected:
+    int_type underflow() override
+    {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        if (!m_buffer) {
+            return traits_type::eof();
+        }
+
+        const size_t size{readSome(m_buffer.get(), InputBufferSize)};
+        setg(m_buffer.get(), m_buffer.get(), m_buffer.get() + size);
+        return (size > 0) ? traits_type::to_int_type(*gptr())
+                          : traits_type::eof();
+    };
+
+    std::streamsize xsgetn(char *s, std::streamsize n) override
+    {
+        // The buffered data first, the rest is read directly
+        std::streamsize done{std::min<std::streamsize>(n, egptr() - gptr())};
+        std::copy(gptr(), gptr() + done, s);
+        gbump(done);
+
+        while (done < n) {
+            const size_t size{readSome(s + done, n - done)};
+            if (size == 0) {
+                break;
+            }
+            done += size;
+        }
+        return done;
+    };
+
+    int_type overflow(int_type ch) override
+    {
+        if (traits_type::eq_int_type(ch, traits_type::eof())) {
+            return traits_type::not_eof(ch);
+        }
+        const char c{traits_type::to_char_type(ch)};
+        return (xsputn(&c, 1) == 1) ? ch : traits_type::eof();
+    };
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override
+    {
+        std::streamsize done{0};
+        while (done < n) {
+            const ssize_t w{write(m_fd, s + done, n - done)};
+            if ((w < 0) && (errno == EINTR)) {
+                continue;
+            } else if (w <= 0) {
+                break;
+            }
+            done += w;
+        }
+        return done;
+    };
+
+  private:
+    const int m_fd;
+    std::unique_ptr<char[]> m_buffer;
+
+    // Returns 0 at the end of the file. Errors are reported by the stream.
+    size_t readSome(char *data, size_t size)
+    {
+        for (;;) {
+            const ssize_t r{read(m_fd, data, size)};
+            if (r >= 0) {
+                return static_cast<size_t>(r);
+            } else if (errno != EINTR) {
+                throw Error("cannot read from standard input");
+            }
+        }
+    };
+};
+
+} // namespace
+
+SpliceBuffer::SpliceBuffer(int fd, size_t capacity)
+    : m_fd(fd), m_capacity(capacity), m_current(0), m_spliced(0)
+{
+    // A larger pipe takes the whole buffer at once. The default size works
+    // too.
+    fcntl(m_fd, F_SETPIPE_SZ, static_cast<int>(m_capacity));
+    const int pipe_size{fcntl(m_fd, F_GETPIPE_SZ)};
+    const size_t count{
+        1 + ((pipe_size > 0)
+                 ? ((static_cast<size_t>(pipe_size) + m_capacity - 1) /
+                    m_capacity)
+                 : 1)};
+
+    for (size_t i = 0; i < count; ++i) {
+        // Populating the pages at once is faster than faulting them one by
+        // one
+        void *p{mmap(nullptr, m_capacity, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0)};
+        if (p == MAP_FAILED) {
+            unmap();
+            throw Error("cannot allocate buffer for pipe data");
+        }
+        m_buffers.push_back(static_cast<char *>(p));
+    }
+    m_ends.resize(count, 0);
+}
+
+SpliceBuffer::~SpliceBuffer() { unmap(); }
+
+void
+SpliceBuffer::splice(size_t size)
+{
+    struct iovec iov {
+        getData(), size
+    };
+    while (iov.iov_len > 0) {
+        const ssize_t w{vmsplice(m_fd, &iov, 1, 0)};
+        if ((w < 0) && (errno == EINTR)) {
+            continue;
+        } else if (w <= 0) {
+            throw Error("cannot write to pipe");
+        }
+        iov.iov_base = static_cast<char *>(iov.iov_base) + w;
+        iov.iov_len -= w;
+    }
+
+    m_spliced += size;
+    m_ends[m_current] = m_spliced;
+    m_current = (m_current + 1) % m_buffers.size();
+    waitForReader(m_current);
+}
+
+void
+SpliceBuffer::unmap()
+{
+    for (char *const b : m_buffers) {
+        munmap(b, m_capacity);
+    }
+    m_buffers.clear();
+}
+
+// The data in the pipe are the last ones written to it. The data written to
+// the pipe directly, not spliced, make the wait only longer.
+void
+SpliceBuffer::waitForReader(size_t buffer)
+{
+    for (;;) {
+        int queued;
+        if (ioctl(m_fd, FIONREAD, &queued) != 0) {
+            throw Error("cannot get size of data in pipe");
+        }
+        if ((static_cast<uint64_t>(queued) <= m_spliced) &&
+            ((m_spliced - queued) >= m_ends[buffer])) {
+            return;
+        }
+        std::this_thread::sleep_for(ReaderWaitInterval);
+    }
+}
+
+Stream::Stream(int fd, bool output, bool owned)
+    : std::iostream(nullptr), m_fd(fd), m_output(output), m_owned(owned)
+{
+    if (m_fd >= 0) {
+        // Without a stream buffer the stream is in the failed state
+        m_buf = std::make_unique<FdBuf>(m_fd, m_output);
+        rdbuf(m_buf.get());
+    }
+}
+
+Stream::~Stream()
+{
+    if (m_owned && (m_fd >= 0)) {
+        close(m_fd);
+    }
+}
+
+std::unique_ptr<Stream>
+Stream::openStandardInput()
+{
+    return std::unique_ptr<Stream>(new Stream(STDIN_FILENO, false, false));
+}
+
+std::unique_ptr<Stream>
+Stream::openStandardOutput()
+{
+    return std::unique_ptr<Stream>(new Stream(STDOUT_FILENO, true, false));
+}
+
+std::unique_ptr<Stream>
+Stream::openOutput(const std::filesystem::path &path)
+{
+    const int fd{::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                        0666)};
+    return std::unique_ptr<Stream>(new Stream(fd, true, true));
+}
+
+void
+Stream::writeVector(const struct iovec *iov, size_t count)
+{
+    // Most of the writes are whole. The vector is copied only after a partial
+    // write, and the copy is adjusted after the next ones.
+    bool copied{false};
+    size_t first{0};
+    for (;;) {
+        const struct iovec *const left{copied ? m_left.data() : iov};
+        const size_t left_count{copied ? m_left.size() : count};
+        while ((first < left_count) && (left[first].iov_len == 0)) {
+            ++first;
+        }
+        if (first == left_count) {
+            return;
+        }
+
+        const int n{
+            static_cast<int>(std::min<size_t>(left_count - first, IOV_MAX))};
+        const ssize_t w{writev(m_fd, &left[first], n)};
+        if ((w < 0) && (errno == EINTR)) {
+            continue;
+        } else if (w <= 0) {
+            setstate(std::ios_base::badbit);
+            throw Error("cannot write to file");
+        }
+
+        size_t written{static_cast<size_t>(w)};
+        while ((first < left_count) && (written >= left[first].iov_len)) {
+            written -= left[first].iov_len;
+            ++first;
+        }
+        if (written > 0) {
+            if (!copied) {
+                m_left.assign(iov + first, iov + count);
+                first = 0;
+                copied = true;
+            }
+            struct iovec &v{m_left[first]};
+            v.iov_base = static_cast<char *>(v.iov_base) + written;
+            v.iov_len -= written;
+        }
+    }
+}
+
+std::unique_ptr<SpliceBuffer>
+Stream::createSpliceBuffer(size_t capacity)
+{
+    struct stat st;
+    if (!m_output || (fstat(m_fd, &st) != 0) || !S_ISFIFO(st.st_mode)) {
+        return nullptr;
+    }
+    return std::make_unique<SpliceBuffer>(m_fd, capacity);
+}
+
+} // namespace Fd
@@ -0,0 +1,114 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "exception.h"
+
+#include <filesystem>
+#include <iostream>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <sys/uio.h>
+
+namespace Fd
+{
+
+class Error : public DiffddError
+{
+  public:
+    explicit Error(const std::string &message) : DiffddError(message) {}
+};
+
+// Buffers whose pages are moved to a pipe by vmsplice instead of being copied.
+// The pipe keeps referencing the pages after they are spliced, so a buffer is
+// filled again only after the reader of the pipe took all its data. The
+// buffers are used in rotation, and there are enough of them to fill the pipe,
+// so the writer rarely waits for the reader. A reader moving the pages further
+// by splice to another pipe, instead of copying them, would see them change.
+class SpliceBuffer
+{
+  public:
+    SpliceBuffer(int fd, size_t capacity);
+    SpliceBuffer(const SpliceBuffer &) = delete;
+    SpliceBuffer &operator=(const SpliceBuffer &) = delete;
+    virtual ~SpliceBuffer();
+
+    char *getData() const { return m_buffers[m_current]; };
+    // Moves the first bytes of the buffer to the pipe, and switches to the
+    // next buffer
+    void splice(size_t size);
+
+  private:
+    const int m_fd;
+    const size_t m_capacity;
+    std::vector<char *> m_buffers;
+    // The number of the bytes spliced up to the end of the last data of each
+    // buffer
+    std::vector<uint64_t> m_ends;
+    size_t m_current;
+    uint64_t m_spliced;
+
+    void unmap();
+    void waitForReader(size_t buffer);
+};
+
+// Stream of the standard input or output, or of an output file written from
+// its start. It is not seekable. The output is not buffered, so the data
+// written through the stream, by the gather writes and spliced from the
+// buffers stay in order.
+class Stream : public std::iostream
+{
+  public:
+    static std::unique_ptr<Stream> openStandardInput();
+    static std::unique_ptr<Stream> openStandardOutput();
+    // The file is truncated. If it cannot be opened, the stream is returned
+    // in the failed state.
+    static std::unique_ptr<Stream>
+    openOutput(const std::filesystem::path &path);
+    ~Stream() override;
+
+    // Writes all the data of the vector by one or more system calls
+    void writeVector(const struct iovec *iov, size_t count);
+    // Returns nullptr if the output is not a pipe
+    std::unique_ptr<SpliceBuffer> createSpliceBuffer(size_t capacity);
+
+  private:
+    Stream(int fd, bool output, bool owned);
+
+    const int m_fd;
+    const bool m_output;
+    // The standard streams are not closed
+    const bool m_owned;
+    std::unique_ptr<std::streambuf> m_buf;
+    // The rest of a vector after a partial write. It is kept for the next
+    // partial writes.
+    std::vector<struct iovec> m_left;
+};
+
+} // namespace Fd
@@ -0,0 +1,131 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "file_stream.h"
+#include "direct_stream.h"
+#include "fd_stream.h"
+#include "uring_stream.h"
+
+#include <fstream>
+
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+namespace FileStream
+{
+
+std::unique_ptr<std::istream>
+openInput(const std::filesystem::path &path, const Config &config)
+{
+    if (path == StandardStreamPath) {
+        return Fd::Stream::openStandardInput();
+    }
+
+    if (config.backend == Options::IoBackend::Direct) {
+        return Direct::Stream::open(path, std::ios_base::in,
+                                    config.buffer_size);
+    } else if (config.backend == Options::IoBackend::Uring) {
+        std::unique_ptr<std::istream> s{
+            Uring::Stream::open(path, std::ios_base::in, config.buffer_size,
+                                config.queue_depth)};
+        if (s) {
+            return s;
+        }
+    }
+
+    return std::make_unique<std::ifstream>(
+        path, std::ifstream::in | std::ifstream::binary);
+}
+
+std::unique_ptr<std::ostream>
+openOutput(const std::filesystem::path &path, bool truncate,
+           const Config &config)
+{
+    const std::ios_base::openmode mode{
+        truncate ? (std::ios_base::out | std::ios_base::trunc)
+                 : std::ios_base::out};
+
+    if (path == StandardStreamPath) {
+        return Fd::Stream::openStandardOutput();
+    }
+
+    if (config.backend == Options::IoBackend::Direct) {
+        return Direct::Stream::open(path, mode, config.buffer_size);
+    } else if (config.backend == Options::IoBackend::Uring) {
+        std::unique_ptr<std::ostream> s{Uring::Stream::open(
+            path, mode, config.buffer_size, config.queue_depth)};
+        if (s) {
+            return s;
+        }
+    }
+
+    if (truncate) {
+        // The output is written sequentially, and the data records are
+        // written from the page buffers by the gather writes
+        return Fd::Stream::openOutput(path);
+    } else {
+        // Opening for reading too prevents creating of the file
+        return std::make_unique<std::fstream>(
+            path, std::ios_base::in | mode | std::ios_base::binary);
+    }
+}
+
+int64_t
+getFileSize(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return -1;
+    }
+    if (S_ISBLK(st.st_mode)) {
+        uint64_t size;
+        if (ioctl(fd, BLKGETSIZE64, &size) != 0) {
+            return -1;
+        }
+        return static_cast<int64_t>(size);
+    }
+    return st.st_size;
+}
+
+int64_t
+getStreamSize(std::istream &istream)
+{
+    if (!istream) {
+        return -1;
+    } else if (!istream.seekg(0, std::ios_base::end)) {
+        // The stream is not seekable. Its position has not changed.
+        istream.clear();
+        return -1;
+    }
+    const std::streampos size{istream.tellg()};
+    if ((size < 0) || !istream.seekg(0, std::ios_base::beg)) {
+        return -1;
+    }
+    return static_cast<int64_t>(size);
+}
+
+} // namespace FileStream
@@ -0,0 +1,65 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "options.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+
+namespace FileStream
+{
+
+struct Config {
+    Options::IoBackend backend;
+    size_t buffer_size;
+    unsigned queue_depth;
+};
+
+// Path standing for the standard input or output
+const inline std::filesystem::path StandardStreamPath{"-"};
+
+// The returned streams are in the failed state if the file cannot be opened.
+// If the I/O backend is not available, the standard file streams are used.
+// The standard input and output are used for the standard stream path,
+// regardless of the backend.
+std::unique_ptr<std::istream> openInput(const std::filesystem::path &path,
+                                        const Config &config);
+// When not truncating, the output file must already exist
+std::unique_ptr<std::ostream> openOutput(const std::filesystem::path &path,
+                                         bool truncate, const Config &config);
+
+// Size of a regular file or a block device. Returns -1 on error.
+int64_t getFileSize(int fd);
+
+// Size of the data in a seekable stream. The stream is positioned at the start
+// afterwards. Returns -1 on error. A stream which is not seekable stays usable.
+int64_t getStreamSize(std::istream &istream);
+
+} // namespace FileStream
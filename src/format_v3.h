@@ -0,0 +1,1007 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "buffered_stream.h"
+#include "crc32c.h"
+#include "format_v2.h"
+#include "stats.h"
+
+#include <endian.h>
+#include <sys/uio.h>
+
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <vector>
+
+namespace FormatV3
+{
+
+// The version 3 file starts with the same signature as the version 2 one. The
+// version is followed by the feature flags. The records have a type.
+using FormatV2::FileSignature;
+const uint8_t FileVersion{3};
+
+// The end record is followed by the index of all the other records, and a
+// trailer with the file position of the index and the number of its entries
+const uint32_t FeatureIndex{1U << 0};
+// The file can have compressed records
+const uint32_t FeatureCompression{1U << 1};
+// Each record except the end one is followed by the CRC-32C of the record. The
+// end record is followed by the CRC-32C of the file header and the checksums
+// of the records.
+const uint32_t FeatureChecksum{1U << 2};
+// The features in the file header are followed by the granularity, a power of
+// 2. The records start at its multiples, and their sizes are its multiples,
+// except at the end of the image.
+const uint32_t FeatureGranularity{1U << 3};
+// The offsets and the sizes in the record headers and in the index entries are
+// varints. The offsets are relative to the end of the previous record, and the
+// positions in the index to the position of the previous record.
+const uint32_t FeatureCompactRecords{1U << 4};
+const uint32_t SupportedFeatures{FeatureIndex | FeatureCompression |
+                                 FeatureChecksum | FeatureGranularity |
+                                 FeatureCompactRecords};
+
+const size_t ChecksumSize{sizeof(uint32_t)};
+
+enum class RecordType : uint8_t {
+    End = 0,
+    Data = 1,
+    Zero = 2,
+    Compressed = 3,
+};
+
+// Header of a data record without the compact records feature. A zero record
+// has a 64-bit size. The end record has only the type. The compressed record
+// has also the codec and the 32-bit size of the compressed data.
+const size_t RecordHeaderSize{sizeof(uint8_t) + sizeof(uint64_t) +
+                              sizeof(uint32_t)};
+
+// The size of the data of a compressed record before and after the
+// compression is not larger. The compressed records are decompressed in
+// memory, so the readers refuse the larger ones before allocating any memory
+// for them. The data and the zero records are read in parts, so they are not
+// limited.
+const uint64_t MaxRecordSize{1024 * 1024 * 1024};
+
+// A varint holds 7 bits of the value in each byte, from the least significant
+// ones. All the bytes except the last one have the top bit set.
+const size_t MaxVarintSize{10};
+
+inline size_t
+getVarintSize(uint64_t value)
+{
+    size_t size{1};
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+// Returns the number of the bytes written to the destination
+inline size_t
+encodeVarint(uint64_t value, char *dest)
+{
+    size_t size{0};
+    while (value >= 0x80) {
+        dest[size++] = static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    dest[size++] = static_cast<char>(value);
+    return size;
+}
+
+// Each byte is read by read_byte(uint8_t &byte), which returns false at the
+// end of the data. Returns false if the data end early, or the value does not
+// fit in 64 bits.
+template <typename ReadByte>
+bool
+decodeVarint(ReadByte read_byte, uint64_t &value)
+{
+    value = 0;
+    for (size_t i = 0; i < MaxVarintSize; ++i) {
+        uint8_t byte;
+        if (!read_byte(byte) ||
+            ((i == (MaxVarintSize - 1)) && (byte > 1))) {
+            return false;
+        }
+        value |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+using FormatV2::RecordData;
+
+// The data of a record written from the parts in the memory. A record is
+// written from at most two pages, so the parts are held inline.
+class RecordDataParts
+{
+  public:
+    static const size_t Capacity{2};
+
+    RecordDataParts() : m_parts{}, m_count{0} {};
+    RecordDataParts(std::initializer_list<RecordData> parts)
+        : m_parts{}, m_count{0}
+    {
+        for (const RecordData &rd : parts) {
+            push_back(rd);
+        }
+    };
+
+    void push_back(const RecordData &rd)
+    {
+        assert(m_count < Capacity);
+        m_parts[m_count++] = rd;
+    };
+    void clear() { m_count = 0; };
+    bool empty() const { return m_count == 0; };
+    size_t size() const { return m_count; };
+    RecordData &back() { return m_parts[m_count - 1]; };
+    const RecordData *begin() const { return m_parts.data(); };
+    const RecordData *end() const { return m_parts.data() + m_count; };
+
+  private:
+    std::array<RecordData, Capacity> m_parts;
+    size_t m_count;
+};
+
+// The size is the size of the range in the output file. Only the compressed
+// records have the codec and the size of the stored data.
+struct RecordHeader {
+    RecordType type;
+    uint64_t offset;
+    uint64_t size;
+    uint8_t codec{0};
+    uint64_t compressed_size{0};
+};
+
+// The position is the offset of the record header in the file
+struct IndexEntry {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t position;
+};
+
+// Without the compact records feature
+const size_t IndexEntrySize{3 * sizeof(uint64_t)};
+const size_t TrailerSize{2 * sizeof(uint64_t)};
+
+class Error : public DiffddError
+{
+  public:
+    explicit Error(const std::string &message) : DiffddError(message) {}
+};
+
+// Returns the granularity read from the file header if it is valid
+inline uint32_t
+checkGranularity(uint32_t granularity)
+{
+    if ((granularity == 0) || ((granularity & (granularity - 1)) != 0)) {
+        throw Error("wrong file header granularity");
+    }
+    return granularity;
+}
+
+// Adds the size read from the file to the offset. Returns false if the sum
+// overflows.
+inline bool
+addOffset(uint64_t &offset, uint64_t size)
+{
+    if (size > (std::numeric_limits<uint64_t>::max() - offset)) {
+        return false;
+    }
+    offset += size;
+    return true;
+}
+
+class Writer
+{
+  public:
+    // The index, the checksum and the compact records features are always
+    // set. The granularity feature is set for the granularity above 1.
+    Writer(std::ostream &ostream, size_t buffer_size, uint32_t features = 0,
+           uint32_t granularity = 1)
+        : m_writer{BufferedStream::Writer{ostream, buffer_size}},
+          m_position{0}, m_crc{0}, m_file_crc{0}, m_previous_end{0},
+          m_zero_offset{0}, m_zero_size{0}, m_parts{}
+    {
+        features |= FeatureIndex | FeatureChecksum | FeatureCompactRecords;
+        if (granularity > 1) {
+            features |= FeatureGranularity;
+        }
+        writeFileHeader(features, granularity);
+    };
+
+    // The records must be written in the ascending order of their offsets,
+    // and must not overlap
+    void writeDataRecord(uint64_t offset, uint64_t size,
+                         const RecordDataParts &data)
+    {
+        writeDataParts(offset, size, data);
+    };
+
+    // Like writeDataRecord(), for a record larger than the pages, whose data
+    // can be in any number of parts
+    void writeLargeDataRecord(uint64_t offset, uint64_t size,
+                              const std::vector<RecordData> &data)
+    {
+        writeDataParts(offset, size, data);
+    };
+
+    // The file must have the compression feature
+    void writeCompressedRecord(uint64_t offset, uint64_t size, uint8_t codec,
+                               const char *data, size_t compressed_size)
+    {
+        flushZeroRecord();
+
+        m_index.push_back(IndexEntry{offset, size, m_position});
+        m_crc = 0;
+        writeType(RecordType::Compressed);
+        writeRange(offset, size);
+        write(reinterpret_cast<const char *>(&codec), sizeof(codec));
+        writeVarint(compressed_size);
+        write(data, compressed_size);
+        writeChecksum();
+    };
+
+    // Adjacent zero ranges are written as one record
+    void writeZeroRecord(uint64_t offset, uint64_t size)
+    {
+        if ((m_zero_size > 0) && (offset == (m_zero_offset + m_zero_size)) &&
+            (size <= (std::numeric_limits<uint64_t>::max() - m_zero_size))) {
+            m_zero_size += size;
+            return;
+        }
+
+        flushZeroRecord();
+        m_zero_offset = offset;
+        m_zero_size = size;
+    };
+
+    // Must be called after the last record. Writes also the index, and flushes
+    // the buffered data.
+    void writeEndRecord()
+    {
+        flushZeroRecord();
+        // All the records are in the index
+        Stats::add(Stats::Counter::Records, m_index.size());
+        writeType(RecordType::End);
+        writeUint32(m_file_crc);
+
+        const uint64_t index_position{m_position};
+        uint64_t previous_end{0};
+        uint64_t previous_position{0};
+        for (const IndexEntry &e : m_index) {
+            writeVarint(e.offset - previous_end);
+            writeVarint(e.size);
+            writeVarint(e.position - previous_position);
+            previous_end = e.offset + e.size;
+            previous_position = e.position;
+        }
+        writeUint64(index_position);
+        writeUint64(m_index.size());
+        m_writer.flush();
+    };
+
+  private:
+    BufferedStream::Writer m_writer;
+    // Number of bytes written to the file
+    uint64_t m_position;
+    // Of the bytes of the current record
+    uint32_t m_crc;
+    uint32_t m_file_crc;
+    std::vector<IndexEntry> m_index;
+    // End of the last record written
+    uint64_t m_previous_end;
+    uint64_t m_zero_offset;
+    uint64_t m_zero_size;
+    // For the data parts of the records
+    std::array<struct iovec, RecordDataParts::Capacity> m_parts;
+
+    template <typename Parts>
+    void writeDataParts(uint64_t offset, uint64_t size, const Parts &data)
+    {
+        flushZeroRecord();
+
+        m_index.push_back(IndexEntry{offset, size, m_position});
+        m_crc = 0;
+        writeType(RecordType::Data);
+        writeRange(offset, size);
+
+        // The data are written from the pages, together with the buffered
+        // header
+        size_t count{0};
+        for (const RecordData &rd : data) {
+            if (count == m_parts.size()) {
+                m_writer.writeVector(m_parts.data(), count);
+                count = 0;
+            }
+            // The data are only read by the gather write
+            m_parts[count++] = iovec{const_cast<char *>(rd.data), rd.size};
+            m_position += rd.size;
+            m_crc = Crc32c::extend(m_crc, rd.data, rd.size);
+        }
+        m_writer.writeVector(m_parts.data(), count);
+        writeChecksum();
+    };
+
+    void writeFileHeader(uint32_t features, uint32_t granularity)
+    {
+        write(FileSignature.data(), FileSignature.size());
+
+        const uint8_t version{FileVersion};
+        write(reinterpret_cast<const char *>(&version), sizeof(version));
+
+        writeUint32(features);
+        if ((features & FeatureGranularity) != 0) {
+            writeUint32(granularity);
+        }
+        m_file_crc = m_crc;
+    };
+
+    void write(const char *data, size_t size)
+    {
+        m_writer.write(data, size);
+        m_position += size;
+        m_crc = Crc32c::extend(m_crc, data, size);
+    };
+
+    void writeChecksum()
+    {
+        const uint32_t val{htobe32(m_crc)};
+        write(reinterpret_cast<const char *>(&val), sizeof(val));
+        m_file_crc = Crc32c::extend(
+            m_file_crc, reinterpret_cast<const char *>(&val), sizeof(val));
+    };
+
+    void flushZeroRecord()
+    {
+        if (m_zero_size == 0) {
+            return;
+        }
+
+        m_index.push_back(IndexEntry{m_zero_offset, m_zero_size, m_position});
+        m_crc = 0;
+        writeType(RecordType::Zero);
+        writeRange(m_zero_offset, m_zero_size);
+        writeChecksum();
+        m_zero_size = 0;
+    };
+
+    void writeType(RecordType type)
+    {
+        const uint8_t val{static_cast<uint8_t>(type)};
+        write(reinterpret_cast<const char *>(&val), sizeof(val));
+    };
+
+    void writeUint32(uint32_t value)
+    {
+        const uint32_t val{htobe32(value)};
+        write(reinterpret_cast<const char *>(&val), sizeof(val));
+    };
+
+    void writeUint64(uint64_t value)
+    {
+        const uint64_t val{htobe64(value)};
+        write(reinterpret_cast<const char *>(&val), sizeof(val));
+    };
+
+    void writeVarint(uint64_t value)
+    {
+        char bytes[MaxVarintSize];
+        write(bytes, encodeVarint(value, bytes));
+    };
+
+    // The offset is written relative to the end of the previous record
+    void writeRange(uint64_t offset, uint64_t size)
+    {
+        assert(offset >= m_previous_end);
+        writeVarint(offset - m_previous_end);
+        writeVarint(size);
+        m_previous_end = offset + size;
+    };
+};
+
+// The parsing of the headers is shared by the readers, so they accept the same
+// files. The bytes are read by read_bytes(char *data, size_t size), which
+// returns false if it cannot read all of them.
+struct FileHeader {
+    uint8_t version{0};
+    uint32_t features{0};
+    // 1 if the file does not have the granularity feature
+    uint32_t granularity{1};
+};
+
+template <typename ReadBytes, typename T>
+bool
+parseValue(ReadBytes &read_bytes, T &value)
+{
+    return read_bytes(reinterpret_cast<char *>(&value), sizeof(value));
+}
+
+// Without the compact records feature, the size is stored in 32 bits, or in 64
+// bits if it is wide
+template <typename ReadBytes>
+bool
+parseSize(ReadBytes &read_bytes, const FileHeader &file_header, bool wide,
+          uint64_t &size)
+{
+    if ((file_header.features & FeatureCompactRecords) != 0) {
+        return decodeVarint(
+            [&read_bytes](uint8_t &b) { return parseValue(read_bytes, b); },
+            size);
+    } else if (wide) {
+        uint64_t val;
+        if (!parseValue(read_bytes, val)) {
+            return false;
+        }
+        size = be64toh(val);
+        return true;
+    }
+
+    uint32_t val;
+    if (!parseValue(read_bytes, val)) {
+        return false;
+    }
+    size = be32toh(val);
+    return true;
+}
+
+// Reads the offset and the size of the record, and moves the previous end to
+// the end of the record. Returns false also if the range does not fit in 64
+// bits.
+template <typename ReadBytes>
+bool
+parseRange(ReadBytes &read_bytes, const FileHeader &file_header,
+           bool wide_size, uint64_t &previous_end, RecordHeader &header)
+{
+    if ((file_header.features & FeatureCompactRecords) != 0) {
+        uint64_t delta;
+        if (!decodeVarint(
+                [&read_bytes](uint8_t &b) {
+                    return parseValue(read_bytes, b);
+                },
+                delta)) {
+            return false;
+        }
+        header.offset = previous_end;
+        if (!addOffset(header.offset, delta)) {
+            return false;
+        }
+    } else {
+        if (!parseValue(read_bytes, header.offset)) {
+            return false;
+        }
+        header.offset = be64toh(header.offset);
+    }
+
+    if (!parseSize(read_bytes, file_header, wide_size, header.size)) {
+        return false;
+    }
+    previous_end = header.offset;
+    return addOffset(previous_end, header.size);
+}
+
+template <typename ReadBytes>
+FileHeader
+parseFileHeader(ReadBytes read_bytes)
+{
+    std::string signature(FileSignature.size(), '\0');
+    if (!read_bytes(signature.data(), signature.size())) {
+        throw Error("cannot read file header signature");
+    }
+    if (signature != FileSignature) {
+        throw Error("wrong file header signature");
+    }
+
+    FileHeader file_header;
+    if (!parseValue(read_bytes, file_header.version)) {
+        throw Error("cannot read file header version");
+    }
+    if ((file_header.version != FormatV2::FileVersion) &&
+        (file_header.version != FileVersion)) {
+        throw Error("wrong file header version");
+    }
+
+    if (file_header.version == FileVersion) {
+        uint32_t features;
+        if (!parseValue(read_bytes, features)) {
+            throw Error("cannot read file header features");
+        }
+        file_header.features = be32toh(features);
+        if ((file_header.features & ~SupportedFeatures) != 0) {
+            throw Error("unsupported file features");
+        }
+    }
+
+    if ((file_header.features & FeatureGranularity) != 0) {
+        uint32_t granularity;
+        if (!parseValue(read_bytes, granularity)) {
+            throw Error("cannot read file header granularity");
+        }
+        file_header.granularity = checkGranularity(be32toh(granularity));
+    }
+    return file_header;
+}
+
+// The version 2 records are read as data records, and the end of the version 2
+// file as the end record. Only the header of the record is read, without the
+// checksums following the zero and the end records.
+template <typename ReadBytes>
+RecordHeader
+parseRecordHeader(ReadBytes read_bytes, const FileHeader &file_header,
+                  uint64_t &previous_end)
+{
+    if (file_header.version == FormatV2::FileVersion) {
+        uint64_t offset;
+        uint32_t size;
+        if (!parseValue(read_bytes, offset) || !parseValue(read_bytes, size)) {
+            return RecordHeader{RecordType::End, 0, 0};
+        }
+        return RecordHeader{RecordType::Data, be64toh(offset), be32toh(size)};
+    }
+
+    uint8_t type;
+    if (!parseValue(read_bytes, type)) {
+        throw Error("missing end record");
+    }
+
+    RecordHeader header{RecordType::End, 0, 0};
+    if (type == static_cast<uint8_t>(RecordType::End)) {
+        return header;
+    } else if (type == static_cast<uint8_t>(RecordType::Data)) {
+        header.type = RecordType::Data;
+        if (!parseRange(read_bytes, file_header, false, previous_end,
+                        header)) {
+            throw Error("cannot read record header");
+        }
+    } else if (type == static_cast<uint8_t>(RecordType::Zero)) {
+        header.type = RecordType::Zero;
+        if (!parseRange(read_bytes, file_header, true, previous_end, header)) {
+            throw Error("cannot read record header");
+        }
+    } else if (type == static_cast<uint8_t>(RecordType::Compressed)) {
+        header.type = RecordType::Compressed;
+        if (!parseRange(read_bytes, file_header, false, previous_end,
+                        header) ||
+            !parseValue(read_bytes, header.codec) ||
+            !parseSize(read_bytes, file_header, false,
+                       header.compressed_size)) {
+            throw Error("cannot read record header");
+        }
+    } else {
+        throw Error("unknown record type");
+    }
+
+    if ((header.offset % file_header.granularity) != 0) {
+        throw Error("record not aligned to the granularity");
+    } else if ((header.type == RecordType::Compressed) &&
+               (header.size > MaxRecordSize)) {
+        throw Error("record too large");
+    } else if ((header.type == RecordType::Compressed) &&
+               ((header.compressed_size == 0) ||
+                (header.compressed_size >= header.size))) {
+        // The data are compressed only if it makes them smaller
+        throw Error("wrong size of compressed record data");
+    }
+    return header;
+}
+
+// Reads the version 2 and version 3 files. The checksums are checked when the
+// whole record is read.
+class Reader
+{
+  public:
+    // The checksum after the data of a record is read before its last part is
+    // returned, so the part must stay in the previous buffer
+    Reader(std::istream &istream, size_t buffer_size, size_t read_ahead_count)
+        : m_reader{istream, buffer_size, 2, read_ahead_count}, m_position{0},
+          m_crc{0}, m_file_crc{0}, m_data_left{0}, m_previous_end{0}
+    {
+        m_header = parseFileHeader([this](char *data, size_t size) {
+            return readBytes(data, size) == size;
+        });
+        m_file_crc = m_crc;
+    };
+
+    uint8_t getVersion() const { return m_header.version; };
+    uint32_t getFeatures() const { return m_header.features; };
+    // 1 if the file does not have the granularity feature
+    uint32_t getGranularity() const { return m_header.granularity; };
+    // Position of the next byte to read in the file
+    uint64_t getPosition() const { return m_position; };
+
+    RecordHeader readRecordHeader()
+    {
+        m_crc = 0;
+
+        const RecordHeader header{parseRecordHeader(
+            [this](char *data, size_t size) {
+                return readBytes(data, size) == size;
+            },
+            m_header, m_previous_end)};
+
+        if ((header.type == RecordType::End) &&
+            (m_header.version == FileVersion) && hasChecksums()) {
+            uint32_t file_crc;
+            if (!readValue(file_crc)) {
+                throw Error("cannot read file checksum");
+            }
+            if (be32toh(file_crc) != m_file_crc) {
+                throw Error("file checksum mismatch");
+            }
+        } else if (header.type == RecordType::Data) {
+            m_data_left = header.size;
+        } else if (header.type == RecordType::Zero) {
+            checkRecordChecksum();
+        } else if (header.type == RecordType::Compressed) {
+            m_data_left = header.compressed_size;
+        }
+        return header;
+    };
+
+    // The size must not exceed the data left in the record. The returned data
+    // stay valid until the next read.
+    RecordData readRecordData(size_t size)
+    {
+        const BufferedStream::DataPart dp = m_reader.readMultipart(size);
+        m_position += dp.size;
+
+        if (hasChecksums() && (dp.size > 0)) {
+            m_crc = Crc32c::extend(m_crc, dp.data, dp.size);
+            m_data_left -= dp.size;
+            if (m_data_left == 0) {
+                checkRecordChecksum();
+            }
+        }
+
+        return RecordData{
+            .size = dp.size,
+            .data = dp.data,
+        };
+    };
+
+  private:
+    BufferedStream::Reader m_reader;
+    FileHeader m_header;
+    uint64_t m_position;
+    // Of the bytes of the current record
+    uint32_t m_crc;
+    uint32_t m_file_crc;
+    uint64_t m_data_left;
+    // End of the last record read
+    uint64_t m_previous_end;
+
+    bool hasChecksums() const
+    {
+        return (m_header.features & FeatureChecksum) != 0;
+    };
+
+    size_t readBytes(char *data, size_t size)
+    {
+        const size_t n{m_reader.read(size, data)};
+        m_position += n;
+        m_crc = Crc32c::extend(m_crc, data, n);
+        return n;
+    };
+
+    template <typename T> bool readValue(T &value)
+    {
+        return readBytes(reinterpret_cast<char *>(&value), sizeof(value)) ==
+               sizeof(value);
+    };
+
+    void checkRecordChecksum()
+    {
+        const uint32_t crc{m_crc};
+        uint32_t stored;
+        if (!readValue(stored)) {
+            throw Error("cannot read record checksum");
+        }
+        if (be32toh(stored) != crc) {
+            throw Error("record checksum mismatch");
+        }
+        m_file_crc = Crc32c::extend(
+            m_file_crc, reinterpret_cast<const char *>(&stored),
+            sizeof(stored));
+    };
+};
+
+// Size of the index with the trailer in the file with the features
+inline uint64_t
+getIndexSize(const std::vector<IndexEntry> &index, uint32_t features)
+{
+    if ((features & FeatureCompactRecords) == 0) {
+        return (index.size() * IndexEntrySize) + TrailerSize;
+    }
+
+    uint64_t size{TrailerSize};
+    uint64_t previous_end{0};
+    uint64_t previous_position{0};
+    for (const IndexEntry &e : index) {
+        size += getVarintSize(e.offset - previous_end) +
+                getVarintSize(e.size) +
+                getVarintSize(e.position - previous_position);
+        previous_end = e.offset + e.size;
+        previous_position = e.position;
+    }
+    return size;
+}
+
+// Loads the index from the end of a seekable stream of a file with the index
+// feature. The file header with the features must be read before.
+inline std::vector<IndexEntry>
+readIndex(std::istream &istream, uint32_t features)
+{
+    if (!istream.seekg(-static_cast<std::streamoff>(TrailerSize),
+                       std::ios_base::end)) {
+        throw Error("cannot seek to index trailer");
+    }
+    const std::streampos trailer_position{istream.tellg()};
+
+    uint64_t trailer[2];
+    if (!istream.read(reinterpret_cast<char *>(trailer), sizeof(trailer))) {
+        throw Error("cannot read index trailer");
+    }
+    const uint64_t index_position{be64toh(trailer[0])};
+    const uint64_t entry_count{be64toh(trailer[1])};
+
+    const uint64_t index_size{static_cast<uint64_t>(trailer_position) -
+                              index_position};
+    const bool compact{(features & FeatureCompactRecords) != 0};
+    if (index_position > static_cast<uint64_t>(trailer_position)) {
+        throw Error("wrong index trailer");
+    } else if (compact && ((index_size / 3) < entry_count)) {
+        // Each entry has at least three bytes
+        throw Error("wrong index trailer");
+    } else if (!compact && (((index_size / IndexEntrySize) != entry_count) ||
+                            ((index_size % IndexEntrySize) != 0))) {
+        throw Error("wrong index trailer");
+    }
+
+    // The whole index is read at once
+    std::vector<char> raw(index_size);
+    if (!istream.seekg(index_position, std::ios_base::beg) ||
+        !istream.read(raw.data(), index_size)) {
+        throw Error("cannot read index");
+    }
+
+    std::vector<IndexEntry> index;
+    index.reserve(entry_count);
+    if (!compact) {
+        for (size_t i = 0; i < raw.size(); i += IndexEntrySize) {
+            uint64_t e[3];
+            memcpy(e, raw.data() + i, sizeof(e));
+            index.push_back(
+                IndexEntry{be64toh(e[0]), be64toh(e[1]), be64toh(e[2])});
+        }
+        return index;
+    }
+
+    size_t pos{0};
+    const auto read_byte{[&raw, &pos](uint8_t &b) {
+        if (pos == raw.size()) {
+            return false;
+        }
+        b = static_cast<uint8_t>(raw[pos++]);
+        return true;
+    }};
+    uint64_t previous_end{0};
+    uint64_t previous_position{0};
+    for (uint64_t i = 0; i < entry_count; ++i) {
+        IndexEntry e{previous_end, 0, previous_position};
+        uint64_t delta;
+        uint64_t position_delta;
+        if (!decodeVarint(read_byte, delta) ||
+            !decodeVarint(read_byte, e.size) ||
+            !decodeVarint(read_byte, position_delta) ||
+            !addOffset(e.offset, delta) ||
+            !addOffset(e.position, position_delta)) {
+            throw Error("wrong index");
+        }
+        previous_end = e.offset;
+        if (!addOffset(previous_end, e.size)) {
+            throw Error("wrong index");
+        }
+        previous_position = e.position;
+        index.push_back(e);
+    }
+    if (pos != raw.size()) {
+        throw Error("wrong index");
+    }
+    return index;
+}
+
+// Reads the records at their positions in a seekable stream, so only the
+// records needed are read. The checksums of the records are checked.
+class SeekableReader
+{
+  public:
+    explicit SeekableReader(std::istream &istream)
+        : m_istream{istream}, m_header_size{0}
+    {
+        uint32_t crc{0};
+        m_header = parseFileHeader([this, &crc](char *data, size_t size) {
+            return readBytes(data, size, crc);
+        });
+        m_header_size = static_cast<uint64_t>(m_istream.tellg());
+    };
+
+    uint8_t getVersion() const { return m_header.version; };
+    uint32_t getFeatures() const { return m_header.features; };
+    // 1 if the file does not have the granularity feature
+    uint32_t getGranularity() const { return m_header.granularity; };
+
+    // Returns the entries of all the records in the order of the records.
+    // Without the index, the headers of the records are read.
+    std::vector<IndexEntry> readEntries()
+    {
+        if ((m_header.features & FeatureIndex) != 0) {
+            return readIndex(m_istream, m_header.features);
+        }
+
+        std::vector<IndexEntry> entries;
+        uint64_t position{m_header_size};
+        uint64_t previous_end{0};
+        for (;;) {
+            uint32_t crc{0};
+            const RecordHeader header{
+                readRecordHeader(position, previous_end, crc)};
+            if (header.type == RecordType::End) {
+                return entries;
+            }
+            entries.push_back(IndexEntry{header.offset, header.size, position});
+            position = static_cast<uint64_t>(m_istream.tellg()) +
+                       getStoredSize(header) +
+                       (hasChecksums() ? ChecksumSize : 0);
+        }
+    };
+
+    // The stored data of the data and the compressed records are read to the
+    // vector. The offset of the record is read relative to the end of the
+    // previous record, or to 0 for the first one.
+    RecordHeader readRecord(uint64_t position, uint64_t previous_end,
+                            std::vector<char> &data)
+    {
+        uint32_t crc{0};
+        const RecordHeader header{
+            readRecordHeader(position, previous_end, crc)};
+        readStoredData(header, crc, data);
+        return header;
+    };
+
+    // Like readRecord(), but only the slice of the data of a data record is
+    // read, starting at the offset in the record. The checksum covers the
+    // whole record, so it is not checked for a part of the record. The other
+    // records are read whole.
+    RecordHeader readRecordSlice(uint64_t position, uint64_t previous_end,
+                                 uint64_t slice_offset, uint64_t slice_size,
+                                 std::vector<char> &data)
+    {
+        uint32_t crc{0};
+        const RecordHeader header{
+            readRecordHeader(position, previous_end, crc)};
+        if ((header.type != RecordType::Data) ||
+            ((slice_offset == 0) && (slice_size == header.size))) {
+            readStoredData(header, crc, data);
+            return header;
+        }
+
+        if ((slice_offset > header.size) ||
+            (slice_size > (header.size - slice_offset))) {
+            throw Error("slice out of the record");
+        }
+        data.resize(slice_size);
+        if (!m_istream.seekg(static_cast<std::streamoff>(slice_offset),
+                             std::ios_base::cur) ||
+            !m_istream.read(data.data(), data.size())) {
+            throw Error("cannot read all the data of the record");
+        }
+        return header;
+    };
+
+  private:
+    std::istream &m_istream;
+    FileHeader m_header;
+    uint64_t m_header_size;
+
+    bool hasChecksums() const
+    {
+        return (m_header.features & FeatureChecksum) != 0;
+    };
+
+    size_t getStoredSize(const RecordHeader &header) const
+    {
+        if (header.type == RecordType::Data) {
+            return header.size;
+        } else if (header.type == RecordType::Compressed) {
+            return header.compressed_size;
+        }
+        return 0;
+    };
+
+    bool readBytes(char *data, size_t size, uint32_t &crc)
+    {
+        if (!m_istream.read(data, size)) {
+            return false;
+        }
+        crc = Crc32c::extend(crc, data, size);
+        return true;
+    };
+
+    void readStoredData(const RecordHeader &header, uint32_t crc,
+                        std::vector<char> &data)
+    {
+        if (header.type == RecordType::End) {
+            throw Error("unexpected end record");
+        }
+
+        data.resize(getStoredSize(header));
+        if (!readBytes(data.data(), data.size(), crc)) {
+            throw Error("cannot read all the data of the record");
+        }
+
+        if (hasChecksums()) {
+            uint32_t stored;
+            if (!m_istream.read(reinterpret_cast<char *>(&stored),
+                                sizeof(stored))) {
+                throw Error("cannot read record checksum");
+            }
+            if (be32toh(stored) != crc) {
+                throw Error("record checksum mismatch");
+            }
+        }
+    };
+
+    // The stream is left at the data of the record. The previous end is moved
+    // to the end of the record.
+    RecordHeader readRecordHeader(uint64_t position, uint64_t &previous_end,
+                                  uint32_t &crc)
+    {
+        // The end of the previous read may have failed the stream
+        m_istream.clear();
+        if (!m_istream.seekg(position, std::ios_base::beg)) {
+            throw Error("cannot seek to record");
+        }
+
+        return parseRecordHeader(
+            [this, &crc](char *data, size_t size) {
+                return readBytes(data, size, crc);
+            },
+            m_header, previous_end);
+    };
+};
+
+} // namespace FormatV3
@@ -25,8 +25,12 @@
  */
 
 #include "create.h"
+#include "extract.h"
+#include "merge.h"
 #include "options.h"
 #include "restore.h"
+#include "signature.h"
+#include "verify.h"
 
 #include "program_info.h"
 
@@ -50,6 +54,14 @@ main(int argc, char **argv)
             create(Options::Parser::parseCreate(argc, argv));
         } else if (Options::Parser::isRestore(argc, argv)) {
             restore(Options::Parser::parseRestore(argc, argv));
+        } else if (Options::Parser::isSignature(argc, argv)) {
+            signature(Options::Parser::parseSignature(argc, argv));
+        } else if (Options::Parser::isVerify(argc, argv)) {
+            verify(Options::Parser::parseVerify(argc, argv));
+        } else if (Options::Parser::isMerge(argc, argv)) {
+            merge(Options::Parser::parseMerge(argc, argv));
+        } else if (Options::Parser::isExtract(argc, argv)) {
+            extract(Options::Parser::parseExtract(argc, argv));
         } else {
             Options::printUsage();
             exit(1);
@@ -0,0 +1,136 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mapped_file.h"
+#include "file_stream.h"
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace MappedFile
+{
+
+bool
+isMappable(const std::filesystem::path &path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    return S_ISREG(st.st_mode) || S_ISBLK(st.st_mode);
+}
+
+Reader::Reader(const std::filesystem::path &path, size_t part_size,
+               uint64_t start_offset, uint64_t end_offset)
+    : m_part_size(part_size), m_pos(start_offset), m_end(end_offset),
+      m_mapping{nullptr, 0}, m_previous_mapping{nullptr, 0},
+      m_generation(0), m_window(nullptr), m_window_start(0), m_window_end(0)
+{
+    m_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        throw Error("cannot open file for mapping");
+    }
+
+    const int64_t file_size{FileStream::getFileSize(m_fd)};
+    if (file_size < 0) {
+        close(m_fd);
+        throw Error("cannot get size of file for mapping");
+    }
+    m_end = std::min(m_end, static_cast<uint64_t>(file_size));
+    m_pos = std::min(m_pos, m_end);
+}
+
+Reader::~Reader()
+{
+    // The mapping stays valid after closing the file
+    close(m_fd);
+    unmap(m_mapping);
+    unmap(m_previous_mapping);
+}
+
+BufferedStream::DataPart
+Reader::readPart()
+{
+    if (m_pos == m_end) {
+        return BufferedStream::DataPart{0, nullptr};
+    }
+
+    if ((m_window == nullptr) || (m_pos == m_window_end)) {
+        mapWindow();
+    }
+
+    const size_t size{static_cast<size_t>(
+        std::min<uint64_t>(m_part_size, m_window_end - m_pos))};
+    const char *const data{m_window + (m_pos - m_window_start)};
+    m_pos += size;
+
+    return BufferedStream::DataPart{size, data};
+}
+
+void
+Reader::mapWindow()
+{
+    // Only the window is mapped, so the size of the address space does not
+    // limit the size of the file
+    const uint64_t parts{std::max<uint64_t>(1, WindowSize / m_part_size)};
+    const uint64_t window_end{std::min(m_pos + (parts * m_part_size), m_end)};
+
+    const uint64_t page_size{static_cast<uint64_t>(sysconf(_SC_PAGESIZE))};
+    const uint64_t map_start{m_pos - (m_pos % page_size)};
+    const size_t map_size{static_cast<size_t>(window_end - map_start)};
+
+    void *const addr{mmap(nullptr, map_size, PROT_READ, MAP_SHARED, m_fd,
+                          static_cast<off_t>(map_start))};
+    if (addr == MAP_FAILED) {
+        throw Error("cannot map file");
+    }
+    // Let the kernel read ahead aggressively and drop the pages early
+    madvise(addr, map_size, MADV_SEQUENTIAL);
+
+    // The parts of the previous window can still be referenced
+    unmap(m_previous_mapping);
+    m_previous_mapping = m_mapping;
+    m_mapping = Mapping{addr, map_size};
+    ++m_generation;
+
+    m_window = static_cast<const char *>(addr) + (m_pos - map_start);
+    m_window_start = m_pos;
+    m_window_end = window_end;
+}
+
+void
+Reader::unmap(const Mapping &mapping)
+{
+    if (mapping.addr != nullptr) {
+        munmap(mapping.addr, mapping.size);
+    }
+}
+
+} // namespace MappedFile
@@ -0,0 +1,99 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "buffered_stream.h"
+#include "exception.h"
+
+#include <cstdint>
+#include <filesystem>
+
+namespace MappedFile
+{
+
+class Error : public DiffddError
+{
+  public:
+    explicit Error(const std::string &message) : DiffddError(message) {}
+};
+
+// Size of the part of the file mapped at once. It is rounded to whole parts.
+const size_t WindowSize{64 * 1024 * 1024};
+
+// Only regular files and block devices can be mapped
+bool isMappable(const std::filesystem::path &path);
+
+// Reads parts of a file without copying. The returned data parts point
+// directly to a window of the file mapping. The window stays mapped until the
+// second next window is mapped.
+class Reader
+{
+  public:
+    // All the parts except the last one have the part size. No data is read
+    // from the end offset, or the end of the file, on.
+    Reader(const std::filesystem::path &path, size_t part_size,
+           uint64_t start_offset, uint64_t end_offset);
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+    virtual ~Reader();
+
+    // Returns an empty data part at the end. The generation of the part is
+    // the current generation of the reader.
+    BufferedStream::DataPart readPart();
+
+    // Number of the windows mapped so far
+    uint64_t getGeneration() const { return m_generation; };
+    // Whether the window of the generation is still mapped
+    bool isValid(uint64_t generation) const
+    {
+        return (generation + 2) > m_generation;
+    };
+
+  private:
+    struct Mapping {
+        void *addr;
+        size_t size;
+    };
+
+    int m_fd;
+    const size_t m_part_size;
+    uint64_t m_pos;
+    uint64_t m_end;
+
+    // The current window and the one before it
+    Mapping m_mapping;
+    Mapping m_previous_mapping;
+    uint64_t m_generation;
+    const char *m_window;
+    uint64_t m_window_start;
+    uint64_t m_window_end;
+
+    void mapWindow();
+    static void unmap(const Mapping &mapping);
+};
+
+} // namespace MappedFile
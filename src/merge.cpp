@@ -0,0 +1,285 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "merge.h"
+#include "compression.h"
+#include "file_stream.h"
+#include "format_v3.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace
+{
+
+// A diff file being merged. Its records are consumed from the lowest offset,
+// possibly in parts.
+class MergeInput
+{
+  public:
+    MergeInput(const std::filesystem::path &path,
+               const FileStream::Config &config, size_t buffer_size,
+               size_t read_ahead_count)
+        : m_stream{FileStream::openInput(path, config)}, m_header{},
+          m_position{0}, m_previous_end{0}, m_end{false}
+    {
+        if (!*m_stream) {
+            throw MergeError("cannot open diff file");
+        }
+        m_reader = std::make_unique<FormatV3::Reader>(*m_stream, buffer_size,
+                                                      read_ahead_count);
+        readNextRecord();
+    };
+
+    MergeInput(const MergeInput &) = delete;
+    MergeInput &operator=(const MergeInput &) = delete;
+
+    bool isEnd() const { return m_end; };
+    // The lowest offset of the data not consumed yet
+    uint64_t getPosition() const { return m_position; };
+    uint64_t getRecordEnd() const { return m_header.offset + m_header.size; };
+    FormatV3::RecordType getRecordType() const { return m_header.type; };
+
+    // Consumes the data of the current record from the position. The data
+    // are copied to the destination unless it is null. The zero records have
+    // no data to copy.
+    void consume(size_t size, char *dest)
+    {
+        if (m_header.type == FormatV3::RecordType::Data) {
+            size_t filled{0};
+            while (filled < size) {
+                const FormatV3::RecordData rd{
+                    m_reader->readRecordData(size - filled)};
+                if (rd.size == 0) {
+                    throw MergeError("cannot read all the data of the record");
+                }
+                if (dest != nullptr) {
+                    memcpy(dest + filled, rd.data, rd.size);
+                }
+                filled += rd.size;
+            }
+        } else if ((m_header.type == FormatV3::RecordType::Compressed) &&
+                   (dest != nullptr)) {
+            memcpy(dest,
+                   m_decompressed.data() + (m_position - m_header.offset),
+                   size);
+        }
+
+        m_position += size;
+        if (m_position == getRecordEnd()) {
+            readNextRecord();
+        }
+    };
+
+    // Drops the data below the offset
+    void discardUntil(uint64_t offset)
+    {
+        while (!m_end && (m_position < offset)) {
+            consume(static_cast<size_t>(
+                        std::min(offset, getRecordEnd()) - m_position),
+                    nullptr);
+        }
+    };
+
+  private:
+    const std::unique_ptr<std::istream> m_stream;
+    std::unique_ptr<FormatV3::Reader> m_reader;
+    FormatV3::RecordHeader m_header;
+    uint64_t m_position;
+    uint64_t m_previous_end;
+    bool m_end;
+    // The compressed records are decompressed whole. The buffers are sized by
+    // their headers, which the reader limits to the maximum record size.
+    std::vector<char> m_compressed;
+    std::vector<char> m_decompressed;
+
+    void readNextRecord()
+    {
+        do {
+            m_header = m_reader->readRecordHeader();
+            if (m_header.type == FormatV3::RecordType::End) {
+                m_end = true;
+                return;
+            } else if (m_header.offset < m_previous_end) {
+                throw MergeError("records of diff file are not in order");
+            }
+            m_previous_end = getRecordEnd();
+            m_position = m_header.offset;
+
+            if (m_header.type == FormatV3::RecordType::Compressed) {
+                decompressRecord();
+            }
+        } while (m_header.size == 0);
+    };
+
+    void decompressRecord()
+    {
+        try {
+            m_compressed.resize(m_header.compressed_size);
+            m_decompressed.resize(m_header.size);
+        } catch (const std::bad_alloc &e) {
+            throw MergeError("cannot allocate buffer for record data");
+        }
+
+        size_t filled{0};
+        while (filled < m_compressed.size()) {
+            const FormatV3::RecordData rd{
+                m_reader->readRecordData(m_compressed.size() - filled)};
+            if (rd.size == 0) {
+                throw MergeError("cannot read all the data of the record");
+            }
+            memcpy(m_compressed.data() + filled, rd.data, rd.size);
+            filled += rd.size;
+        }
+
+        Compression::decompress(
+            static_cast<Compression::Codec>(m_header.codec),
+            m_compressed.data(), m_compressed.size(), m_decompressed.data(),
+            m_decompressed.size());
+    };
+};
+
+// Coalesces the adjacent merged data to the data records of at most the
+// buffer size
+class DataRecordBuffer
+{
+  public:
+    DataRecordBuffer(FormatV3::Writer &writer, size_t capacity)
+        : m_writer{writer}, m_data{new char[capacity]}, m_capacity{capacity},
+          m_offset{0}, m_size{0} {};
+
+    // Returns where to copy the data of the size at the offset. The size is
+    // reduced to fit in the buffer.
+    char *append(uint64_t offset, size_t &size)
+    {
+        if ((m_size > 0) &&
+            ((offset != (m_offset + m_size)) || (m_size == m_capacity))) {
+            flush();
+        }
+        if (m_size == 0) {
+            m_offset = offset;
+        }
+
+        size = std::min(size, m_capacity - m_size);
+        char *const dest{m_data.get() + m_size};
+        m_size += size;
+        return dest;
+    };
+
+    void flush()
+    {
+        if (m_size > 0) {
+            m_writer.writeDataRecord(
+                m_offset, m_size, {FormatV3::RecordData{m_size, m_data.get()}});
+            m_size = 0;
+        }
+    };
+
+  private:
+    FormatV3::Writer &m_writer;
+    const std::unique_ptr<char[]> m_data;
+    const size_t m_capacity;
+    uint64_t m_offset;
+    size_t m_size;
+};
+
+} // namespace
+
+void
+merge(const Options::Merge &opts)
+{
+    const FileStream::Config stream_config{
+        opts.getIoBackend(), opts.getBufferSize(), opts.getQueueDepth()};
+
+    std::vector<std::unique_ptr<MergeInput>> inputs;
+    for (const std::filesystem::path &path : opts.getDiffFilePaths()) {
+        inputs.push_back(std::make_unique<MergeInput>(
+            path, stream_config, opts.getBufferSize(),
+            opts.getReadAheadCount()));
+    }
+
+    const std::unique_ptr<std::ostream> out_ostream{FileStream::openOutput(
+        opts.getOutFilePath(), true, stream_config)};
+    if (!*out_ostream) {
+        throw MergeError("cannot open output file");
+    }
+    FormatV3::Writer format_writer{*out_ostream, opts.getBufferSize()};
+    DataRecordBuffer data_buffer{format_writer, opts.getBufferSize()};
+
+    // The records of each diff are in ascending order and do not overlap, so
+    // the diffs are merged by going through the offsets once. The data below
+    // the position are already merged.
+    uint64_t position{0};
+    for (;;) {
+        for (auto &input : inputs) {
+            input->discardUntil(position);
+        }
+
+        // The latest diff having data at the position wins until a later
+        // diff has data too
+        MergeInput *winner{nullptr};
+        uint64_t next_position{std::numeric_limits<uint64_t>::max()};
+        for (auto it = inputs.rbegin(); it != inputs.rend(); ++it) {
+            if ((*it)->isEnd()) {
+                continue;
+            } else if ((*it)->getPosition() == position) {
+                winner = it->get();
+                break;
+            }
+            next_position = std::min(next_position, (*it)->getPosition());
+        }
+
+        if (winner == nullptr) {
+            if (next_position == std::numeric_limits<uint64_t>::max()) {
+                break;
+            }
+            position = next_position;
+            continue;
+        }
+
+        const uint64_t end{std::min(winner->getRecordEnd(), next_position)};
+        if (winner->getRecordType() == FormatV3::RecordType::Zero) {
+            data_buffer.flush();
+            format_writer.writeZeroRecord(position, end - position);
+            winner->consume(static_cast<size_t>(end - position), nullptr);
+            position = end;
+            continue;
+        }
+
+        while (position < end) {
+            size_t size{static_cast<size_t>(end - position)};
+            char *const dest{data_buffer.append(position, size)};
+            winner->consume(size, dest);
+            position += size;
+        }
+    }
+
+    data_buffer.flush();
+    format_writer.writeEndRecord();
+}
@@ -0,0 +1,360 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Measures the parts of create on the data in the memory. It is built by
+// "make microbench" and is not a part of the program.
+
+#include "buffered_stream.h"
+#include "diff_finder.h"
+#include "format_v3.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::atomic<uint64_t> allocation_count{0};
+
+} // namespace
+
+// All the allocations of the objects are counted
+void *
+operator new(size_t size)
+{
+    ++allocation_count;
+    void *const p{malloc((size > 0) ? size : 1)};
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void
+operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void
+operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace
+{
+
+const size_t ImageSize{16 * 1024 * 1024};
+const int RepeatCount{5};
+
+// Deterministic, so the runs can be compared
+class Random
+{
+  public:
+    explicit Random(uint64_t seed) : m_state{seed} {};
+
+    uint64_t next()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 7;
+        m_state ^= m_state << 17;
+        return m_state;
+    };
+
+  private:
+    uint64_t m_state;
+};
+
+struct Images {
+    std::shared_ptr<char[]> old_data;
+    std::shared_ptr<char[]> new_data;
+};
+
+// One byte in each interval of the size differs at a random position. No
+// byte differs with the zero interval.
+Images
+makeImages(size_t change_interval)
+{
+    Random random{0x9e3779b97f4a7c15ULL};
+    Images images{std::shared_ptr<char[]>{new char[ImageSize]},
+                  std::shared_ptr<char[]>{new char[ImageSize]}};
+    for (size_t i = 0; i < ImageSize; ++i) {
+        images.old_data[i] = static_cast<char>(random.next());
+    }
+    memcpy(images.new_data.get(), images.old_data.get(), ImageSize);
+
+    if (change_interval > 0) {
+        for (size_t i = 0; i < ImageSize; i += change_interval) {
+            const size_t pos{i + (random.next() % change_interval)};
+            if (pos < ImageSize) {
+                images.new_data[pos] = ~images.new_data[pos];
+            }
+        }
+    }
+    return images;
+}
+
+Page
+makePage(const std::shared_ptr<char[]> &data, uint64_t start, size_t size)
+{
+    return Page{data.get() + start, start, start + size};
+}
+
+// Returns the pages of the image
+class MemoryPageReader : public PageReader
+{
+  public:
+    MemoryPageReader(std::shared_ptr<char[]> data, size_t page_size)
+        : m_data{data}, m_page_size{page_size}, m_pos{0} {};
+
+    Page getNextPage() override
+    {
+        const size_t size{std::min(m_page_size, ImageSize - m_pos)};
+        const Page page{makePage(m_data, m_pos, size)};
+        m_pos += size;
+        return page;
+    };
+
+    // The whole image is in the memory
+    bool isValid(const Page &) const override { return true; };
+
+  private:
+    std::shared_ptr<char[]> m_data;
+    const size_t m_page_size;
+    size_t m_pos;
+};
+
+// Discards the data written to it
+class NullBuffer : public std::streambuf
+{
+  protected:
+    std::streamsize xsputn(const char *, std::streamsize n) override
+    {
+        return n;
+    };
+    int overflow(int c) override { return traits_type::not_eof(c); };
+};
+
+struct Result {
+    double seconds;
+    uint64_t records;
+    uint64_t allocations;
+};
+
+// Runs the function several times and keeps the fastest run. The function
+// returns the number of the records it processed.
+Result
+measure(const std::function<uint64_t()> &func)
+{
+    Result best{0, 0, 0};
+    for (int i = 0; i < RepeatCount; ++i) {
+        const uint64_t allocations_before{allocation_count};
+        const auto start{std::chrono::steady_clock::now()};
+        const uint64_t records{func()};
+        const std::chrono::duration<double> elapsed{
+            std::chrono::steady_clock::now() - start};
+        if ((i == 0) || (elapsed.count() < best.seconds)) {
+            best = Result{elapsed.count(), records,
+                          allocation_count - allocations_before};
+        }
+    }
+    return best;
+}
+
+void
+report(const char *component, size_t page_size, size_t change_interval,
+       const Result &result)
+{
+    printf("%s\t%zu\t%zu\t%.4f\t%lu\t%.2f\n", component, page_size,
+           change_interval, (result.seconds * 1e9) / ImageSize,
+           static_cast<unsigned long>(result.records),
+           (result.records > 0) ? (static_cast<double>(result.allocations) /
+                                   result.records)
+                                : 0.0);
+}
+
+// Reads the data in the memory
+class MemoryBuffer : public std::streambuf
+{
+  public:
+    MemoryBuffer(char *data, size_t size) { setg(data, data, data + size); };
+};
+
+// Calls the function for the diffs of the pages as found by the diff finder
+// before merging. Each page ends with an empty diff.
+void
+forEachDiff(const Images &images, size_t page_size,
+            const std::function<void(const Diff &)> &func)
+{
+    for (uint64_t start = 0; start < ImageSize; start += page_size) {
+        const size_t size{std::min<size_t>(page_size, ImageSize - start)};
+        const Page old_page{makePage(images.old_data, start, size)};
+        const Page new_page{makePage(images.new_data, start, size)};
+        for (uint64_t offset = start;;) {
+            const Diff diff{
+                DiffFinder::findDiffInPages(old_page, new_page, offset)};
+            func(diff);
+            if (diff.isEmpty()) {
+                break;
+            }
+            offset = diff.getEnd();
+        }
+    }
+}
+
+// Calls the function for the diffs merged to the records as by create
+void
+forEachRecord(const Images &images, size_t page_size,
+              const std::function<void(const Diff &)> &func)
+{
+    DiffFinder finder{
+        std::make_unique<MemoryPageReader>(images.old_data, page_size),
+        std::make_unique<MemoryPageReader>(images.new_data, page_size),
+        static_cast<uint32_t>(page_size), FormatV3::RecordHeaderSize};
+    for (;;) {
+        const Diff diff{finder.findNextDiff()};
+        if (diff.isEmpty()) {
+            return;
+        }
+        func(diff);
+    }
+}
+
+void
+benchmark(size_t page_size, size_t change_interval)
+{
+    const Images images{makeImages(change_interval)};
+
+    report("findDiffInPages", page_size, change_interval, measure([&] {
+               uint64_t diffs{0};
+               forEachDiff(images, page_size, [&diffs](const Diff &diff) {
+                   diffs += diff.isEmpty() ? 0 : 1;
+               });
+               return diffs;
+           }));
+
+    std::vector<Diff> diffs;
+    forEachDiff(images, page_size,
+                [&diffs](const Diff &diff) { diffs.push_back(diff); });
+    report("diffsTryMerge", page_size, change_interval, measure([&] {
+               // The same merging as in the diff finder
+               uint64_t records{0};
+               Diff record{0};
+               for (const Diff &d : diffs) {
+                   Diff diff{d};
+                   if (diffsTryMerge(record, diff, FormatV3::RecordHeaderSize,
+                                     page_size) == MergeState::Finished) {
+                       records += record.isEmpty() ? 0 : 1;
+                       record = diff;
+                   }
+               }
+               return records + (record.isEmpty() ? 0 : 1);
+           }));
+
+    report("findNextDiff", page_size, change_interval, measure([&] {
+               uint64_t records{0};
+               forEachRecord(images, page_size,
+                             [&records](const Diff &) { ++records; });
+               return records;
+           }));
+
+    std::vector<Diff> records;
+    forEachRecord(images, page_size,
+                  [&records](const Diff &diff) { records.push_back(diff); });
+    report("getData", page_size, change_interval, measure([&] {
+               size_t size{0};
+               for (const Diff &r : records) {
+                   size += r.getData().size();
+               }
+               return (size > 0) ? records.size() : 0;
+           }));
+
+    report("readMultipart", page_size, change_interval, measure([&] {
+               MemoryBuffer buffer{images.new_data.get(), ImageSize};
+               std::istream istr{&buffer};
+               BufferedStream::Reader reader{istr, page_size, 2};
+               uint64_t parts{0};
+               while (reader.readMultipart(page_size).size > 0) {
+                   ++parts;
+               }
+               return parts;
+           }));
+
+    std::vector<FormatV3::RecordDataParts> record_data;
+    for (const Diff &r : records) {
+        record_data.push_back(r.getData());
+    }
+    report("writeDataRecord", page_size, change_interval, measure([&] {
+               NullBuffer null_buffer;
+               std::ostream ostr{&null_buffer};
+               FormatV3::Writer writer{ostr, page_size};
+               for (size_t i = 0; i < records.size(); ++i) {
+                   writer.writeDataRecord(records[i].getStart(),
+                                          records[i].getSize(),
+                                          record_data[i]);
+               }
+               return records.size();
+           }));
+
+    report("createRecords", page_size, change_interval, measure([&] {
+               // The whole path from the pages to the written records
+               NullBuffer null_buffer;
+               std::ostream ostr{&null_buffer};
+               FormatV3::Writer writer{ostr, page_size};
+               uint64_t records{0};
+               forEachRecord(images, page_size, [&](const Diff &diff) {
+                   writer.writeDataRecord(diff.getStart(), diff.getSize(),
+                                          diff.getData());
+                   ++records;
+               });
+               writer.writeEndRecord();
+               return records;
+           }));
+}
+
+} // namespace
+
+int
+main()
+{
+    printf("component\tpage_size\tchange_interval\tns_per_byte\trecords"
+           "\tallocs_per_record\n");
+    for (const size_t page_size : {4096, 65536, 1048576, 4194304}) {
+        for (const size_t change_interval : {0, 65536, 4096, 256, 16}) {
+            benchmark(page_size, change_interval);
+        }
+    }
+    return 0;
+}
@@ -29,6 +29,8 @@
 #include <iostream>
 
 #include <cstring>
+#include <getopt.h>
+#include <limits>
 #include <unistd.h>
 
 /* This header file is automatically generated at build time from the Makefile
@@ -38,22 +40,77 @@
 namespace Options
 {
 
+// Values of the options without a short form
+enum LongOption {
+    LONG_OPTION_IO_URING = 256,
+    LONG_OPTION_QUEUE_DEPTH,
+    LONG_OPTION_DIRECT,
+    LONG_OPTION_MMAP,
+    LONG_OPTION_SIGNATURE,
+    LONG_OPTION_COMPRESS,
+    LONG_OPTION_SKIP_IDENTICAL,
+    LONG_OPTION_OFFSET,
+    LONG_OPTION_LENGTH,
+    LONG_OPTION_STATS,
+    LONG_OPTION_PROGRESS,
+    LONG_OPTION_STATS_JSON,
+    LONG_OPTION_GRANULARITY,
+    LONG_OPTION_MAX_RECORD_SIZE,
+};
+
 void
 printUsage()
 {
     std::cout << "Usage: " << PROGRAM_NAME_STR << " create";
-    std::cout << " [-B BUFFER_SIZE] -i INFILE -b BASEFILE -o OUTFILE"
+    std::cout << " [-B BUFFER_SIZE] [-j THREADS] [-R READ_AHEAD]";
+    std::cout << " [--io-uring [--queue-depth DEPTH] | --direct] [--mmap]";
+    std::cout << " [--compress CODEC] [--granularity N]";
+    std::cout << " [--max-record-size SIZE] [--stats] [--progress]";
+    std::cout << " [--stats-json FILE]";
+    std::cout << " -i INFILE (-b BASEFILE | --signature SIGFILE) -o OUTFILE"
               << std::endl;
 
     std::cout << "   Or: " << PROGRAM_NAME_STR << " restore";
-    std::cout << " [-B BUFFER_SIZE] -d DIFFFILE -o OUTFILE" << std::endl;
+    std::cout << " [-B BUFFER_SIZE] [-j THREADS] [-R READ_AHEAD]";
+    std::cout << " [--io-uring [--queue-depth DEPTH] | --direct]";
+    std::cout << " [--skip-identical] [--stats] [--progress]";
+    std::cout << " [--stats-json FILE] -d DIFFFILE -o OUTFILE" << std::endl;
+
+    std::cout << "   Or: " << PROGRAM_NAME_STR << " signature";
+    std::cout << " [-B BUFFER_SIZE] [-s BLOCK_SIZE]";
+    std::cout << " -i INFILE -o SIGFILE" << std::endl;
+
+    std::cout << "   Or: " << PROGRAM_NAME_STR << " verify";
+    std::cout << " [-B BUFFER_SIZE] [-R READ_AHEAD]";
+    std::cout << " [--io-uring [--queue-depth DEPTH] | --direct]";
+    std::cout << " -d DIFFFILE" << std::endl;
+
+    std::cout << "   Or: " << PROGRAM_NAME_STR << " merge";
+    std::cout << " [-B BUFFER_SIZE] [-R READ_AHEAD]";
+    std::cout << " [--io-uring [--queue-depth DEPTH] | --direct]";
+    std::cout << " -o OUTFILE DIFFFILE..." << std::endl;
+
+    std::cout << "   Or: " << PROGRAM_NAME_STR << " extract";
+    std::cout << " [-B BUFFER_SIZE] --offset OFFSET --length LENGTH";
+    std::cout << " -b BASEFILE [DIFFFILE...]" << std::endl;
 
     std::cout << "   Or: " << PROGRAM_NAME_STR << " version" << std::endl;
 
     std::cout << "   Or: " << PROGRAM_NAME_STR << " help" << std::endl;
 }
 
-Create::Create() : m_buffer_size{Options::DEFAULT_BUFFER_SIZE} {}
+Create::Create()
+    : m_buffer_size{Options::DEFAULT_BUFFER_SIZE},
+      m_thread_count{Options::DEFAULT_THREAD_COUNT},
+      m_read_ahead_count{Options::DEFAULT_READ_AHEAD_COUNT},
+      m_io_backend{IoBackend::Stream},
+      m_queue_depth{Options::DEFAULT_QUEUE_DEPTH}, m_mmap{false},
+      m_compression_codec{Compression::Codec::None},
+      m_granularity{Options::DEFAULT_GRANULARITY},
+      m_max_record_size{Options::DEFAULT_MAX_RECORD_SIZE}, m_stats{false},
+      m_progress{false}
+{
+}
 
 uint32_t
 Create::getBufferSize() const
@@ -61,6 +118,72 @@ Create::getBufferSize() const
     return m_buffer_size;
 }
 
+uint32_t
+Create::getThreadCount() const
+{
+    return m_thread_count;
+}
+
+uint32_t
+Create::getReadAheadCount() const
+{
+    return m_read_ahead_count;
+}
+
+IoBackend
+Create::getIoBackend() const
+{
+    return m_io_backend;
+}
+
+uint32_t
+Create::getQueueDepth() const
+{
+    return m_queue_depth;
+}
+
+bool
+Create::getMmap() const
+{
+    return m_mmap;
+}
+
+Compression::Codec
+Create::getCompressionCodec() const
+{
+    return m_compression_codec;
+}
+
+uint32_t
+Create::getGranularity() const
+{
+    return m_granularity;
+}
+
+uint64_t
+Create::getMaxRecordSize() const
+{
+    return m_max_record_size;
+}
+
+bool
+Create::getStats() const
+{
+    return m_stats;
+}
+
+bool
+Create::getProgress() const
+{
+    return m_progress;
+}
+
+std::filesystem::path
+Create::getStatsJsonPath() const
+{
+    return m_stats_json_path;
+}
+
 std::filesystem::path
 Create::getInFilePath() const
 {
@@ -73,13 +196,27 @@ Create::getBaseFilePath() const
     return m_base_file_path;
 }
 
+std::filesystem::path
+Create::getSignatureFilePath() const
+{
+    return m_signature_file_path;
+}
+
 std::filesystem::path
 Create::getOutFilePath() const
 {
     return m_out_file_path;
 }
 
-Restore::Restore() : m_buffer_size{Options::DEFAULT_BUFFER_SIZE} {}
+Restore::Restore()
+    : m_buffer_size{Options::DEFAULT_BUFFER_SIZE},
+      m_thread_count{Options::DEFAULT_THREAD_COUNT},
+      m_read_ahead_count{Options::DEFAULT_READ_AHEAD_COUNT},
+      m_io_backend{IoBackend::Stream},
+      m_queue_depth{Options::DEFAULT_QUEUE_DEPTH}, m_skip_identical{false},
+      m_stats{false}, m_progress{false}
+{
+}
 
 uint32_t
 Restore::getBufferSize() const
@@ -87,6 +224,54 @@ Restore::getBufferSize() const
     return m_buffer_size;
 }
 
+uint32_t
+Restore::getThreadCount() const
+{
+    return m_thread_count;
+}
+
+uint32_t
+Restore::getReadAheadCount() const
+{
+    return m_read_ahead_count;
+}
+
+IoBackend
+Restore::getIoBackend() const
+{
+    return m_io_backend;
+}
+
+uint32_t
+Restore::getQueueDepth() const
+{
+    return m_queue_depth;
+}
+
+bool
+Restore::getSkipIdentical() const
+{
+    return m_skip_identical;
+}
+
+bool
+Restore::getStats() const
+{
+    return m_stats;
+}
+
+bool
+Restore::getProgress() const
+{
+    return m_progress;
+}
+
+std::filesystem::path
+Restore::getStatsJsonPath() const
+{
+    return m_stats_json_path;
+}
+
 std::filesystem::path
 Restore::getDiffFilePath() const
 {
@@ -99,6 +284,153 @@ Restore::getOutFilePath() const
     return m_out_file_path;
 }
 
+Signature::Signature()
+    : m_buffer_size{Options::DEFAULT_BUFFER_SIZE},
+      m_block_size{Options::DEFAULT_BLOCK_SIZE}
+{
+}
+
+uint32_t
+Signature::getBufferSize() const
+{
+    return m_buffer_size;
+}
+
+uint32_t
+Signature::getBlockSize() const
+{
+    return m_block_size;
+}
+
+std::filesystem::path
+Signature::getInFilePath() const
+{
+    return m_in_file_path;
+}
+
+std::filesystem::path
+Signature::getOutFilePath() const
+{
+    return m_out_file_path;
+}
+
+Verify::Verify()
+    : m_buffer_size{Options::DEFAULT_BUFFER_SIZE},
+      m_read_ahead_count{Options::DEFAULT_READ_AHEAD_COUNT},
+      m_io_backend{IoBackend::Stream},
+      m_queue_depth{Options::DEFAULT_QUEUE_DEPTH}
+{
+}
+
+uint32_t
+Verify::getBufferSize() const
+{
+    return m_buffer_size;
+}
+
+uint32_t
+Verify::getReadAheadCount() const
+{
+    return m_read_ahead_count;
+}
+
+IoBackend
+Verify::getIoBackend() const
+{
+    return m_io_backend;
+}
+
+uint32_t
+Verify::getQueueDepth() const
+{
+    return m_queue_depth;
+}
+
+std::filesystem::path
+Verify::getDiffFilePath() const
+{
+    return m_diff_file_path;
+}
+
+Merge::Merge()
+    : m_buffer_size{Options::DEFAULT_BUFFER_SIZE},
+      m_read_ahead_count{Options::DEFAULT_READ_AHEAD_COUNT},
+      m_io_backend{IoBackend::Stream},
+      m_queue_depth{Options::DEFAULT_QUEUE_DEPTH}
+{
+}
+
+uint32_t
+Merge::getBufferSize() const
+{
+    return m_buffer_size;
+}
+
+uint32_t
+Merge::getReadAheadCount() const
+{
+    return m_read_ahead_count;
+}
+
+IoBackend
+Merge::getIoBackend() const
+{
+    return m_io_backend;
+}
+
+uint32_t
+Merge::getQueueDepth() const
+{
+    return m_queue_depth;
+}
+
+std::vector<std::filesystem::path>
+Merge::getDiffFilePaths() const
+{
+    return m_diff_file_paths;
+}
+
+std::filesystem::path
+Merge::getOutFilePath() const
+{
+    return m_out_file_path;
+}
+
+Extract::Extract()
+    : m_buffer_size{Options::DEFAULT_BUFFER_SIZE}, m_offset{0}, m_length{0}
+{
+}
+
+uint32_t
+Extract::getBufferSize() const
+{
+    return m_buffer_size;
+}
+
+uint64_t
+Extract::getOffset() const
+{
+    return m_offset;
+}
+
+uint64_t
+Extract::getLength() const
+{
+    return m_length;
+}
+
+std::filesystem::path
+Extract::getBaseFilePath() const
+{
+    return m_base_file_path;
+}
+
+std::vector<std::filesystem::path>
+Extract::getDiffFilePaths() const
+{
+    return m_diff_file_paths;
+}
+
 bool
 Parser::isHelp(int argc, char **argv)
 {
@@ -123,6 +455,30 @@ Parser::isRestore(int argc, char **argv)
     return isOperation(argc, argv, "restore");
 }
 
+bool
+Parser::isSignature(int argc, char **argv)
+{
+    return isOperation(argc, argv, "signature");
+}
+
+bool
+Parser::isVerify(int argc, char **argv)
+{
+    return isOperation(argc, argv, "verify");
+}
+
+bool
+Parser::isMerge(int argc, char **argv)
+{
+    return isOperation(argc, argv, "merge");
+}
+
+bool
+Parser::isExtract(int argc, char **argv)
+{
+    return isOperation(argc, argv, "extract");
+}
+
 Create
 Parser::parseCreate(int argc, char **argv)
 {
@@ -135,16 +491,48 @@ Parser::parseCreate(int argc, char **argv)
 
     int ch;
     const char *arg_buffer_size = NULL;
+    const char *arg_thread_count = NULL;
+    const char *arg_read_ahead_count = NULL;
+    const char *arg_queue_depth = NULL;
     const char *arg_input_file = NULL;
     const char *arg_base_file = NULL;
+    const char *arg_signature_file = NULL;
     const char *arg_output_file = NULL;
+    const char *arg_stats_json_file = NULL;
+    const char *arg_granularity = NULL;
+    const char *arg_max_record_size = NULL;
 
-    while ((ch = getopt(argc, argv, ":B:i:b:o:")) != -1) {
+    const struct option long_options[] = {
+        {"io-uring", no_argument, NULL, LONG_OPTION_IO_URING},
+        {"queue-depth", required_argument, NULL, LONG_OPTION_QUEUE_DEPTH},
+        {"direct", no_argument, NULL, LONG_OPTION_DIRECT},
+        {"mmap", no_argument, NULL, LONG_OPTION_MMAP},
+        {"signature", required_argument, NULL, LONG_OPTION_SIGNATURE},
+        {"compress", required_argument, NULL, LONG_OPTION_COMPRESS},
+        {"granularity", required_argument, NULL, LONG_OPTION_GRANULARITY},
+        {"max-record-size", required_argument, NULL,
+         LONG_OPTION_MAX_RECORD_SIZE},
+        {"stats", no_argument, NULL, LONG_OPTION_STATS},
+        {"progress", no_argument, NULL, LONG_OPTION_PROGRESS},
+        {"stats-json", required_argument, NULL, LONG_OPTION_STATS_JSON},
+        {NULL, 0, NULL, 0},
+    };
+
+    while ((ch = getopt_long(argc, argv, ":B:j:R:i:b:o:", long_options,
+                             NULL)) != -1) {
         switch (ch) {
         case 'B':
             arg_buffer_size = optarg;
             break;
 
+        case 'j':
+            arg_thread_count = optarg;
+            break;
+
+        case 'R':
+            arg_read_ahead_count = optarg;
+            break;
+
         case 'i':
             arg_input_file = optarg;
             break;
@@ -157,11 +545,58 @@ Parser::parseCreate(int argc, char **argv)
             arg_output_file = optarg;
             break;
 
+        case LONG_OPTION_IO_URING:
+            opts.m_io_backend =
+                selectIoBackend(opts.m_io_backend, IoBackend::Uring);
+            break;
+
+        case LONG_OPTION_DIRECT:
+            opts.m_io_backend =
+                selectIoBackend(opts.m_io_backend, IoBackend::Direct);
+            break;
+
+        case LONG_OPTION_MMAP:
+            opts.m_mmap = true;
+            break;
+
+        case LONG_OPTION_SIGNATURE:
+            arg_signature_file = optarg;
+            break;
+
+        case LONG_OPTION_COMPRESS:
+            opts.m_compression_codec = parseCodec(optarg);
+            break;
+
+        case LONG_OPTION_GRANULARITY:
+            arg_granularity = optarg;
+            break;
+
+        case LONG_OPTION_MAX_RECORD_SIZE:
+            arg_max_record_size = optarg;
+            break;
+
+        case LONG_OPTION_STATS:
+            opts.m_stats = true;
+            break;
+
+        case LONG_OPTION_PROGRESS:
+            opts.m_progress = true;
+            break;
+
+        case LONG_OPTION_STATS_JSON:
+            arg_stats_json_file = optarg;
+            break;
+
+        case LONG_OPTION_QUEUE_DEPTH:
+            arg_queue_depth = optarg;
+            break;
+
         case ':':
-            throw Error("missing argument for option '-" +
-                        std::string(1, optopt) + "'");
+            throw Error("missing argument for option '" +
+                        getOptionName(optopt, long_options, argv) + "'");
         default:
-            throw Error("unknown option '-" + std::string(1, optopt) + "'");
+            throw Error("unknown option '" +
+                        getOptionName(optopt, long_options, argv) + "'");
         }
     }
 
@@ -175,10 +610,52 @@ Parser::parseCreate(int argc, char **argv)
         throw Error("buffer size cannot be 0");
     }
 
+    if ((arg_thread_count != NULL) &&
+        parseUnsigned(arg_thread_count, &(opts.m_thread_count))) {
+        throw Error("incorrect thread count");
+    } else if (opts.m_thread_count == 0) {
+        throw Error("thread count cannot be 0");
+    }
+
+    if ((arg_read_ahead_count != NULL) &&
+        parseUnsigned(arg_read_ahead_count, &(opts.m_read_ahead_count))) {
+        throw Error("incorrect read-ahead count");
+    }
+
+    if ((arg_queue_depth != NULL) &&
+        parseUnsigned(arg_queue_depth, &(opts.m_queue_depth))) {
+        throw Error("incorrect queue depth");
+    } else if (opts.m_queue_depth == 0) {
+        throw Error("queue depth cannot be 0");
+    }
+
+    if ((arg_granularity != NULL) &&
+        parseUnsigned(arg_granularity, &(opts.m_granularity))) {
+        throw Error("incorrect granularity");
+    } else if (opts.m_granularity == 0) {
+        throw Error("granularity cannot be 0");
+    } else if ((opts.m_granularity & (opts.m_granularity - 1)) != 0) {
+        throw Error("granularity must be a power of 2");
+    } else if ((arg_granularity != NULL) && (arg_signature_file != NULL)) {
+        throw Error("--granularity cannot be used with --signature");
+    }
+
+    if ((arg_max_record_size != NULL) &&
+        parseUnsigned(arg_max_record_size, &(opts.m_max_record_size))) {
+        throw Error("incorrect maximum record size");
+    } else if (opts.m_max_record_size == 0) {
+        throw Error("maximum record size cannot be 0");
+    } else if (opts.m_granularity > opts.m_max_record_size) {
+        throw Error(
+            "granularity cannot be larger than the maximum record size");
+    }
+
     if (arg_input_file == NULL) {
         throw Error("missing input file");
-    } else if (arg_base_file == NULL) {
+    } else if ((arg_base_file == NULL) && (arg_signature_file == NULL)) {
         throw Error("missing base file");
+    } else if ((arg_base_file != NULL) && (arg_signature_file != NULL)) {
+        throw Error("base file cannot be used with --signature");
     } else if (arg_output_file == NULL) {
         throw Error("missing output file");
     } else if (argc != 0) {
@@ -186,8 +663,15 @@ Parser::parseCreate(int argc, char **argv)
     }
 
     opts.m_in_file_path = arg_input_file;
-    opts.m_base_file_path = arg_base_file;
+    if (arg_base_file != NULL) {
+        opts.m_base_file_path = arg_base_file;
+    } else {
+        opts.m_signature_file_path = arg_signature_file;
+    }
     opts.m_out_file_path = arg_output_file;
+    if (arg_stats_json_file != NULL) {
+        opts.m_stats_json_path = arg_stats_json_file;
+    }
 
     return opts;
 }
@@ -202,15 +686,39 @@ Parser::parseRestore(int argc, char **argv)
 
     int ch;
     const char *arg_buffer_size = NULL;
+    const char *arg_thread_count = NULL;
+    const char *arg_read_ahead_count = NULL;
+    const char *arg_queue_depth = NULL;
     const char *arg_diff_file = NULL;
     const char *arg_output_file = NULL;
+    const char *arg_stats_json_file = NULL;
 
-    while ((ch = getopt(argc, argv, ":B:d:o:")) != -1) {
+    const struct option long_options[] = {
+        {"io-uring", no_argument, NULL, LONG_OPTION_IO_URING},
+        {"queue-depth", required_argument, NULL, LONG_OPTION_QUEUE_DEPTH},
+        {"direct", no_argument, NULL, LONG_OPTION_DIRECT},
+        {"skip-identical", no_argument, NULL, LONG_OPTION_SKIP_IDENTICAL},
+        {"stats", no_argument, NULL, LONG_OPTION_STATS},
+        {"progress", no_argument, NULL, LONG_OPTION_PROGRESS},
+        {"stats-json", required_argument, NULL, LONG_OPTION_STATS_JSON},
+        {NULL, 0, NULL, 0},
+    };
+
+    while ((ch = getopt_long(argc, argv, ":B:j:R:d:o:", long_options, NULL)) !=
+           -1) {
         switch (ch) {
         case 'B':
             arg_buffer_size = optarg;
             break;
 
+        case 'j':
+            arg_thread_count = optarg;
+            break;
+
+        case 'R':
+            arg_read_ahead_count = optarg;
+            break;
+
         case 'd':
             arg_diff_file = optarg;
             break;
@@ -219,11 +727,42 @@ Parser::parseRestore(int argc, char **argv)
             arg_output_file = optarg;
             break;
 
+        case LONG_OPTION_IO_URING:
+            opts.m_io_backend =
+                selectIoBackend(opts.m_io_backend, IoBackend::Uring);
+            break;
+
+        case LONG_OPTION_DIRECT:
+            opts.m_io_backend =
+                selectIoBackend(opts.m_io_backend, IoBackend::Direct);
+            break;
+
+        case LONG_OPTION_QUEUE_DEPTH:
+            arg_queue_depth = optarg;
+            break;
+
+        case LONG_OPTION_SKIP_IDENTICAL:
+            opts.m_skip_identical = true;
+            break;
+
+        case LONG_OPTION_STATS:
+            opts.m_stats = true;
+            break;
+
+        case LONG_OPTION_PROGRESS:
+            opts.m_progress = true;
+            break;
+
+        case LONG_OPTION_STATS_JSON:
+            arg_stats_json_file = optarg;
+            break;
+
         case ':':
-            throw Error("missing argument for option '-" +
-                        std::string(1, optopt) + "'");
+            throw Error("missing argument for option '" +
+                        getOptionName(optopt, long_options, argv) + "'");
         default:
-            throw Error("unknown option '-" + std::string(1, optopt) + "'");
+            throw Error("unknown option '" +
+                        getOptionName(optopt, long_options, argv) + "'");
         }
     }
 
@@ -237,6 +776,29 @@ Parser::parseRestore(int argc, char **argv)
         throw Error("buffer size cannot be 0");
     }
 
+    if ((arg_thread_count != NULL) &&
+        parseUnsigned(arg_thread_count, &(opts.m_thread_count))) {
+        throw Error("incorrect thread count");
+    } else if (opts.m_thread_count == 0) {
+        throw Error("thread count cannot be 0");
+    } else if ((opts.m_thread_count > 1) &&
+               (opts.m_io_backend == IoBackend::Uring)) {
+        // The threads write the output file by pwrite
+        throw Error("-j cannot be used with --io-uring");
+    }
+
+    if ((arg_read_ahead_count != NULL) &&
+        parseUnsigned(arg_read_ahead_count, &(opts.m_read_ahead_count))) {
+        throw Error("incorrect read-ahead count");
+    }
+
+    if ((arg_queue_depth != NULL) &&
+        parseUnsigned(arg_queue_depth, &(opts.m_queue_depth))) {
+        throw Error("incorrect queue depth");
+    } else if (opts.m_queue_depth == 0) {
+        throw Error("queue depth cannot be 0");
+    }
+
     if (arg_diff_file == NULL) {
         throw Error("missing diff file");
     } else if (arg_output_file == NULL) {
@@ -247,6 +809,358 @@ Parser::parseRestore(int argc, char **argv)
 
     opts.m_diff_file_path = arg_diff_file;
     opts.m_out_file_path = arg_output_file;
+    if (arg_stats_json_file != NULL) {
+        opts.m_stats_json_path = arg_stats_json_file;
+    }
+
+    return opts;
+}
+
+Signature
+Parser::parseSignature(int argc, char **argv)
+{
+    Signature opts;
+
+    argc -= 1;
+    argv += 1;
+
+    int ch;
+    const char *arg_buffer_size = NULL;
+    const char *arg_block_size = NULL;
+    const char *arg_input_file = NULL;
+    const char *arg_output_file = NULL;
+
+    const struct option long_options[] = {
+        {NULL, 0, NULL, 0},
+    };
+
+    while ((ch = getopt_long(argc, argv, ":B:s:i:o:", long_options, NULL)) !=
+           -1) {
+        switch (ch) {
+        case 'B':
+            arg_buffer_size = optarg;
+            break;
+
+        case 's':
+            arg_block_size = optarg;
+            break;
+
+        case 'i':
+            arg_input_file = optarg;
+            break;
+
+        case 'o':
+            arg_output_file = optarg;
+            break;
+
+        case ':':
+            throw Error("missing argument for option '" +
+                        getOptionName(optopt, long_options, argv) + "'");
+        default:
+            throw Error("unknown option '" +
+                        getOptionName(optopt, long_options, argv) + "'");
+        }
+    }
+
+    argc -= optind;
+
+    /* Convert numbers in the arguments */
+    if ((arg_buffer_size != NULL) &&
+        parseUnsigned(arg_buffer_size, &(opts.m_buffer_size))) {
+        throw Error("incorrect buffer size");
+    } else if (opts.m_buffer_size == 0) {
+        throw Error("buffer size cannot be 0");
+    }
+
+    if ((arg_block_size != NULL) &&
+        parseUnsigned(arg_block_size, &(opts.m_block_size))) {
+        throw Error("incorrect block size");
+    } else if (opts.m_block_size == 0) {
+        throw Error("block size cannot be 0");
+    }
+
+    if (arg_input_file == NULL) {
+        throw Error("missing input file");
+    } else if (arg_output_file == NULL) {
+        throw Error("missing output file");
+    } else if (argc != 0) {
+        throw Error("too many arguments");
+    }
+
+    opts.m_in_file_path = arg_input_file;
+    opts.m_out_file_path = arg_output_file;
+
+    return opts;
+}
+
+Verify
+Parser::parseVerify(int argc, char **argv)
+{
+    Verify opts;
+
+    argc -= 1;
+    argv += 1;
+
+    int ch;
+    const char *arg_buffer_size = NULL;
+    const char *arg_read_ahead_count = NULL;
+    const char *arg_queue_depth = NULL;
+    const char *arg_diff_file = NULL;
+
+    const struct option long_options[] = {
+        {"io-uring", no_argument, NULL, LONG_OPTION_IO_URING},
+        {"queue-depth", required_argument, NULL, LONG_OPTION_QUEUE_DEPTH},
+        {"direct", no_argument, NULL, LONG_OPTION_DIRECT},
+        {NULL, 0, NULL, 0},
+    };
+
+    while ((ch = getopt_long(argc, argv, ":B:R:d:", long_options, NULL)) !=
+           -1) {
+        switch (ch) {
+        case 'B':
+            arg_buffer_size = optarg;
+            break;
+
+        case 'R':
+            arg_read_ahead_count = optarg;
+            break;
+
+        case 'd':
+            arg_diff_file = optarg;
+            break;
+
+        case LONG_OPTION_IO_URING:
+            opts.m_io_backend =
+                selectIoBackend(opts.m_io_backend, IoBackend::Uring);
+            break;
+
+        case LONG_OPTION_DIRECT:
+            opts.m_io_backend =
+                selectIoBackend(opts.m_io_backend, IoBackend::Direct);
+            break;
+
+        case LONG_OPTION_QUEUE_DEPTH:
+            arg_queue_depth = optarg;
+            break;
+
+        case ':':
+            throw Error("missing argument for option '" +
+                        getOptionName(optopt, long_options, argv) + "'");
+        default:
+            throw Error("unknown option '" +
+                        getOptionName(optopt, long_options, argv) + "'");
+        }
+    }
+
+    argc -= optind;
+
+    /* Convert numbers in the arguments */
+    if ((arg_buffer_size != NULL) &&
+        parseUnsigned(arg_buffer_size, &(opts.m_buffer_size))) {
+        throw Error("incorrect buffer size");
+    } else if (opts.m_buffer_size == 0) {
+        throw Error("buffer size cannot be 0");
+    }
+
+    if ((arg_read_ahead_count != NULL) &&
+        parseUnsigned(arg_read_ahead_count, &(opts.m_read_ahead_count))) {
+        throw Error("incorrect read-ahead count");
+    }
+
+    if ((arg_queue_depth != NULL) &&
+        parseUnsigned(arg_queue_depth, &(opts.m_queue_depth))) {
+        throw Error("incorrect queue depth");
+    } else if (opts.m_queue_depth == 0) {
+        throw Error("queue depth cannot be 0");
+    }
+
+    if (arg_diff_file == NULL) {
+        throw Error("missing diff file");
+    } else if (argc != 0) {
+        throw Error("too many arguments");
+    }
+
+    opts.m_diff_file_path = arg_diff_file;
+
+    return opts;
+}
+
+Merge
+Parser::parseMerge(int argc, char **argv)
+{
+    Merge opts;
+
+    argc -= 1;
+    argv += 1;
+
+    int ch;
+    const char *arg_buffer_size = NULL;
+    const char *arg_read_ahead_count = NULL;
+    const char *arg_queue_depth = NULL;
+    const char *arg_output_file = NULL;
+
+    const struct option long_options[] = {
+        {"io-uring", no_argument, NULL, LONG_OPTION_IO_URING},
+        {"queue-depth", required_argument, NULL, LONG_OPTION_QUEUE_DEPTH},
+        {"direct", no_argument, NULL, LONG_OPTION_DIRECT},
+        {NULL, 0, NULL, 0},
+    };
+
+    while ((ch = getopt_long(argc, argv, ":B:R:o:", long_options, NULL)) !=
+           -1) {
+        switch (ch) {
+        case 'B':
+            arg_buffer_size = optarg;
+            break;
+
+        case 'R':
+            arg_read_ahead_count = optarg;
+            break;
+
+        case 'o':
+            arg_output_file = optarg;
+            break;
+
+        case LONG_OPTION_IO_URING:
+            opts.m_io_backend =
+                selectIoBackend(opts.m_io_backend, IoBackend::Uring);
+            break;
+
+        case LONG_OPTION_DIRECT:
+            opts.m_io_backend =
+                selectIoBackend(opts.m_io_backend, IoBackend::Direct);
+            break;
+
+        case LONG_OPTION_QUEUE_DEPTH:
+            arg_queue_depth = optarg;
+            break;
+
+        case ':':
+            throw Error("missing argument for option '" +
+                        getOptionName(optopt, long_options, argv) + "'");
+        default:
+            throw Error("unknown option '" +
+                        getOptionName(optopt, long_options, argv) + "'");
+        }
+    }
+
+    argc -= optind;
+
+    /* Convert numbers in the arguments */
+    if ((arg_buffer_size != NULL) &&
+        parseUnsigned(arg_buffer_size, &(opts.m_buffer_size))) {
+        throw Error("incorrect buffer size");
+    } else if (opts.m_buffer_size == 0) {
+        throw Error("buffer size cannot be 0");
+    }
+
+    if ((arg_read_ahead_count != NULL) &&
+        parseUnsigned(arg_read_ahead_count, &(opts.m_read_ahead_count))) {
+        throw Error("incorrect read-ahead count");
+    }
+
+    if ((arg_queue_depth != NULL) &&
+        parseUnsigned(arg_queue_depth, &(opts.m_queue_depth))) {
+        throw Error("incorrect queue depth");
+    } else if (opts.m_queue_depth == 0) {
+        throw Error("queue depth cannot be 0");
+    }
+
+    if (arg_output_file == NULL) {
+        throw Error("missing output file");
+    } else if (argc == 0) {
+        throw Error("missing diff file");
+    }
+
+    opts.m_out_file_path = arg_output_file;
+    for (int i = 0; i < argc; ++i) {
+        opts.m_diff_file_paths.push_back(argv[optind + i]);
+    }
+
+    return opts;
+}
+
+Extract
+Parser::parseExtract(int argc, char **argv)
+{
+    Extract opts;
+
+    argc -= 1;
+    argv += 1;
+
+    int ch;
+    const char *arg_buffer_size = NULL;
+    const char *arg_offset = NULL;
+    const char *arg_length = NULL;
+    const char *arg_base_file = NULL;
+
+    const struct option long_options[] = {
+        {"offset", required_argument, NULL, LONG_OPTION_OFFSET},
+        {"length", required_argument, NULL, LONG_OPTION_LENGTH},
+        {NULL, 0, NULL, 0},
+    };
+
+    while ((ch = getopt_long(argc, argv, ":B:b:", long_options, NULL)) != -1) {
+        switch (ch) {
+        case 'B':
+            arg_buffer_size = optarg;
+            break;
+
+        case 'b':
+            arg_base_file = optarg;
+            break;
+
+        case LONG_OPTION_OFFSET:
+            arg_offset = optarg;
+            break;
+
+        case LONG_OPTION_LENGTH:
+            arg_length = optarg;
+            break;
+
+        case ':':
+            throw Error("missing argument for option '" +
+                        getOptionName(optopt, long_options, argv) + "'");
+        default:
+            throw Error("unknown option '" +
+                        getOptionName(optopt, long_options, argv) + "'");
+        }
+    }
+
+    argc -= optind;
+
+    /* Convert numbers in the arguments */
+    if ((arg_buffer_size != NULL) &&
+        parseUnsigned(arg_buffer_size, &(opts.m_buffer_size))) {
+        throw Error("incorrect buffer size");
+    } else if (opts.m_buffer_size == 0) {
+        throw Error("buffer size cannot be 0");
+    }
+
+    if (arg_offset == NULL) {
+        throw Error("missing offset");
+    } else if (parseUnsigned(arg_offset, &(opts.m_offset))) {
+        throw Error("incorrect offset");
+    }
+
+    if (arg_length == NULL) {
+        throw Error("missing length");
+    } else if (parseUnsigned(arg_length, &(opts.m_length)) ||
+               (opts.m_length >
+                (std::numeric_limits<uint64_t>::max() - opts.m_offset))) {
+        throw Error("incorrect length");
+    } else if (opts.m_length == 0) {
+        throw Error("length cannot be 0");
+    }
+
+    if (arg_base_file == NULL) {
+        throw Error("missing base file");
+    }
+
+    opts.m_base_file_path = arg_base_file;
+    for (int i = 0; i < argc; ++i) {
+        opts.m_diff_file_paths.push_back(argv[optind + i]);
+    }
 
     return opts;
 }
@@ -270,4 +1184,61 @@ Parser::parseUnsigned(const char *const arg, uint32_t *const value)
     return ((*end != '\0') || (errno != 0)) ? -1 : 0;
 }
 
+int
+Parser::parseUnsigned(const char *const arg, uint64_t *const value)
+{
+    char *end;
+
+    errno = 0;
+
+    *value = strtoull(arg, &end, 0);
+
+    return ((*end != '\0') || (errno != 0)) ? -1 : 0;
+}
+
+IoBackend
+Parser::selectIoBackend(IoBackend current, IoBackend selected)
+{
+    if ((current != IoBackend::Stream) && (current != selected)) {
+        throw Error("--direct cannot be used with --io-uring");
+    }
+    return selected;
+}
+
+Compression::Codec
+Parser::parseCodec(const char *const arg)
+{
+    Compression::Codec codec;
+    if (strcmp(arg, "lz") == 0) {
+        codec = Compression::Codec::Lz;
+    } else if (strcmp(arg, "zstd") == 0) {
+        codec = Compression::Codec::Zstd;
+    } else {
+        throw Error("unknown compression codec");
+    }
+
+    if (!Compression::isAvailable(codec)) {
+        throw Error("compression codec is not available");
+    }
+    return codec;
+}
+
+std::string
+Parser::getOptionName(int ch, const struct option *long_options, char **argv)
+{
+    for (const struct option *o = long_options; o->name != NULL; ++o) {
+        if (o->val == ch) {
+            return "--" + std::string(o->name);
+        }
+    }
+
+    if (ch == 0) {
+        // Unknown long option. getopt does not return it, take it from the
+        // arguments.
+        return std::string(argv[optind - 1]);
+    }
+
+    return "-" + std::string(1, ch);
+}
+
 } // namespace Options
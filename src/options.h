@@ -26,10 +26,14 @@
 
 #pragma once
 
+#include "compression.h"
 #include "exception.h"
 
 #include <cstdint>
 #include <filesystem>
+#include <vector>
+
+struct option;
 
 namespace Options
 {
@@ -41,6 +45,19 @@ class Error : public DiffddError
 };
 
 const inline int DEFAULT_BUFFER_SIZE{4 * 1024 * 1024};
+const inline int DEFAULT_THREAD_COUNT{1};
+const inline int DEFAULT_READ_AHEAD_COUNT{0};
+const inline int DEFAULT_QUEUE_DEPTH{8};
+const inline int DEFAULT_BLOCK_SIZE{4096};
+// The diffs are byte-exact by default
+const inline int DEFAULT_GRANULARITY{1};
+const inline int DEFAULT_MAX_RECORD_SIZE{4 * 1024 * 1024};
+
+enum class IoBackend {
+    Stream,
+    Uring,
+    Direct,
+};
 
 void printUsage();
 
@@ -52,14 +69,42 @@ class Create
     Create();
 
     uint32_t getBufferSize() const;
+    uint32_t getThreadCount() const;
+    uint32_t getReadAheadCount() const;
+    IoBackend getIoBackend() const;
+    uint32_t getQueueDepth() const;
+    bool getMmap() const;
+    Compression::Codec getCompressionCodec() const;
+    // The diffs consist of whole blocks of this size
+    uint32_t getGranularity() const;
+    // The data records are not larger
+    uint64_t getMaxRecordSize() const;
+    bool getStats() const;
+    bool getProgress() const;
+    // Empty when the statistics are not written to a file
+    std::filesystem::path getStatsJsonPath() const;
     std::filesystem::path getInFilePath() const;
+    // Empty when the signature file is used instead
     std::filesystem::path getBaseFilePath() const;
+    std::filesystem::path getSignatureFilePath() const;
     std::filesystem::path getOutFilePath() const;
 
   private:
     uint32_t m_buffer_size;
+    uint32_t m_thread_count;
+    uint32_t m_read_ahead_count;
+    IoBackend m_io_backend;
+    uint32_t m_queue_depth;
+    bool m_mmap;
+    Compression::Codec m_compression_codec;
+    uint32_t m_granularity;
+    uint64_t m_max_record_size;
+    bool m_stats;
+    bool m_progress;
+    std::filesystem::path m_stats_json_path;
     std::filesystem::path m_in_file_path;
     std::filesystem::path m_base_file_path;
+    std::filesystem::path m_signature_file_path;
     std::filesystem::path m_out_file_path;
 };
 
@@ -71,15 +116,118 @@ class Restore
     Restore();
 
     uint32_t getBufferSize() const;
+    uint32_t getThreadCount() const;
+    uint32_t getReadAheadCount() const;
+    IoBackend getIoBackend() const;
+    uint32_t getQueueDepth() const;
+    bool getSkipIdentical() const;
+    bool getStats() const;
+    bool getProgress() const;
+    // Empty when the statistics are not written to a file
+    std::filesystem::path getStatsJsonPath() const;
     std::filesystem::path getDiffFilePath() const;
     std::filesystem::path getOutFilePath() const;
 
   private:
     uint32_t m_buffer_size;
+    uint32_t m_thread_count;
+    uint32_t m_read_ahead_count;
+    IoBackend m_io_backend;
+    uint32_t m_queue_depth;
+    bool m_skip_identical;
+    bool m_stats;
+    bool m_progress;
+    std::filesystem::path m_stats_json_path;
     std::filesystem::path m_diff_file_path;
     std::filesystem::path m_out_file_path;
 };
 
+class Signature
+{
+    friend class Parser;
+
+  public:
+    Signature();
+
+    uint32_t getBufferSize() const;
+    uint32_t getBlockSize() const;
+    std::filesystem::path getInFilePath() const;
+    std::filesystem::path getOutFilePath() const;
+
+  private:
+    uint32_t m_buffer_size;
+    uint32_t m_block_size;
+    std::filesystem::path m_in_file_path;
+    std::filesystem::path m_out_file_path;
+};
+
+class Verify
+{
+    friend class Parser;
+
+  public:
+    Verify();
+
+    uint32_t getBufferSize() const;
+    uint32_t getReadAheadCount() const;
+    IoBackend getIoBackend() const;
+    uint32_t getQueueDepth() const;
+    std::filesystem::path getDiffFilePath() const;
+
+  private:
+    uint32_t m_buffer_size;
+    uint32_t m_read_ahead_count;
+    IoBackend m_io_backend;
+    uint32_t m_queue_depth;
+    std::filesystem::path m_diff_file_path;
+};
+
+class Merge
+{
+    friend class Parser;
+
+  public:
+    Merge();
+
+    uint32_t getBufferSize() const;
+    uint32_t getReadAheadCount() const;
+    IoBackend getIoBackend() const;
+    uint32_t getQueueDepth() const;
+    // In the order of the application, the later ones win
+    std::vector<std::filesystem::path> getDiffFilePaths() const;
+    std::filesystem::path getOutFilePath() const;
+
+  private:
+    uint32_t m_buffer_size;
+    uint32_t m_read_ahead_count;
+    IoBackend m_io_backend;
+    uint32_t m_queue_depth;
+    std::vector<std::filesystem::path> m_diff_file_paths;
+    std::filesystem::path m_out_file_path;
+};
+
+class Extract
+{
+    friend class Parser;
+
+  public:
+    Extract();
+
+    uint32_t getBufferSize() const;
+    uint64_t getOffset() const;
+    uint64_t getLength() const;
+    std::filesystem::path getBaseFilePath() const;
+    // In the order of the application, the later ones win
+    std::vector<std::filesystem::path> getDiffFilePaths() const;
+
+  private:
+    uint32_t m_buffer_size;
+    uint64_t m_offset;
+    uint64_t m_length;
+    std::filesystem::path m_base_file_path;
+    std::vector<std::filesystem::path> m_diff_file_paths;
+};
+
 class Parser
 {
   public:
@@ -87,16 +235,29 @@ class Parser
     static bool isVersion(int argc, char **argv);
     static bool isCreate(int argc, char **argv);
     static bool isRestore(int argc, char **argv);
+    static bool isSignature(int argc, char **argv);
+    static bool isVerify(int argc, char **argv);
+    static bool isMerge(int argc, char **argv);
+    static bool isExtract(int argc, char **argv);
 
     static Create parseCreate(int argc, char **argv);
     static Restore parseRestore(int argc, char **argv);
+    static Signature parseSignature(int argc, char **argv);
+    static Verify parseVerify(int argc, char **argv);
+    static Merge parseMerge(int argc, char **argv);
+    static Extract parseExtract(int argc, char **argv);
 
   private:
-    static const size_t MAX_OPERATION_NAME_LENGTH{8};
+    static const size_t MAX_OPERATION_NAME_LENGTH{16};
 
     static bool isOperation(int argc, char **argv,
                             std::string_view operationName);
     static int parseUnsigned(const char *const arg, uint32_t *const value);
+    static int parseUnsigned(const char *const arg, uint64_t *const value);
+    static IoBackend selectIoBackend(IoBackend current, IoBackend selected);
+    static Compression::Codec parseCodec(const char *const arg);
+    static std::string getOptionName(int ch, const struct option *long_options,
+                                     char **argv);
 };
 
 } // namespace Options
@@ -0,0 +1,2 @@
+const std::string PROGRAM_NAME_STR {"diff-dd"};
+const std::string PROGRAM_VERSION_STR {"3.0.0-prealpha"};
@@ -25,58 +25,1005 @@
  */
 
 #include "restore.h"
-#include "format_v2.h"
+#include "buffered_stream.h"
+#include "compression.h"
+#include "direct_stream.h"
+#include "file_stream.h"
+#include "format_v3.h"
+#include "scan.h"
+#include "sparse.h"
+#include "stats.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <filesystem>
-#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Copies the data of the record to the destination
 void
-restore(const Options::Restore &opts)
+readRecordData(FormatV3::Reader &diff_reader, char *dest, size_t size)
 {
-    std::fstream diff_stream;
-    diff_stream.open(opts.getDiffFilePath(),
-                     std::ifstream::in | std::ifstream::binary);
-    if (!diff_stream) {
-        throw RestoreError("cannot open diff file");
+    size_t filled{0};
+    while (filled < size) {
+        const FormatV3::RecordData rd{
+            diff_reader.readRecordData(size - filled)};
+        if (rd.size == 0) {
+            throw RestoreError("cannot read all the data of the record");
+        }
+        memcpy(dest + filled, rd.data, rd.size);
+        filled += rd.size;
     }
+}
+
+// Reads the output file to find the ranges of the data differing from it, so
+// only they are written. The file is read in batches of the buffer size.
+class TargetComparator
+{
+  public:
+    TargetComparator(const std::filesystem::path &path, size_t buffer_size)
+        : m_fd(open(path.c_str(), O_RDONLY | O_CLOEXEC)),
+          m_buffer_size(buffer_size)
+    {
+        if (m_fd < 0) {
+            throw RestoreError("cannot open output file");
+        }
+
+        try {
+            m_buffer = std::make_unique<char[]>(buffer_size);
+        } catch (const std::bad_alloc &e) {
+            close(m_fd);
+            throw RestoreError("cannot allocate buffer for output data");
+        }
+    };
+
+    TargetComparator(const TargetComparator &) = delete;
+    TargetComparator &operator=(const TargetComparator &) = delete;
+
+    virtual ~TargetComparator() { close(m_fd); };
 
-    FormatV2::Reader diff_reader(diff_stream, opts.getBufferSize());
+    // Calls write(offset, data, size) for each range of the data differing
+    // from the file, in ascending order. The data beyond the end of the file
+    // differ.
+    template <typename WriteFunc>
+    void forEachDifferent(uint64_t offset, const char *data, size_t size,
+                          WriteFunc write)
+    {
+        // The adjacent differing ranges are written at once, even across the
+        // batches
+        size_t diff_start{0};
+        size_t diff_end{0};
+        const auto add_diff{[&](size_t start, size_t end) {
+            if (start != diff_end) {
+                if (diff_end > diff_start) {
+                    write(offset + diff_start, data + diff_start,
+                          diff_end - diff_start);
+                }
+                diff_start = start;
+            }
+            diff_end = end;
+        }};
+
+        size_t batch_start{0};
+        while (batch_start < size) {
+            const size_t batch_size{
+                std::min(size - batch_start, m_buffer_size)};
+            const size_t read_size{readBatch(offset + batch_start, batch_size)};
+            const char *const batch{data + batch_start};
+            const char *const file{m_buffer.get()};
+
+            size_t pos{Scan::findFirstDifferent(batch, file, read_size)};
+            while (pos < read_size) {
+                const size_t end{pos + Scan::findFirstSame(batch + pos,
+                                                           file + pos,
+                                                           read_size - pos)};
+                add_diff(batch_start + pos, batch_start + end);
+                pos = end + Scan::findFirstDifferent(batch + end, file + end,
+                                                     read_size - end);
+            }
 
-    std::fstream out_file;
-    out_file.open(opts.getOutFilePath(),
-                  std::ios::in | std::ios::out | std::ios::binary);
-    if (!out_file) {
-        throw RestoreError("cannot open output file");
+            if (read_size < batch_size) {
+                // The rest of the data is beyond the end of the file
+                add_diff(batch_start + read_size, size);
+                break;
+            }
+            batch_start += batch_size;
+        }
+
+        if (diff_end > diff_start) {
+            write(offset + diff_start, data + diff_start,
+                  diff_end - diff_start);
+        }
+    };
+
+    // Returns true if the range of the file holds only zeros. The range
+    // beyond the end of the file does not.
+    bool isZero(uint64_t offset, uint64_t size)
+    {
+        while (size > 0) {
+            const size_t batch_size{static_cast<size_t>(
+                std::min<uint64_t>(size, m_buffer_size))};
+            if ((readBatch(offset, batch_size) != batch_size) ||
+                (Scan::findFirstNonZero(m_buffer.get(), batch_size) !=
+                 batch_size)) {
+                return false;
+            }
+            offset += batch_size;
+            size -= batch_size;
+        }
+        return true;
+    };
+
+  private:
+    const int m_fd;
+    const size_t m_buffer_size;
+    std::unique_ptr<char[]> m_buffer;
+
+    // Returns less than the size only at the end of the file
+    size_t readBatch(uint64_t offset, size_t size)
+    {
+        size_t filled{0};
+        while (filled < size) {
+            const ssize_t r{
+                pread(m_fd, m_buffer.get() + filled, size - filled, offset)};
+            if ((r < 0) && (errno == EINTR)) {
+                continue;
+            } else if (r < 0) {
+                throw RestoreError("cannot read output file");
+            } else if (r == 0) {
+                break;
+            }
+            filled += r;
+            offset += r;
+        }
+        return filled;
+    };
+};
+
+// Counts the records and the data read from the diff file for the
+// statistics. The data of a record are counted with the header of the next
+// one. The statistics are updated once per the batch size of the data read,
+// and at the end record.
+class RecordCounter
+{
+  public:
+    RecordCounter(const FormatV3::Reader &diff_reader, size_t batch_size)
+        : m_diff_reader(diff_reader), m_batch_size(batch_size),
+          m_position(diff_reader.getPosition()), m_records(0){};
+
+    void count(const FormatV3::RecordHeader &header)
+    {
+        if (header.type != FormatV3::RecordType::End) {
+            ++m_records;
+        }
+        const uint64_t position{m_diff_reader.getPosition()};
+        if (((position - m_position) >= m_batch_size) ||
+            (header.type == FormatV3::RecordType::End)) {
+            Stats::add(Stats::Counter::Records, m_records);
+            Stats::add(Stats::Counter::DiffBytesRead, position - m_position);
+            m_position = position;
+            m_records = 0;
+        }
+    };
+
+  private:
+    const FormatV3::Reader &m_diff_reader;
+    const size_t m_batch_size;
+    uint64_t m_position;
+    uint64_t m_records;
+};
+
+// Writes all the data at the offset of the file
+void
+writeAll(int fd, const char *data, uint64_t offset, size_t size)
+{
+    while (size > 0) {
+        ssize_t w;
+        {
+            const Stats::IoTimer timer;
+            w = pwrite(fd, data, size, offset);
+        }
+        if ((w < 0) && (errno == EINTR)) {
+            continue;
+        } else if (w <= 0) {
+            throw RestoreError("cannot write to output file");
+        }
+        Stats::add(Stats::Counter::BytesWritten, w);
+        data += w;
+        offset += w;
+        size -= w;
     }
+}
 
-    for (;;) {
-        const uint64_t offset{diff_reader.readOffset()};
-        if (diff_reader.eof()) {
-            break;
+// Writes the restored data to the output file
+class OutputWriter
+{
+  public:
+    virtual ~OutputWriter() = default;
+
+    virtual void write(uint64_t offset, const char *data, size_t size) = 0;
+    // Writes out all the data passed before
+    virtual void flush() = 0;
+};
+
+// Writes through the stream of the I/O backend
+class StreamWriter : public OutputWriter
+{
+  public:
+    explicit StreamWriter(std::ostream &out_file)
+        : m_out_file(out_file), m_position(0)
+    {
+        if (!m_out_file.seekp(0, std::ios_base::beg)) {
+            throw RestoreError("cannot seek in output file");
         }
+    };
 
-        if (!out_file.seekp(offset, std::ios_base::beg)) {
+    void write(uint64_t offset, const char *data, size_t size) override
+    {
+        if ((offset != m_position) &&
+            !m_out_file.seekp(offset, std::ios_base::beg)) {
             throw RestoreError("cannot seek in output file");
         }
+        {
+            const Stats::IoTimer timer;
+            m_out_file.write(data, size);
+        }
+        if (!m_out_file) {
+            throw RestoreError("cannot write to output file");
+        }
+        Stats::add(Stats::Counter::BytesWritten, size);
+        m_position = offset + size;
+    };
 
-        uint64_t size{diff_reader.readSize()};
+    void flush() override
+    {
+        {
+            const Stats::IoTimer timer;
+            m_out_file.flush();
+        }
+        if (!m_out_file) {
+            throw RestoreError("cannot write to output file");
+        }
+    };
 
-        while (size > 0) {
-            const FormatV2::RecordData rd{diff_reader.readRecordData(size)};
-            if (rd.size == 0) {
+  private:
+    std::ostream &m_out_file;
+    uint64_t m_position;
+};
+
+// Maximum number of the writes in one batch. Each of them and the gap before
+// it take two entries of the vector written by pwritev.
+const size_t MaxBatchWrites{IOV_MAX / 2};
+
+// The writes with a gap between them not holding a whole page are written
+// together with the data of the file in the gap. The gap is in the pages
+// written anyway, so no more pages are written back, and no blocks are
+// allocated in the holes of the file.
+const uint64_t GapPageSize{4096};
+
+// Collects the data of the writes to batches of at most the buffer size, so
+// many small records are written by a few system calls. Each group of the
+// nearby writes of a batch is written by one pwritev, with the gaps between
+// them read back from the file by one pread. The data not flushed are lost on
+// destruction.
+class BatchWriter : public OutputWriter
+{
+  public:
+    BatchWriter(const std::filesystem::path &path, size_t buffer_size)
+        : m_fd(open(path.c_str(), O_RDWR | O_CLOEXEC)),
+          m_capacity(buffer_size), m_used(0)
+    {
+        if (m_fd < 0) {
+            throw RestoreError("cannot open output file");
+        }
+        try {
+            m_buffer = BufferedStream::allocateAlignedBuffer(m_capacity);
+            m_gap_buffer = BufferedStream::allocateAlignedBuffer(m_capacity);
+            m_iov.reserve(MaxBatchWrites);
+            m_offsets.reserve(MaxBatchWrites);
+            m_group_iov.reserve(2 * MaxBatchWrites);
+        } catch (const std::bad_alloc &e) {
+            close(m_fd);
+            throw RestoreError("cannot allocate buffer for output data");
+        }
+    };
+
+    BatchWriter(const BatchWriter &) = delete;
+    BatchWriter &operator=(const BatchWriter &) = delete;
+
+    ~BatchWriter() override { close(m_fd); };
+
+    void write(uint64_t offset, const char *data, size_t size) override
+    {
+        if (((m_capacity - m_used) < size) ||
+            (m_iov.size() == MaxBatchWrites)) {
+            flush();
+        }
+        if (size > m_capacity) {
+            writeAll(m_fd, data, offset, size);
+            return;
+        }
+
+        char *const dest{m_buffer.get() + m_used};
+        memcpy(dest, data, size);
+        m_iov.push_back(iovec{dest, size});
+        m_offsets.push_back(offset);
+        m_used += size;
+    };
+
+    void flush() override
+    {
+        size_t group_start{0};
+        for (size_t i = 1; i <= m_iov.size(); ++i) {
+            if ((i == m_iov.size()) || !isNearby(group_start, i)) {
+                writeGroup(group_start, i);
+                group_start = i;
+            }
+        }
+        m_iov.clear();
+        m_offsets.clear();
+        m_used = 0;
+    };
+
+  private:
+    const int m_fd;
+    const size_t m_capacity;
+    // The data of the writes one after another
+    BufferedStream::AlignedBuffer m_buffer;
+    size_t m_used;
+    // The data of the file in the range of a group of the writes
+    BufferedStream::AlignedBuffer m_gap_buffer;
+    // The data and the offsets of the writes in the order of the writes
+    std::vector<struct iovec> m_iov;
+    std::vector<uint64_t> m_offsets;
+    // The writes and the gaps of a group
+    std::vector<struct iovec> m_group_iov;
+
+    uint64_t getEnd(size_t write) const
+    {
+        return m_offsets[write] + m_iov[write].iov_len;
+    };
+
+    // Whether the write follows the previous one closely enough to be added
+    // to the group. The range of the group must fit in the gap buffer.
+    bool isNearby(size_t group_start, size_t write) const
+    {
+        const uint64_t previous_end{getEnd(write - 1)};
+        const uint64_t first_whole_page{
+            ((previous_end + GapPageSize - 1) / GapPageSize) * GapPageSize};
+        return (m_offsets[write] >= previous_end) &&
+               (m_offsets[write] < (first_whole_page + GapPageSize)) &&
+               ((getEnd(write) - m_offsets[group_start]) <= m_capacity);
+    };
+
+    void writeGroup(size_t first, size_t last)
+    {
+        const uint64_t start{m_offsets[first]};
+        const uint64_t end{getEnd(last - 1)};
+        uint64_t data_size{0};
+        for (size_t i = first; i < last; ++i) {
+            data_size += m_iov[i].iov_len;
+        }
+        if (data_size < (end - start)) {
+            readGaps(start, static_cast<size_t>(end - start));
+        }
+
+        m_group_iov.clear();
+        for (size_t i = first; i < last; ++i) {
+            if ((i > first) && (m_offsets[i] > getEnd(i - 1))) {
+                const uint64_t gap_start{getEnd(i - 1)};
+                m_group_iov.push_back(
+                    iovec{m_gap_buffer.get() + (gap_start - start),
+                          static_cast<size_t>(m_offsets[i] - gap_start)});
+            }
+            m_group_iov.push_back(m_iov[i]);
+        }
+        writeAllVector(m_group_iov.data(), m_group_iov.size(), start);
+    };
+
+    // The range beyond the end of the file reads as zeros, like it would be
+    // after the write following it
+    void readGaps(uint64_t offset, size_t size)
+    {
+        size_t filled{0};
+        while (filled < size) {
+            ssize_t r;
+            {
+                const Stats::IoTimer timer;
+                r = pread(m_fd, m_gap_buffer.get() + filled, size - filled,
+                          offset + filled);
+            }
+            if ((r < 0) && (errno == EINTR)) {
+                continue;
+            } else if (r < 0) {
+                throw RestoreError("cannot read output file");
+            } else if (r == 0) {
+                memset(m_gap_buffer.get() + filled, 0, size - filled);
                 break;
             }
+            filled += r;
+        }
+    };
 
-            if (!out_file.write(rd.data.get(), rd.size)) {
+    // The entries of the vector are changed by the partial writes
+    void writeAllVector(struct iovec *iov, size_t count, uint64_t offset)
+    {
+        while (count > 0) {
+            ssize_t w;
+            {
+                const Stats::IoTimer timer;
+                w = pwritev(m_fd, iov, static_cast<int>(count), offset);
+            }
+            if ((w < 0) && (errno == EINTR)) {
+                continue;
+            } else if (w <= 0) {
                 throw RestoreError("cannot write to output file");
             }
+            Stats::add(Stats::Counter::BytesWritten, w);
+            offset += w;
 
-            size -= rd.size;
+            size_t done{static_cast<size_t>(w)};
+            while ((count > 0) && (done >= iov->iov_len)) {
+                done -= iov->iov_len;
+                ++iov;
+                --count;
+            }
+            if (count > 0) {
+                iov->iov_base = static_cast<char *>(iov->iov_base) + done;
+                iov->iov_len -= done;
+            }
         }
+    };
+};
 
-        if (size > 0) {
-            throw RestoreError("cannot read all the data of the record");
+// Zero data is not written to the holes of the output file, so it stays
+// sparse. With the target comparator, only the ranges differing from the file
+// are written.
+void
+writeRecordData(OutputWriter &out, const Sparse::OutputFile &out_sparse,
+                TargetComparator *target, uint64_t pos, const char *data,
+                size_t size)
+{
+    if (target != nullptr) {
+        target->forEachDifferent(
+            pos, data, size,
+            [&out](uint64_t offset, const char *diff, size_t diff_size) {
+                out.write(offset, diff, diff_size);
+            });
+        return;
+    }
+
+    const bool is_zero{Scan::findFirstNonZero(data, size) == size};
+    if (!is_zero || !out_sparse.isHole(pos, pos + size)) {
+        out.write(pos, data, size);
+    }
+}
+
+void
+restoreDataRecord(FormatV3::Reader &diff_reader, OutputWriter &out,
+                  const Sparse::OutputFile &out_sparse,
+                  TargetComparator *target, uint64_t offset, uint64_t size)
+{
+    uint64_t pos{offset};
+    while (size > 0) {
+        const FormatV3::RecordData rd{diff_reader.readRecordData(size)};
+        if (rd.size == 0) {
+            break;
+        }
+
+        writeRecordData(out, out_sparse, target, pos, rd.data, rd.size);
+        pos += rd.size;
+        size -= rd.size;
+    }
+
+    if (size > 0) {
+        throw RestoreError("cannot read all the data of the record");
+    }
+}
+
+// The buffers are reused for the next records
+void
+restoreCompressedRecord(FormatV3::Reader &diff_reader, OutputWriter &out,
+                        const Sparse::OutputFile &out_sparse,
+                        TargetComparator *target,
+                        const FormatV3::RecordHeader &header,
+                        std::vector<char> &compressed,
+                        std::vector<char> &decompressed)
+{
+    try {
+        compressed.resize(header.compressed_size);
+        decompressed.resize(header.size);
+    } catch (const std::bad_alloc &e) {
+        throw RestoreError("cannot allocate buffer for record data");
+    }
+    readRecordData(diff_reader, compressed.data(), compressed.size());
+    Compression::decompress(static_cast<Compression::Codec>(header.codec),
+                            compressed.data(), compressed.size(),
+                            decompressed.data(), decompressed.size());
+
+    writeRecordData(out, out_sparse, target, header.offset,
+                    decompressed.data(), decompressed.size());
+}
+
+// The zeros are written only if the range cannot be zeroed out in the file
+// directly. With the target comparator, the range already holding zeros is
+// skipped.
+void
+restoreZeroRecord(OutputWriter &out, Sparse::OutputFile &out_sparse,
+                  TargetComparator *target, uint64_t offset, uint64_t size,
+                  size_t buffer_size)
+{
+    if ((target != nullptr) && (out_sparse.isHole(offset, offset + size) ||
+                                target->isZero(offset, size))) {
+        return;
+    }
+
+    // The data written before must not overwrite the zeroed range later
+    out.flush();
+    if (out_sparse.zeroRange(offset, offset + size)) {
+        return;
+    }
+
+    const size_t zeros_size{
+        static_cast<size_t>(std::min<uint64_t>(size, buffer_size))};
+    const auto zeros{std::make_unique<char[]>(zeros_size)};
+    while (size > 0) {
+        const size_t to_write{
+            static_cast<size_t>(std::min<uint64_t>(size, zeros_size))};
+        out.write(offset, zeros.get(), to_write);
+        offset += to_write;
+        size -= to_write;
+    }
+}
+
+// Number of buffers per writer thread. The record data are read to some of
+// them while the others are being written.
+const size_t WriterBufferCount{2};
+
+// Applies the records by a pool of threads writing to the output file with
+// pwrite. The records never overlap, so they can be written in any order. The
+// compressed records are decompressed by the threads too.
+class ParallelRestorer
+{
+  public:
+    // With direct I/O, the data of the records aligned to the granularity of
+    // the diff are written bypassing the page cache
+    ParallelRestorer(const Options::Restore &opts,
+                     Sparse::OutputFile &out_sparse, uint32_t granularity)
+        : m_opts(opts), m_out_sparse(out_sparse),
+          m_out_fd(open(opts.getOutFilePath().c_str(), O_WRONLY | O_CLOEXEC)),
+          m_direct_fd(-1), m_direct_block_size(1), m_done(false),
+          m_abort(false)
+    {
+        if (m_out_fd < 0) {
+            throw RestoreError("cannot open output file");
+        }
+
+        for (size_t i = 0; i < (WriterBufferCount * opts.getThreadCount());
+             ++i) {
+            try {
+                m_free_buffers.push_back(BufferedStream::allocateAlignedBuffer(
+                    opts.getBufferSize()));
+            } catch (const std::bad_alloc &e) {
+                close(m_out_fd);
+                throw RestoreError("cannot allocate buffer for output data");
+            }
+        }
+
+        if (opts.getIoBackend() == Options::IoBackend::Direct) {
+            openDirectOutput(granularity);
+        }
+    };
+
+    ParallelRestorer(const ParallelRestorer &) = delete;
+    ParallelRestorer &operator=(const ParallelRestorer &) = delete;
+
+    virtual ~ParallelRestorer()
+    {
+        close(m_out_fd);
+        if (m_direct_fd >= 0) {
+            close(m_direct_fd);
+        }
+    };
+
+    void run(FormatV3::Reader &diff_reader)
+    {
+        std::vector<std::thread> workers;
+        for (uint32_t i = 0; i < m_opts.getThreadCount(); ++i) {
+            workers.emplace_back(&ParallelRestorer::worker, this);
+        }
+
+        try {
+            readRecords(diff_reader);
+        } catch (...) {
+            setError(std::current_exception());
+        }
+
+        {
+            const std::lock_guard<std::mutex> lock{m_mutex};
+            m_done = true;
+        }
+        m_cond.notify_all();
+
+        for (auto &w : workers) {
+            w.join();
+        }
+
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+
+        // The writes of the threads are not ordered, so the restoration is
+        // complete only when all of them are on the disk. The direct writes
+        // are synchronized by the other descriptor of the file too. The
+        // special files may not support it.
+        int r;
+        {
+            const Stats::IoTimer timer;
+            r = fdatasync(m_out_fd);
+        }
+        if ((r != 0) && (errno != EINVAL)) {
+            throw RestoreError("cannot synchronize output file");
+        }
+    };
+
+  private:
+    struct Task {
+        FormatV3::RecordType type;
+        uint64_t offset;
+        uint64_t size;
+        // Only for the data and the compressed records. The buffers of the
+        // compressed records are not taken from the free ones.
+        BufferedStream::AlignedBuffer data;
+        size_t data_size;
+        uint8_t codec;
+    };
+
+    const Options::Restore &m_opts;
+    Sparse::OutputFile &m_out_sparse;
+    const int m_out_fd;
+    // Only for the aligned writes. Not opened if the diff is not aligned.
+    int m_direct_fd;
+    size_t m_direct_block_size;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<Task> m_tasks;
+    std::deque<BufferedStream::AlignedBuffer> m_free_buffers;
+    std::exception_ptr m_error;
+    bool m_done;
+    bool m_abort;
+
+    void setError(std::exception_ptr error)
+    {
+        const std::lock_guard<std::mutex> lock{m_mutex};
+        if (!m_error) {
+            m_error = error;
+        }
+        m_abort = true;
+        m_cond.notify_all();
+    };
+
+    void readRecords(FormatV3::Reader &diff_reader)
+    {
+        RecordCounter counter{diff_reader, m_opts.getBufferSize()};
+        for (;;) {
+            const FormatV3::RecordHeader header{
+                diff_reader.readRecordHeader()};
+            counter.count(header);
+            if (header.type == FormatV3::RecordType::End) {
+                return;
+            } else if (header.type == FormatV3::RecordType::Zero) {
+                if (!pushTask(Task{header.type, header.offset, header.size,
+                                   nullptr, 0, 0})) {
+                    return;
+                }
+            } else if (header.type == FormatV3::RecordType::Compressed) {
+                BufferedStream::AlignedBuffer buf;
+                try {
+                    buf = BufferedStream::allocateAlignedBuffer(
+                        header.compressed_size);
+                } catch (const std::bad_alloc &e) {
+                    throw RestoreError(
+                        "cannot allocate buffer for record data");
+                }
+                readRecordData(diff_reader, buf.get(), header.compressed_size);
+                if (!pushTask(Task{header.type, header.offset, header.size,
+                                   std::move(buf), header.compressed_size,
+                                   header.codec})) {
+                    return;
+                }
+            } else if (!readDataRecord(diff_reader, header.offset,
+                                       header.size)) {
+                return;
+            }
+        }
+    };
+
+    // The data are split to the buffers. Returns false if the restoration
+    // was aborted.
+    bool readDataRecord(FormatV3::Reader &diff_reader, uint64_t offset,
+                        uint64_t size)
+    {
+        while (size > 0) {
+            BufferedStream::AlignedBuffer buf{takeFreeBuffer()};
+            if (!buf) {
+                return false;
+            }
+
+            const size_t to_fill{static_cast<size_t>(
+                std::min<uint64_t>(size, m_opts.getBufferSize()))};
+            readRecordData(diff_reader, buf.get(), to_fill);
+
+            if (!pushTask(Task{FormatV3::RecordType::Data, offset, to_fill,
+                               std::move(buf), to_fill, 0})) {
+                return false;
+            }
+            offset += to_fill;
+            size -= to_fill;
+        }
+        return true;
+    };
+
+    BufferedStream::AlignedBuffer takeFreeBuffer()
+    {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_cond.wait(lock,
+                    [this] { return m_abort || !m_free_buffers.empty(); });
+        if (m_abort) {
+            return nullptr;
+        }
+        BufferedStream::AlignedBuffer buf{std::move(m_free_buffers.front())};
+        m_free_buffers.pop_front();
+        return buf;
+    };
+
+    bool pushTask(Task task)
+    {
+        {
+            // The zero records have no buffers limiting their count
+            std::unique_lock<std::mutex> lock{m_mutex};
+            m_cond.wait(lock, [this] {
+                return m_abort ||
+                       (m_tasks.size() <
+                        (WriterBufferCount * m_opts.getThreadCount()));
+            });
+            if (m_abort) {
+                return false;
+            }
+            m_tasks.push_back(std::move(task));
+        }
+        m_cond.notify_all();
+        return true;
+    };
+
+    void worker()
+    {
+        try {
+            std::unique_ptr<TargetComparator> target;
+            if (m_opts.getSkipIdentical()) {
+                target = std::make_unique<TargetComparator>(
+                    m_opts.getOutFilePath(), m_opts.getBufferSize());
+            }
+            std::vector<char> decompressed;
+            for (;;) {
+                Task task;
+                {
+                    std::unique_lock<std::mutex> lock{m_mutex};
+                    m_cond.wait(lock, [this] {
+                        return m_abort || m_done || !m_tasks.empty();
+                    });
+                    if (m_abort || m_tasks.empty()) {
+                        return;
+                    }
+                    task = std::move(m_tasks.front());
+                    m_tasks.pop_front();
+                }
+                m_cond.notify_all();
+
+                if (task.type == FormatV3::RecordType::Zero) {
+                    writeZeroRange(target.get(), task.offset, task.size);
+                } else if (task.type == FormatV3::RecordType::Compressed) {
+                    try {
+                        decompressed.resize(task.size);
+                    } catch (const std::bad_alloc &e) {
+                        throw RestoreError(
+                            "cannot allocate buffer for record data");
+                    }
+                    Compression::decompress(
+                        static_cast<Compression::Codec>(task.codec),
+                        task.data.get(), task.data_size, decompressed.data(),
+                        decompressed.size());
+                    writeData(target.get(), decompressed.data(), task.offset,
+                              task.size);
+                } else {
+                    writeData(target.get(), task.data.get(), task.offset,
+                              task.size);
+                    {
+                        const std::lock_guard<std::mutex> lock{m_mutex};
+                        m_free_buffers.push_back(std::move(task.data));
+                    }
+                    m_cond.notify_all();
+                }
+            }
+        } catch (...) {
+            setError(std::current_exception());
+        }
+    };
+
+    // Zero data is not written to the holes of the output file, so it stays
+    // sparse
+    void writeData(TargetComparator *target, const char *data, uint64_t offset,
+                   size_t size)
+    {
+        if (target != nullptr) {
+            target->forEachDifferent(
+                offset, data, size,
+                [this](uint64_t diff_offset, const char *diff,
+                       size_t diff_size) {
+                    writeAll(m_out_fd, diff, diff_offset, diff_size);
+                });
+            return;
+        }
+
+        const bool is_zero{Scan::findFirstNonZero(data, size) == size};
+        if (is_zero && m_out_sparse.isHole(offset, offset + size)) {
+            return;
+        }
+        writeAll(getOutputFd(data, offset, size), data, offset, size);
+    };
+
+    // The records must be aligned to the logical block size of the file. The
+    // granularity must be also a multiple of the memory page size, so the
+    // data written through the page cache, like at the end of the image,
+    // never share a page with the data written directly.
+    void openDirectOutput(uint32_t granularity)
+    {
+        const size_t page_size{static_cast<size_t>(sysconf(_SC_PAGESIZE))};
+        if ((granularity % page_size) != 0) {
+            return;
+        }
+
+        const int fd{open(m_opts.getOutFilePath().c_str(),
+                          O_WRONLY | O_CLOEXEC | O_DIRECT)};
+        if (fd < 0) {
+            // The file system does not support direct I/O
+            return;
+        }
+        const size_t block_size{Direct::getLogicalBlockSize(fd)};
+        if ((granularity % block_size) != 0) {
+            close(fd);
+            return;
+        }
+        m_direct_fd = fd;
+        m_direct_block_size = block_size;
+    };
+
+    // The direct I/O needs the data, the offset and the size aligned
+    int getOutputFd(const char *data, uint64_t offset, size_t size) const
+    {
+        const bool aligned{
+            ((reinterpret_cast<uintptr_t>(data) % m_direct_block_size) == 0) &&
+            ((offset % m_direct_block_size) == 0) &&
+            ((size % m_direct_block_size) == 0)};
+        return ((m_direct_fd >= 0) && aligned) ? m_direct_fd : m_out_fd;
+    };
+
+    void writeZeroRange(TargetComparator *target, uint64_t offset,
+                        uint64_t size)
+    {
+        if ((target != nullptr) &&
+            (m_out_sparse.isHole(offset, offset + size) ||
+             target->isZero(offset, size))) {
+            return;
+        }
+        if (m_out_sparse.zeroRange(offset, offset + size)) {
+            return;
         }
+
+        const size_t zeros_size{static_cast<size_t>(
+            std::min<uint64_t>(size, m_opts.getBufferSize()))};
+        const auto zeros{std::make_unique<char[]>(zeros_size)};
+        while (size > 0) {
+            const size_t to_write{
+                static_cast<size_t>(std::min<uint64_t>(size, zeros_size))};
+            writeAll(m_out_fd, zeros.get(), offset, to_write);
+            offset += to_write;
+            size -= to_write;
+        }
+    };
+};
+
+void
+restore(const Options::Restore &opts)
+{
+    const FileStream::Config stream_config{
+        opts.getIoBackend(), opts.getBufferSize(), opts.getQueueDepth()};
+
+    const std::unique_ptr<std::istream> diff_stream{
+        FileStream::openInput(opts.getDiffFilePath(), stream_config)};
+    if (!*diff_stream) {
+        throw RestoreError("cannot open diff file");
+    }
+
+    // The progress is measured in the read bytes of the diff file
+    Stats::Reporter reporter{
+        "restore",
+        opts.getStats(),
+        opts.getProgress(),
+        opts.getStatsJsonPath(),
+        Stats::Counter::DiffBytesRead,
+        static_cast<uint64_t>(
+            std::max<int64_t>(FileStream::getStreamSize(*diff_stream), 0))};
+
+    FormatV3::Reader diff_reader(*diff_stream, opts.getBufferSize(),
+                                 opts.getReadAheadCount());
+
+    if (opts.getThreadCount() > 1) {
+        // The I/O backend is used for reading the diff file. Only the direct
+        // I/O is used for writing too, for the aligned data.
+        Sparse::OutputFile out_sparse{opts.getOutFilePath()};
+        ParallelRestorer restorer{opts, out_sparse,
+                                  diff_reader.getGranularity()};
+        restorer.run(diff_reader);
+        reporter.finish();
+        return;
     }
+
+    std::unique_ptr<std::ostream> out_file;
+    std::unique_ptr<OutputWriter> out;
+    if (opts.getIoBackend() == Options::IoBackend::Stream) {
+        out = std::make_unique<BatchWriter>(opts.getOutFilePath(),
+                                            opts.getBufferSize());
+    } else {
+        out_file =
+            FileStream::openOutput(opts.getOutFilePath(), false, stream_config);
+        if (!*out_file) {
+            throw RestoreError("cannot open output file");
+        }
+        out = std::make_unique<StreamWriter>(*out_file);
+    }
+
+    Sparse::OutputFile out_sparse{opts.getOutFilePath()};
+
+    std::unique_ptr<TargetComparator> target;
+    if (opts.getSkipIdentical()) {
+        target = std::make_unique<TargetComparator>(opts.getOutFilePath(),
+                                                    opts.getBufferSize());
+    }
+
+    std::vector<char> compressed;
+    std::vector<char> decompressed;
+    RecordCounter counter{diff_reader, opts.getBufferSize()};
+    for (;;) {
+        const FormatV3::RecordHeader header{diff_reader.readRecordHeader()};
+        counter.count(header);
+        if (header.type == FormatV3::RecordType::End) {
+            break;
+        } else if (header.type == FormatV3::RecordType::Zero) {
+            restoreZeroRecord(*out, out_sparse, target.get(),
+                              header.offset, header.size, opts.getBufferSize());
+        } else if (header.type == FormatV3::RecordType::Compressed) {
+            restoreCompressedRecord(diff_reader, *out, out_sparse,
+                                    target.get(), header, compressed,
+                                    decompressed);
+        } else {
+            restoreDataRecord(diff_reader, *out, out_sparse, target.get(),
+                              header.offset, header.size);
+        }
+    }
+
+    out->flush();
+    reporter.finish();
 }
@@ -0,0 +1,316 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "scan.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace Scan
+{
+
+namespace
+{
+
+using Kernel = size_t (*)(const char *a, const char *b, size_t size);
+
+struct Kernels {
+    Kernel first_different;
+    Kernel first_same;
+};
+
+const uint64_t LowSevenBits{0x7F7F7F7F7F7F7F7FULL};
+
+uint64_t
+loadWord(const char *data)
+{
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+// Index of the lowest-addressed byte marked by a non-zero bit in the word
+size_t
+firstMarkedByte(uint64_t marks)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_ctzll(marks) / 8;
+#else
+    return __builtin_clzll(marks) / 8;
+#endif
+}
+
+// Sets the highest bit of every zero byte of the word, clears all other bits
+uint64_t
+zeroBytes(uint64_t word)
+{
+    return ~(((word & LowSevenBits) + LowSevenBits) | word | LowSevenBits);
+}
+
+size_t
+bytesFirstDifferent(const char *a, const char *b, size_t size)
+{
+    size_t i{0};
+    for (; i < size; ++i) {
+        if (a[i] != b[i]) {
+            break;
+        }
+    }
+    return i;
+}
+
+size_t
+bytesFirstSame(const char *a, const char *b, size_t size)
+{
+    size_t i{0};
+    for (; i < size; ++i) {
+        if (a[i] == b[i]) {
+            break;
+        }
+    }
+    return i;
+}
+
+size_t
+wordFirstDifferent(const char *a, const char *b, size_t size)
+{
+    size_t i{0};
+    for (; (i + sizeof(uint64_t)) <= size; i += sizeof(uint64_t)) {
+        const uint64_t diff{loadWord(a + i) ^ loadWord(b + i)};
+        if (diff != 0) {
+            return i + firstMarkedByte(diff);
+        }
+    }
+    return i + bytesFirstDifferent(a + i, b + i, size - i);
+}
+
+size_t
+wordFirstSame(const char *a, const char *b, size_t size)
+{
+    size_t i{0};
+    for (; (i + sizeof(uint64_t)) <= size; i += sizeof(uint64_t)) {
+        const uint64_t same{zeroBytes(loadWord(a + i) ^ loadWord(b + i))};
+        if (same != 0) {
+            return i + firstMarkedByte(same);
+        }
+    }
+    return i + bytesFirstSame(a + i, b + i, size - i);
+}
+
+#if defined(__x86_64__)
+
+// SSE2 is a part of the x86-64 baseline, no runtime check is needed for it
+
+__m128i
+load128(const char *data)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+}
+
+__attribute__((target("avx2"))) __m256i
+load256(const char *data)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+}
+
+size_t
+sse2FirstDifferent(const char *a, const char *b, size_t size)
+{
+    const size_t vsize{sizeof(__m128i)};
+    size_t i{0};
+    for (; (i + vsize) <= size; i += vsize) {
+        const __m128i eq{_mm_cmpeq_epi8(load128(a + i), load128(b + i))};
+        const uint32_t diff{~static_cast<uint32_t>(_mm_movemask_epi8(eq)) &
+                            0xFFFFU};
+        if (diff != 0) {
+            return i + __builtin_ctz(diff);
+        }
+    }
+    return i + wordFirstDifferent(a + i, b + i, size - i);
+}
+
+size_t
+sse2FirstSame(const char *a, const char *b, size_t size)
+{
+    const size_t vsize{sizeof(__m128i)};
+    size_t i{0};
+    for (; (i + vsize) <= size; i += vsize) {
+        const __m128i eq{_mm_cmpeq_epi8(load128(a + i), load128(b + i))};
+        const uint32_t same{static_cast<uint32_t>(_mm_movemask_epi8(eq))};
+        if (same != 0) {
+            return i + __builtin_ctz(same);
+        }
+    }
+    return i + wordFirstSame(a + i, b + i, size - i);
+}
+
+__attribute__((target("avx2"))) size_t
+avx2FirstDifferent(const char *a, const char *b, size_t size)
+{
+    const size_t vsize{sizeof(__m256i)};
+    size_t i{0};
+    // Mostly equal data is the common case. Compare two vectors per iteration
+    // and locate the exact byte only when a difference is found.
+    for (; (i + 2 * vsize) <= size; i += 2 * vsize) {
+        const __m256i eq0{_mm256_cmpeq_epi8(load256(a + i), load256(b + i))};
+        const __m256i eq1{
+            _mm256_cmpeq_epi8(load256(a + i + vsize), load256(b + i + vsize))};
+        if (_mm256_movemask_epi8(_mm256_and_si256(eq0, eq1)) != -1) {
+            const uint32_t diff0{
+                ~static_cast<uint32_t>(_mm256_movemask_epi8(eq0))};
+            if (diff0 != 0) {
+                return i + __builtin_ctz(diff0);
+            }
+            const uint32_t diff1{
+                ~static_cast<uint32_t>(_mm256_movemask_epi8(eq1))};
+            return i + vsize + __builtin_ctz(diff1);
+        }
+    }
+    return i + sse2FirstDifferent(a + i, b + i, size - i);
+}
+
+__attribute__((target("avx2"))) size_t
+avx2FirstSame(const char *a, const char *b, size_t size)
+{
+    const size_t vsize{sizeof(__m256i)};
+    size_t i{0};
+    for (; (i + vsize) <= size; i += vsize) {
+        const __m256i eq{_mm256_cmpeq_epi8(load256(a + i), load256(b + i))};
+        const uint32_t same{static_cast<uint32_t>(_mm256_movemask_epi8(eq))};
+        if (same != 0) {
+            return i + __builtin_ctz(same);
+        }
+    }
+    return i + sse2FirstSame(a + i, b + i, size - i);
+}
+
+__attribute__((target("avx512bw"))) size_t
+avx512FirstDifferent(const char *a, const char *b, size_t size)
+{
+    const size_t vsize{sizeof(__m512i)};
+    size_t i{0};
+    for (; (i + vsize) <= size; i += vsize) {
+        const uint64_t diff{_mm512_cmpneq_epi8_mask(_mm512_loadu_si512(a + i),
+                                                    _mm512_loadu_si512(b + i))};
+        if (diff != 0) {
+            return i + __builtin_ctzll(diff);
+        }
+    }
+    return i + avx2FirstDifferent(a + i, b + i, size - i);
+}
+
+__attribute__((target("avx512bw"))) size_t
+avx512FirstSame(const char *a, const char *b, size_t size)
+{
+    const size_t vsize{sizeof(__m512i)};
+    size_t i{0};
+    for (; (i + vsize) <= size; i += vsize) {
+        const uint64_t same{_mm512_cmpeq_epi8_mask(_mm512_loadu_si512(a + i),
+                                                   _mm512_loadu_si512(b + i))};
+        if (same != 0) {
+            return i + __builtin_ctzll(same);
+        }
+    }
+    return i + avx2FirstSame(a + i, b + i, size - i);
+}
+
+#endif
+
+Kernels
+selectKernels()
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        return Kernels{avx512FirstDifferent, avx512FirstSame};
+    } else if (__builtin_cpu_supports("avx2")) {
+        return Kernels{avx2FirstDifferent, avx2FirstSame};
+    } else {
+        return Kernels{sse2FirstDifferent, sse2FirstSame};
+    }
+#else
+    return Kernels{wordFirstDifferent, wordFirstSame};
+#endif
+}
+
+const Kernels kernels{selectKernels()};
+
+// The data is compared with this block of zeros piece by piece
+const size_t ZeroBlockSize{4096};
+const char zero_block[ZeroBlockSize]{};
+
+} // namespace
+
+size_t
+findFirstDifferent(const char *a, const char *b, size_t size)
+{
+    return kernels.first_different(a, b, size);
+}
+
+size_t
+findFirstSame(const char *a, const char *b, size_t size)
+{
+    return kernels.first_same(a, b, size);
+}
+
+size_t
+findFirstSameBlock(const char *a, const char *b, size_t size,
+                   size_t block_size)
+{
+    size_t offset{0};
+    while (offset < size) {
+        const size_t block{std::min(block_size, size - offset)};
+        // The comparison of a different block stops at its first difference
+        if (kernels.first_different(a + offset, b + offset, block) == block) {
+            break;
+        }
+        offset += block;
+    }
+    return offset;
+}
+
+size_t
+findFirstNonZero(const char *data, size_t size)
+{
+    size_t offset{0};
+    while (offset < size) {
+        const size_t piece{std::min(ZeroBlockSize, size - offset)};
+        const size_t same{
+            kernels.first_different(data + offset, zero_block, piece)};
+        offset += same;
+        if (same < piece) {
+            break;
+        }
+    }
+    return offset;
+}
+
+} // namespace Scan
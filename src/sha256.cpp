@@ -0,0 +1,241 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sha256.h"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace Sha256
+{
+
+namespace
+{
+
+const size_t BlockSize{64};
+
+using Compress = void (*)(uint32_t *state, const uint8_t *data,
+                          size_t block_count);
+
+const uint32_t InitialState[8]{0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                               0xa54ff53a, 0x510e527f, 0x9b05688c,
+                               0x1f83d9ab, 0x5be0cd19};
+
+const uint32_t RoundConstants[64]{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+uint32_t
+rotateRight(uint32_t x, unsigned n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+uint32_t
+loadBigEndian(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) |
+           (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+void
+portableCompress(uint32_t *state, const uint8_t *data, size_t block_count)
+{
+    for (; block_count > 0; --block_count, data += BlockSize) {
+        uint32_t w[64];
+        for (size_t i = 0; i < 16; ++i) {
+            w[i] = loadBigEndian(data + (4 * i));
+        }
+        for (size_t i = 16; i < 64; ++i) {
+            const uint32_t s0{rotateRight(w[i - 15], 7) ^
+                              rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3)};
+            const uint32_t s1{rotateRight(w[i - 2], 17) ^
+                              rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10)};
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a{state[0]}, b{state[1]}, c{state[2]}, d{state[3]};
+        uint32_t e{state[4]}, f{state[5]}, g{state[6]}, h{state[7]};
+        for (size_t i = 0; i < 64; ++i) {
+            const uint32_t s1{rotateRight(e, 6) ^ rotateRight(e, 11) ^
+                              rotateRight(e, 25)};
+            const uint32_t ch{(e & f) ^ (~e & g)};
+            const uint32_t t1{h + s1 + ch + RoundConstants[i] + w[i]};
+            const uint32_t s0{rotateRight(a, 2) ^ rotateRight(a, 13) ^
+                              rotateRight(a, 22)};
+            const uint32_t maj{(a & b) ^ (a & c) ^ (b & c)};
+            const uint32_t t2{s0 + maj};
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#if defined(__x86_64__)
+
+// Intel SHA extensions. The state is kept in two registers as ABEF and CDGH,
+// the order expected by the round instructions.
+__attribute__((target("sha,sse4.1"))) void
+shaniCompress(uint32_t *state, const uint8_t *data, size_t block_count)
+{
+    const __m128i byte_swap{
+        _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL)};
+
+    const __m128i dcba{
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(state))};
+    const __m128i hgfe{
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4))};
+    const __m128i cdab{_mm_shuffle_epi32(dcba, 0xB1)};
+    const __m128i efgh{_mm_shuffle_epi32(hgfe, 0x1B)};
+    __m128i abef{_mm_alignr_epi8(cdab, efgh, 8)};
+    __m128i cdgh{_mm_blend_epi16(efgh, cdab, 0xF0)};
+
+    for (; block_count > 0; --block_count, data += BlockSize) {
+        const __m128i abef_saved{abef};
+        const __m128i cdgh_saved{cdgh};
+
+        // Message schedule of the last four groups of four rounds
+        __m128i w[4];
+        for (size_t i = 0; i < 4; ++i) {
+            w[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(data + (16 * i))),
+                byte_swap);
+        }
+
+        for (size_t g = 0; g < 16; ++g) {
+            __m128i wk{_mm_add_epi32(
+                w[g % 4], _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                              RoundConstants + (4 * g))))};
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+            wk = _mm_shuffle_epi32(wk, 0x0E);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, wk);
+
+            if (g < 12) {
+                // Schedule of the group four groups ahead
+                __m128i next{_mm_sha256msg1_epu32(w[g % 4], w[(g + 1) % 4])};
+                next = _mm_add_epi32(
+                    next, _mm_alignr_epi8(w[(g + 3) % 4], w[(g + 2) % 4], 4));
+                w[g % 4] = _mm_sha256msg2_epu32(next, w[(g + 3) % 4]);
+            }
+        }
+
+        abef = _mm_add_epi32(abef, abef_saved);
+        cdgh = _mm_add_epi32(cdgh, cdgh_saved);
+    }
+
+    const __m128i feba{_mm_shuffle_epi32(abef, 0x1B)};
+    const __m128i dchg{_mm_shuffle_epi32(cdgh, 0xB1)};
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state),
+                     _mm_blend_epi16(feba, dchg, 0xF0));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4),
+                     _mm_alignr_epi8(dchg, feba, 8));
+}
+
+#endif
+
+Compress
+selectCompress()
+{
+#if defined(__x86_64__)
+    // The SHA extensions are reported in the extended features leaf
+    unsigned eax, ebx, ecx, edx;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+        ((ebx & bit_SHA) != 0) && __builtin_cpu_supports("sse4.1")) {
+        return shaniCompress;
+    }
+#endif
+    return portableCompress;
+}
+
+const Compress compress{selectCompress()};
+
+} // namespace
+
+Digest
+compute(const char *data, size_t size)
+{
+    uint32_t state[8];
+    memcpy(state, InitialState, sizeof(state));
+
+    const uint8_t *const bytes{reinterpret_cast<const uint8_t *>(data)};
+    const size_t full_blocks{size / BlockSize};
+    compress(state, bytes, full_blocks);
+
+    // The padding is a one bit, zeros, and the size in bits. It takes one or
+    // two blocks with the rest of the data.
+    uint8_t tail[2 * BlockSize]{};
+    const size_t rest{size % BlockSize};
+    memcpy(tail, bytes + (full_blocks * BlockSize), rest);
+    tail[rest] = 0x80;
+    const size_t tail_size{(rest < (BlockSize - 8)) ? BlockSize
+                                                    : (2 * BlockSize)};
+    const uint64_t size_bits{static_cast<uint64_t>(size) * 8};
+    for (size_t i = 0; i < 8; ++i) {
+        tail[tail_size - 1 - i] = static_cast<uint8_t>(size_bits >> (8 * i));
+    }
+    compress(state, tail, tail_size / BlockSize);
+
+    Digest digest;
+    for (size_t i = 0; i < 8; ++i) {
+        for (size_t j = 0; j < 4; ++j) {
+            digest[(4 * i) + j] =
+                static_cast<uint8_t>(state[i] >> (24 - (8 * j)));
+        }
+    }
+    return digest;
+}
+
+} // namespace Sha256
@@ -0,0 +1,85 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "signature.h"
+#include "buffered_stream.h"
+#include "file_stream.h"
+#include "sha256.h"
+#include "signature_format.h"
+
+#include <algorithm>
+#include <memory>
+
+void
+signature(const Options::Signature &opts)
+{
+    const FileStream::Config stream_config{Options::IoBackend::Stream,
+                                           opts.getBufferSize(),
+                                           Options::DEFAULT_QUEUE_DEPTH};
+
+    const std::unique_ptr<std::istream> in_istream{
+        FileStream::openInput(opts.getInFilePath(), stream_config)};
+    if (!*in_istream) {
+        throw SignatureError("cannot open input file");
+    }
+
+    // The image size is needed for the header
+    const int64_t image_size{FileStream::getStreamSize(*in_istream)};
+    if (image_size < 0) {
+        throw SignatureError("cannot get size of the input file");
+    }
+
+    const std::unique_ptr<std::ostream> out_ostream{FileStream::openOutput(
+        opts.getOutFilePath(), true, stream_config)};
+    if (!*out_ostream) {
+        throw SignatureError("cannot open output file");
+    }
+
+    SignatureFormat::Writer sig_writer(
+        *out_ostream, opts.getBufferSize(),
+        SignatureFormat::Header{opts.getBlockSize(),
+                                static_cast<uint64_t>(image_size)});
+
+    BufferedStream::Reader in_reader(*in_istream, opts.getBufferSize(), 1);
+    const auto block{std::make_unique<char[]>(opts.getBlockSize())};
+
+    for (uint64_t left = image_size; left > 0;) {
+        const size_t to_read{static_cast<size_t>(
+            std::min<uint64_t>(opts.getBlockSize(), left))};
+        if (in_reader.read(to_read, block.get()) != to_read) {
+            throw SignatureError("cannot read input file");
+        }
+
+        sig_writer.writeDigest(Sha256::compute(block.get(), to_read));
+        left -= to_read;
+    }
+
+    try {
+        sig_writer.finish();
+    } catch (const BufferedStream::Error &e) {
+        throw SignatureError("cannot write to output file");
+    }
+}
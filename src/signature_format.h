@@ -0,0 +1,153 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "buffered_stream.h"
+#include "sha256.h"
+
+#include <endian.h>
+
+namespace SignatureFormat
+{
+
+const std::string FileSignature{"diff-dd signature"};
+const uint8_t FileVersion{1};
+const size_t HeaderSize{FileSignature.size() + sizeof(uint8_t) +
+                        sizeof(uint32_t) + sizeof(uint64_t)};
+
+// The header is followed by the digests of all the blocks of the image. The
+// last block can be shorter.
+struct Header {
+    uint32_t block_size;
+    uint64_t image_size;
+};
+
+class Error : public DiffddError
+{
+  public:
+    explicit Error(const std::string &message) : DiffddError(message) {}
+};
+
+// Reads the header from the current position of the stream
+inline Header
+readHeader(std::istream &istream)
+{
+    char raw[HeaderSize];
+    if (!istream.read(raw, sizeof(raw))) {
+        throw Error("cannot read signature file header");
+    }
+
+    const std::string signature{raw, FileSignature.size()};
+    if (signature != FileSignature) {
+        throw Error("wrong signature file header signature");
+    }
+    const char *p{raw + FileSignature.size()};
+
+    const uint8_t version{static_cast<uint8_t>(*p)};
+    if (version != FileVersion) {
+        throw Error("wrong signature file header version");
+    }
+    p += sizeof(version);
+
+    uint32_t block_size;
+    memcpy(&block_size, p, sizeof(block_size));
+    p += sizeof(block_size);
+    uint64_t image_size;
+    memcpy(&image_size, p, sizeof(image_size));
+
+    const Header header{be32toh(block_size), be64toh(image_size)};
+    if (header.block_size == 0) {
+        throw Error("wrong signature file block size");
+    }
+    return header;
+}
+
+class Writer
+{
+  public:
+    Writer(std::ostream &ostream, size_t buffer_size, const Header &header)
+        : m_writer{BufferedStream::Writer{ostream, buffer_size}}
+    {
+        writeHeader(header);
+    };
+
+    void writeDigest(const Sha256::Digest &digest)
+    {
+        m_writer.write(reinterpret_cast<const char *>(digest.data()),
+                       digest.size());
+    };
+
+    // Writes out the buffered digests. Must be called after the last digest,
+    // as the write errors are not reported on destruction.
+    void finish() { m_writer.flush(); };
+
+  private:
+    BufferedStream::Writer m_writer;
+
+    void writeHeader(const Header &header)
+    {
+        m_writer.write(FileSignature.data(), FileSignature.size());
+
+        const uint8_t version{FileVersion};
+        m_writer.write(reinterpret_cast<const char *>(&version),
+                       sizeof(version));
+
+        const uint32_t block_size{htobe32(header.block_size)};
+        m_writer.write(reinterpret_cast<const char *>(&block_size),
+                       sizeof(block_size));
+
+        const uint64_t image_size{htobe64(header.image_size)};
+        m_writer.write(reinterpret_cast<const char *>(&image_size),
+                       sizeof(image_size));
+    };
+};
+
+// Reads the digests from the current position of the stream
+class Reader
+{
+  public:
+    Reader(std::istream &istream, size_t buffer_size)
+        : m_reader{istream, buffer_size, 1}
+    {
+    }
+
+    Sha256::Digest readDigest()
+    {
+        Sha256::Digest digest;
+        const size_t r{m_reader.read(
+            digest.size(), reinterpret_cast<char *>(digest.data()))};
+        if (r != digest.size()) {
+            throw Error("cannot read block digest from signature file");
+        }
+        return digest;
+    };
+
+  private:
+    BufferedStream::Reader m_reader;
+};
+
+} // namespace SignatureFormat
@@ -0,0 +1,187 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sparse.h"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Sparse
+{
+
+namespace
+{
+
+const uint64_t SectorSize{512};
+
+} // namespace
+
+bool
+isRegularFile(const std::filesystem::path &path)
+{
+    struct stat st;
+    return (stat(path.c_str(), &st) == 0) && S_ISREG(st.st_mode);
+}
+
+std::vector<Extent>
+findDataExtents(const std::filesystem::path &path, uint64_t start,
+                uint64_t end)
+{
+    const std::vector<Extent> whole_range{Extent{start, end}};
+
+    const int fd{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (fd < 0) {
+        return whole_range;
+    }
+
+    std::vector<Extent> extents;
+    uint64_t offset{start};
+    while (offset < end) {
+        const off_t data{lseek(fd, offset, SEEK_DATA)};
+        if (data < 0) {
+            if (errno == ENXIO) {
+                // Only a hole up to the end of the file
+                break;
+            }
+            // Not supported by the file system
+            close(fd);
+            return whole_range;
+        }
+        if (static_cast<uint64_t>(data) >= end) {
+            break;
+        }
+
+        // There is always a virtual hole at the end of the file
+        const off_t hole{lseek(fd, data, SEEK_HOLE)};
+        if (hole < 0) {
+            close(fd);
+            return whole_range;
+        }
+
+        const uint64_t extent_end{std::min(static_cast<uint64_t>(hole), end)};
+        extents.push_back(Extent{static_cast<uint64_t>(data), extent_end});
+        offset = extent_end;
+    }
+
+    close(fd);
+    return extents;
+}
+
+OutputFile::OutputFile(const std::filesystem::path &path)
+    : m_fd(open(path.c_str(), O_RDWR | O_CLOEXEC))
+{
+}
+
+OutputFile::~OutputFile()
+{
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool
+OutputFile::isHole(uint64_t start, uint64_t end) const
+{
+    struct stat st;
+    if ((m_fd < 0) || (fstat(m_fd, &st) != 0) || !S_ISREG(st.st_mode) ||
+        (end > static_cast<uint64_t>(st.st_size))) {
+        return false;
+    }
+
+    const off_t data{lseek(m_fd, start, SEEK_DATA)};
+    if (data < 0) {
+        return errno == ENXIO;
+    }
+    return static_cast<uint64_t>(data) >= end;
+}
+
+bool
+OutputFile::writeZeros(uint64_t start, uint64_t end)
+{
+    const char zeros[SectorSize]{};
+    while (start < end) {
+        const ssize_t w{pwrite(m_fd, zeros,
+                               std::min<uint64_t>(end - start, SectorSize),
+                               start)};
+        if (w <= 0) {
+            return false;
+        }
+        start += w;
+    }
+    return true;
+}
+
+bool
+OutputFile::zeroRange(uint64_t start, uint64_t end)
+{
+    struct stat st;
+    if ((m_fd < 0) || (fstat(m_fd, &st) != 0)) {
+        return false;
+    }
+
+    if (S_ISREG(st.st_mode)) {
+        if (fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, start,
+                      end - start) != 0) {
+            return false;
+        }
+        // The hole punched beyond the end does not extend the file.
+        // Allocating its last byte extends it. Unlike truncating, it never
+        // shrinks the file extended by a concurrent write.
+        if ((end > static_cast<uint64_t>(st.st_size)) &&
+            (fallocate(m_fd, 0, end - 1, 1) != 0)) {
+            return false;
+        }
+        return true;
+    } else if (S_ISBLK(st.st_mode)) {
+        // Only whole sectors can be zeroed out. The partial sectors at the
+        // ends are written. Discarding is not used as it does not guarantee
+        // zeros.
+        const uint64_t first_sector{
+            std::min(end, start + ((SectorSize - (start % SectorSize)) %
+                                   SectorSize))};
+        const uint64_t last_sector{
+            std::max(first_sector, end - (end % SectorSize))};
+        if (!writeZeros(start, first_sector) ||
+            !writeZeros(last_sector, end)) {
+            return false;
+        }
+        if (first_sector == last_sector) {
+            return true;
+        }
+        uint64_t range[2]{first_sector, last_sector - first_sector};
+        return ioctl(m_fd, BLKZEROOUT, range) == 0;
+    }
+
+    return false;
+}
+
+} // namespace Sparse
@@ -0,0 +1,76 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace Sparse
+{
+
+struct Extent {
+    uint64_t start;
+    uint64_t end;
+};
+
+// Returns true for regular files. Holes can be detected only in them.
+bool isRegularFile(const std::filesystem::path &path);
+
+// Returns the extents of the data in the range of the file, in ascending
+// order. The rest of the range is holes. When the holes cannot be detected,
+// the whole range is returned as data.
+std::vector<Extent> findDataExtents(const std::filesystem::path &path,
+                                    uint64_t start, uint64_t end);
+
+// Detects and makes holes in a file written by a stream. The data written to
+// the range by the stream must be flushed before.
+class OutputFile
+{
+  public:
+    explicit OutputFile(const std::filesystem::path &path);
+    OutputFile(const OutputFile &) = delete;
+    OutputFile &operator=(const OutputFile &) = delete;
+    virtual ~OutputFile();
+
+    // Returns true if the range of the file is a hole. The range beyond the
+    // end of the file is not.
+    bool isHole(uint64_t start, uint64_t end) const;
+
+    // Sets the range of the file to zeros by punching a hole in a regular
+    // file, or by zeroing out the range on a block device. A regular file is
+    // extended if needed. Returns false if the range has to be written with
+    // zeros instead. Safe to call concurrently for non-overlapping ranges.
+    bool zeroRange(uint64_t start, uint64_t end);
+
+  private:
+    int m_fd;
+
+    bool writeZeros(uint64_t start, uint64_t end);
+};
+
+} // namespace Sparse
@@ -0,0 +1,241 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stats.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace Stats
+{
+
+namespace
+{
+
+// Indexed by the counters
+std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::Count)>
+    counters{};
+
+// The I/O of the threads overlapping in time is counted once in the I/O wall
+// time. It starts when the first thread enters the I/O, and ends when the last
+// one leaves it. The start is subtracted from the wall time and the end is
+// added to it, so no lock is needed. The sum is right once all the threads
+// left the I/O.
+std::atomic<unsigned> io_threads{0};
+
+const std::chrono::seconds ProgressInterval{1};
+
+// The names of the counters in the summary
+const std::vector<std::pair<Counter, const char *>> CounterNames{
+    {Counter::InputBytesRead, "input_bytes_read"},
+    {Counter::BaseBytesRead, "base_bytes_read"},
+    {Counter::DiffBytesRead, "diff_bytes_read"},
+    {Counter::BytesCompared, "bytes_compared"},
+    {Counter::Records, "records"},
+    {Counter::Merges, "merges"},
+    {Counter::BytesWritten, "bytes_written"},
+};
+
+double
+toSeconds(uint64_t nanoseconds)
+{
+    return nanoseconds / 1e9;
+}
+
+double
+toMib(uint64_t bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+uint64_t
+toNanoseconds(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::nanoseconds{t.time_since_epoch()}.count();
+}
+
+} // namespace
+
+void
+addEnabled(Counter counter, uint64_t value)
+{
+    counters[static_cast<size_t>(counter)].fetch_add(
+        value, std::memory_order_relaxed);
+}
+
+uint64_t
+get(Counter counter)
+{
+    return counters[static_cast<size_t>(counter)].load(
+        std::memory_order_relaxed);
+}
+
+void
+IoTimer::start()
+{
+    m_start = std::chrono::steady_clock::now();
+    if (io_threads.fetch_add(1, std::memory_order_relaxed) == 0) {
+        counters[static_cast<size_t>(Counter::IoWallNanoseconds)].fetch_sub(
+            toNanoseconds(m_start), std::memory_order_relaxed);
+    }
+}
+
+void
+IoTimer::stop()
+{
+    const std::chrono::steady_clock::time_point end{
+        std::chrono::steady_clock::now()};
+    addEnabled(Counter::IoThreadNanoseconds,
+               toNanoseconds(end) - toNanoseconds(m_start));
+    if (io_threads.fetch_sub(1, std::memory_order_relaxed) == 1) {
+        addEnabled(Counter::IoWallNanoseconds, toNanoseconds(end));
+    }
+}
+
+Reporter::Reporter(const std::string &operation, bool print_summary,
+                   bool print_progress, const std::filesystem::path &json_path,
+                   Counter progress_counter, uint64_t progress_total)
+    : m_operation{operation}, m_print_summary{print_summary},
+      m_json_path{json_path}, m_progress_counter{progress_counter},
+      m_progress_total{progress_total},
+      m_start{std::chrono::steady_clock::now()}, m_stop{false}
+{
+    if (print_summary || print_progress || !json_path.empty()) {
+        enabled.store(true, std::memory_order_relaxed);
+    }
+    if (print_progress) {
+        m_progress_thread = std::thread{&Reporter::printProgress, this};
+    }
+}
+
+Reporter::~Reporter() { stopProgress(); }
+
+void
+Reporter::finish()
+{
+    stopProgress();
+
+    const std::chrono::nanoseconds wall{std::chrono::steady_clock::now() -
+                                        m_start};
+    const double wall_seconds{toSeconds(wall.count())};
+    const double io_seconds{
+        std::min(toSeconds(get(Counter::IoWallNanoseconds)), wall_seconds)};
+    // The time during which no thread waited for the I/O
+    const double compute_seconds{wall_seconds - io_seconds};
+    const double io_thread_seconds{
+        toSeconds(get(Counter::IoThreadNanoseconds))};
+
+    if (m_print_summary) {
+        std::cerr << "operation: " << m_operation << std::endl;
+        std::cerr << "wall_seconds: " << wall_seconds << std::endl;
+        std::cerr << "io_seconds: " << io_seconds << std::endl;
+        std::cerr << "compute_seconds: " << compute_seconds << std::endl;
+        std::cerr << "io_thread_seconds: " << io_thread_seconds << std::endl;
+        for (const auto &[counter, name] : CounterNames) {
+            std::cerr << name << ": " << get(counter) << std::endl;
+        }
+    }
+
+    if (!m_json_path.empty()) {
+        std::ofstream json{m_json_path};
+        json << "{\"operation\": \"" << m_operation << "\"";
+        json << ", \"wall_seconds\": " << wall_seconds;
+        json << ", \"io_seconds\": " << io_seconds;
+        json << ", \"compute_seconds\": " << compute_seconds;
+        json << ", \"io_thread_seconds\": " << io_thread_seconds;
+        for (const auto &[counter, name] : CounterNames) {
+            json << ", \"" << name << "\": " << get(counter);
+        }
+        json << "}" << std::endl;
+        if (!json) {
+            throw Error("cannot write statistics file");
+        }
+    }
+}
+
+void
+Reporter::printProgress()
+{
+    std::unique_lock<std::mutex> lock{m_mutex};
+    for (;;) {
+        const bool stop{
+            m_cond.wait_for(lock, ProgressInterval, [this] { return m_stop; })};
+
+        const uint64_t done{get(m_progress_counter)};
+        const std::chrono::duration<double> elapsed{
+            std::chrono::steady_clock::now() - m_start};
+        const double rate{(elapsed.count() > 0) ? (done / elapsed.count())
+                                                : 0.0};
+
+        char line[128];
+        if ((m_progress_total > 0) && (rate > 0)) {
+            const uint64_t eta{static_cast<uint64_t>(
+                (m_progress_total - std::min(done, m_progress_total)) /
+                rate)};
+            snprintf(line, sizeof(line),
+                     "%.1f / %.1f MiB (%.0f%%), %.1f MiB/s, ETA %" PRIu64
+                     ":%02" PRIu64 ":%02" PRIu64,
+                     toMib(done), toMib(m_progress_total),
+                     (100.0 * std::min(done, m_progress_total)) /
+                         m_progress_total,
+                     toMib(rate), eta / 3600, (eta / 60) % 60, eta % 60);
+        } else {
+            snprintf(line, sizeof(line), "%.1f MiB, %.1f MiB/s", toMib(done),
+                     toMib(rate));
+        }
+        // The line is overwritten by the next one
+        std::cerr << "\r" << m_operation << ": " << line << "\033[K"
+                  << std::flush;
+
+        if (stop) {
+            std::cerr << std::endl;
+            return;
+        }
+    }
+}
+
+void
+Reporter::stopProgress()
+{
+    if (!m_progress_thread.joinable()) {
+        return;
+    }
+    {
+        const std::lock_guard<std::mutex> lock{m_mutex};
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_progress_thread.join();
+}
+
+} // namespace Stats
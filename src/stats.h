@@ -0,0 +1,145 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "exception.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Counters of the work done by the operation. They are shared by all its
+// threads.
+namespace Stats
+{
+
+class Error : public DiffddError
+{
+  public:
+    explicit Error(const std::string &message) : DiffddError(message) {}
+};
+
+enum class Counter {
+    InputBytesRead,
+    BaseBytesRead,
+    DiffBytesRead,
+    BytesCompared,
+    Records,
+    Merges,
+    BytesWritten,
+    // Time spent blocked in reading and writing of the files, summed over the
+    // threads
+    IoThreadNanoseconds,
+    // Time during which at least one thread was blocked in reading or writing
+    IoWallNanoseconds,
+    // The number of the counters
+    Count,
+};
+
+// Set by the reporter if it prints anything, before the operation starts.
+// Otherwise the counters are not updated and the I/O is not timed, so the
+// records do not pay for them.
+inline std::atomic<bool> enabled{false};
+
+void addEnabled(Counter counter, uint64_t value);
+uint64_t get(Counter counter);
+
+inline void
+add(Counter counter, uint64_t value)
+{
+    if (enabled.load(std::memory_order_relaxed)) {
+        addEnabled(counter, value);
+    }
+}
+
+// Adds the time spent in its scope to the I/O times
+class IoTimer
+{
+  public:
+    IoTimer() : m_enabled{enabled.load(std::memory_order_relaxed)}
+    {
+        if (m_enabled) {
+            start();
+        }
+    };
+    IoTimer(const IoTimer &) = delete;
+    IoTimer &operator=(const IoTimer &) = delete;
+    virtual ~IoTimer()
+    {
+        if (m_enabled) {
+            stop();
+        }
+    };
+
+  private:
+    const bool m_enabled;
+    std::chrono::steady_clock::time_point m_start;
+
+    void start();
+    void stop();
+};
+
+// Prints the progress of the counter towards the total on an interval, and
+// the summary of all the counters when the operation finishes
+class Reporter
+{
+  public:
+    // The total of zero means it is unknown. The summary is written as JSON
+    // to the file if its path is not empty.
+    Reporter(const std::string &operation, bool print_summary,
+             bool print_progress, const std::filesystem::path &json_path,
+             Counter progress_counter, uint64_t progress_total);
+    Reporter(const Reporter &) = delete;
+    Reporter &operator=(const Reporter &) = delete;
+    virtual ~Reporter();
+
+    // Must be called after the operation finished successfully
+    void finish();
+
+  private:
+    const std::string m_operation;
+    const bool m_print_summary;
+    const std::filesystem::path m_json_path;
+    const Counter m_progress_counter;
+    const uint64_t m_progress_total;
+    const std::chrono::steady_clock::time_point m_start;
+
+    std::thread m_progress_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_stop;
+
+    void printProgress();
+    void stopProgress();
+};
+
+} // namespace Stats
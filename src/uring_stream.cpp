@@ -0,0 +1,563 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "uring_stream.h"
+#include "file_stream.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define DIFFDD_HAVE_IO_URING
+#endif
+
+namespace Uring
+{
+
+#ifdef DIFFDD_HAVE_IO_URING
+
+namespace
+{
+
+// Minimal io_uring built directly on the system calls. The ring is used only
+// by one thread.
+class Ring
+{
+  public:
+    struct Completion {
+        uint64_t user_data;
+        int32_t res;
+    };
+
+    explicit Ring(unsigned entries)
+        : m_fd(-1), m_sq_ring(MAP_FAILED), m_cq_ring(MAP_FAILED),
+          m_sqes(static_cast<io_uring_sqe *>(MAP_FAILED)), m_to_submit(0)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        m_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (m_fd < 0) {
+            throw Error("io_uring is not available");
+        }
+
+        m_sq_ring_size =
+            params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+        m_cq_ring_size =
+            params.cq_off.cqes + (params.cq_entries * sizeof(io_uring_cqe));
+        const bool single_mmap{(params.features & IORING_FEAT_SINGLE_MMAP) !=
+                               0};
+        if (single_mmap) {
+            m_sq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+        }
+        m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+        m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if (single_mmap) {
+            m_cq_ring = m_sq_ring;
+        } else if (m_sq_ring != MAP_FAILED) {
+            m_cq_ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, m_fd,
+                             IORING_OFF_CQ_RING);
+        }
+        if (m_cq_ring != MAP_FAILED) {
+            m_sqes = static_cast<io_uring_sqe *>(
+                mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+        }
+        if (m_sqes == MAP_FAILED) {
+            release();
+            throw Error("io_uring is not available");
+        }
+
+        char *sq{static_cast<char *>(m_sq_ring)};
+        m_sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        m_sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        m_sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+        char *cq{static_cast<char *>(m_cq_ring)};
+        m_cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        m_cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        m_cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    };
+
+    ~Ring() { release(); };
+
+    Ring(const Ring &) = delete;
+    Ring &operator=(const Ring &) = delete;
+
+    bool registerBuffers(const std::vector<iovec> &iovecs)
+    {
+        return syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_BUFFERS,
+                       iovecs.data(), iovecs.size()) == 0;
+    };
+
+    // The operation is submitted on the next call of submit() or wait()
+    void prepare(uint8_t opcode, int fd, char *addr, size_t len,
+                 uint64_t offset, uint16_t buf_index, uint64_t user_data)
+    {
+        const unsigned tail{*m_sq_tail};
+        const unsigned index{tail & *m_sq_mask};
+
+        io_uring_sqe &sqe{m_sqes[index]};
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = opcode;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(addr);
+        sqe.len = static_cast<uint32_t>(len);
+        sqe.off = offset;
+        sqe.buf_index = buf_index;
+        sqe.user_data = user_data;
+
+        m_sq_array[index] = index;
+        __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+        ++m_to_submit;
+    };
+
+    void submit()
+    {
+        while (m_to_submit > 0) {
+            enter(0);
+        }
+    };
+
+    Completion wait()
+    {
+        for (;;) {
+            const unsigned head{*m_cq_head};
+            if (head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe &cqe{m_cqes[head & *m_cq_mask]};
+                const Completion c{cqe.user_data, cqe.res};
+                __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+                return c;
+            }
+            enter(1);
+        }
+    };
+
+  private:
+    int m_fd;
+    void *m_sq_ring;
+    void *m_cq_ring;
+    io_uring_sqe *m_sqes;
+    size_t m_sq_ring_size;
+    size_t m_cq_ring_size;
+    size_t m_sqes_size;
+    unsigned *m_sq_tail;
+    unsigned *m_sq_mask;
+    unsigned *m_sq_array;
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned *m_cq_mask;
+    io_uring_cqe *m_cqes;
+    unsigned m_to_submit;
+
+    void enter(unsigned min_complete)
+    {
+        const unsigned flags{(min_complete > 0) ? IORING_ENTER_GETEVENTS : 0};
+        const long r{syscall(__NR_io_uring_enter, m_fd, m_to_submit,
+                             min_complete, flags, nullptr, 0)};
+        if (r < 0) {
+            if ((errno == EINTR) || (errno == EAGAIN) || (errno == EBUSY)) {
+                return;
+            }
+            throw Error("cannot submit I/O to io_uring");
+        }
+        m_to_submit -= static_cast<unsigned>(r);
+    };
+
+    void release()
+    {
+        if (m_sqes != MAP_FAILED) {
+            munmap(m_sqes, m_sqes_size);
+        }
+        if ((m_cq_ring != MAP_FAILED) && (m_cq_ring != m_sq_ring)) {
+            munmap(m_cq_ring, m_cq_ring_size);
+        }
+        if (m_sq_ring != MAP_FAILED) {
+            munmap(m_sq_ring, m_sq_ring_size);
+        }
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    };
+};
+
+// The buffers of the slots are used in a round robin order. In input mode,
+// all the slots are reading ahead at increasing offsets and the get area is
+// in the oldest one. In output mode, the put area is in the current slot and
+// the others are being written.
+class FileBuf : public std::streambuf
+{
+  public:
+    FileBuf(std::unique_ptr<Ring> ring, int fd, bool output,
+            size_t buffer_size, unsigned queue_depth)
+        : m_ring(std::move(ring)), m_fd(fd), m_output(output),
+          m_buffer_size(buffer_size), m_slots(queue_depth), m_current(0),
+          m_next_offset(0), m_error(0)
+    {
+        std::vector<iovec> iovecs;
+        for (Slot &s : m_slots) {
+            try {
+                s.data = std::unique_ptr<char[]>(new char[m_buffer_size]);
+            } catch (const std::bad_alloc &e) {
+                close(m_fd);
+                throw Error("cannot allocate buffer for io_uring");
+            }
+            iovecs.push_back(iovec{s.data.get(), m_buffer_size});
+        }
+        // Registration can fail on the locked memory limit. The unregistered
+        // buffers are slower, but work the same.
+        m_fixed_buffers = m_ring->registerBuffers(iovecs);
+
+        if (m_output) {
+            setp(m_slots[0].data.get(), m_slots[0].data.get() + m_buffer_size);
+        } else {
+            startReading(0);
+        }
+    };
+
+    ~FileBuf() override
+    {
+        // The buffers must not be freed while the kernel can still use them
+        try {
+            if (m_output) {
+                sync();
+            } else {
+                waitAll();
+            }
+        } catch (const Error &e) {
+        }
+        close(m_fd);
+    };
+
+  protected:
+    int_type underflow() override
+    {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+
+        if (eback() != nullptr) {
+            // The current slot has been consumed
+            Slot &s{m_slots[m_current]};
+            if (s.done < s.size) {
+                // It was the end of the file
+                return traits_type::eof();
+            }
+            // Read ahead further into the consumed slot
+            s.offset = m_next_offset;
+            s.size = m_buffer_size;
+            s.done = 0;
+            submitSlot(m_current);
+            m_ring->submit();
+            m_next_offset += m_buffer_size;
+            m_current = (m_current + 1) % m_slots.size();
+        }
+
+        Slot &s{m_slots[m_current]};
+        waitSlot(m_current);
+        if (s.error != 0) {
+            // The input stream catches this and sets its bad bit
+            throw Error("cannot read from file");
+        }
+        setg(s.data.get(), s.data.get(), s.data.get() + s.done);
+
+        return (s.done == 0) ? traits_type::eof()
+                             : traits_type::to_int_type(*gptr());
+    };
+
+    int_type overflow(int_type ch) override
+    {
+        if (!m_output) {
+            return traits_type::eof();
+        }
+
+        flushPutArea();
+        if (m_error != 0) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    };
+
+    int sync() override
+    {
+        if (m_output) {
+            flushPutArea();
+            waitAll();
+        }
+        return (m_error == 0) ? 0 : -1;
+    };
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode /* which */) override
+    {
+        const Slot &s{m_slots[m_current]};
+        const uint64_t current{
+            m_output ? (s.offset + (pptr() - pbase()))
+                     : (s.offset + ((eback() != nullptr) ? (gptr() - eback())
+                                                         : 0))};
+        if ((dir == std::ios_base::cur) && (off == 0)) {
+            return pos_type(static_cast<off_type>(current));
+        }
+
+        if (m_output) {
+            flushPutArea();
+            if (m_error != 0) {
+                return pos_type(off_type(-1));
+            }
+        }
+
+        off_type target;
+        if (dir == std::ios_base::beg) {
+            target = off;
+        } else if (dir == std::ios_base::cur) {
+            target = static_cast<off_type>(current) + off;
+        } else {
+            if (m_output) {
+                waitAll();
+            }
+            const int64_t size{FileStream::getFileSize(m_fd)};
+            if (size < 0) {
+                return pos_type(off_type(-1));
+            }
+            target = size + off;
+        }
+        if (target < 0) {
+            return pos_type(off_type(-1));
+        }
+
+        if (m_output) {
+            m_slots[m_current].offset = static_cast<uint64_t>(target);
+        } else {
+            startReading(static_cast<uint64_t>(target));
+        }
+        return pos_type(target);
+    };
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+    {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    };
+
+  private:
+    struct Slot {
+        std::unique_ptr<char[]> data;
+        // Offset in the file of the first byte of the data
+        uint64_t offset{0};
+        size_t size{0};
+        size_t done{0};
+        bool in_flight{false};
+        int error{0};
+    };
+
+    std::unique_ptr<Ring> m_ring;
+    const int m_fd;
+    const bool m_output;
+    const size_t m_buffer_size;
+    bool m_fixed_buffers;
+    std::vector<Slot> m_slots;
+    size_t m_current;
+    // Offset in the file of the next read ahead
+    uint64_t m_next_offset;
+    int m_error;
+
+    void submitSlot(size_t index)
+    {
+        Slot &s{m_slots[index]};
+        uint8_t opcode;
+        if (m_output) {
+            opcode = m_fixed_buffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        } else {
+            opcode = m_fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        }
+        m_ring->prepare(opcode, m_fd, s.data.get() + s.done, s.size - s.done,
+                        s.offset + s.done, static_cast<uint16_t>(index), index);
+        s.in_flight = true;
+    };
+
+    void completeOne()
+    {
+        const Ring::Completion c{m_ring->wait()};
+        assert(c.user_data < m_slots.size());
+        Slot &s{m_slots[c.user_data]};
+        s.in_flight = false;
+
+        if ((c.res == -EINTR) || (c.res == -EAGAIN)) {
+            submitSlot(c.user_data);
+        } else if (c.res < 0) {
+            s.error = -c.res;
+        } else if ((c.res == 0) && m_output) {
+            s.error = EIO;
+        } else {
+            s.done += static_cast<size_t>(c.res);
+            if ((c.res > 0) && (s.done < s.size)) {
+                // Short transfer. Continue with the rest.
+                submitSlot(c.user_data);
+            }
+        }
+
+        if (s.in_flight) {
+            m_ring->submit();
+        } else if ((s.error != 0) && (m_error == 0)) {
+            m_error = s.error;
+        }
+    };
+
+    void waitSlot(size_t index)
+    {
+        while (m_slots[index].in_flight) {
+            completeOne();
+        }
+    };
+
+    void waitAll()
+    {
+        for (size_t i = 0; i < m_slots.size(); ++i) {
+            waitSlot(i);
+        }
+    };
+
+    void startReading(uint64_t offset)
+    {
+        waitAll();
+
+        m_next_offset = offset;
+        for (size_t i = 0; i < m_slots.size(); ++i) {
+            Slot &s{m_slots[i]};
+            s.offset = m_next_offset;
+            s.size = m_buffer_size;
+            s.done = 0;
+            s.error = 0;
+            submitSlot(i);
+            m_next_offset += m_buffer_size;
+        }
+        m_ring->submit();
+
+        m_current = 0;
+        setg(nullptr, nullptr, nullptr);
+    };
+
+    void flushPutArea()
+    {
+        Slot &s{m_slots[m_current]};
+        const size_t size{static_cast<size_t>(pptr() - pbase())};
+        if (size == 0) {
+            return;
+        }
+
+        // Writes in flight are not ordered. Do not let them overlap.
+        for (size_t i = 0; i < m_slots.size(); ++i) {
+            const Slot &o{m_slots[i]};
+            if (o.in_flight && (o.offset < (s.offset + size)) &&
+                (s.offset < (o.offset + o.size))) {
+                waitSlot(i);
+            }
+        }
+
+        s.size = size;
+        s.done = 0;
+        submitSlot(m_current);
+        m_ring->submit();
+
+        const uint64_t next_offset{s.offset + size};
+        m_current = (m_current + 1) % m_slots.size();
+        waitSlot(m_current);
+
+        Slot &next{m_slots[m_current]};
+        next.offset = next_offset;
+        next.error = 0;
+        setp(next.data.get(), next.data.get() + m_buffer_size);
+    };
+};
+
+} // namespace
+
+#endif
+
+Stream::Stream(std::unique_ptr<std::streambuf> buf)
+    : std::iostream(buf.get()), m_buf(std::move(buf))
+{
+}
+
+Stream::~Stream() = default;
+
+std::unique_ptr<Stream>
+Stream::open(const std::filesystem::path &path, std::ios_base::openmode mode,
+             size_t buffer_size, unsigned queue_depth)
+{
+#ifdef DIFFDD_HAVE_IO_URING
+    std::unique_ptr<Ring> ring;
+    try {
+        ring = std::make_unique<Ring>(queue_depth);
+    } catch (const Error &e) {
+        return nullptr;
+    }
+
+    const bool output{(mode & std::ios_base::out) != 0};
+    int flags{O_CLOEXEC};
+    if (!output) {
+        flags |= O_RDONLY;
+    } else if ((mode & std::ios_base::trunc) != 0) {
+        flags |= O_WRONLY | O_CREAT | O_TRUNC;
+    } else {
+        flags |= O_WRONLY;
+    }
+
+    const int fd{::open(path.c_str(), flags, 0666)};
+    if (fd < 0) {
+        // Without a stream buffer the stream is in the failed state
+        return std::unique_ptr<Stream>(new Stream(nullptr));
+    }
+
+    return std::unique_ptr<Stream>(new Stream(std::make_unique<FileBuf>(
+        std::move(ring), fd, output, buffer_size, queue_depth)));
+#else
+    (void)path;
+    (void)mode;
+    (void)buffer_size;
+    (void)queue_depth;
+    return nullptr;
+#endif
+}
+
+} // namespace Uring
@@ -0,0 +1,121 @@
+/* Copyright 2026 Ján Sučan <jan@jansucan.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "verify.h"
+#include "file_stream.h"
+#include "format_v3.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+namespace
+{
+
+// The index must have the records read from the file, and must follow the end
+// record
+void
+verifyIndex(const std::filesystem::path &path,
+            const std::vector<FormatV3::IndexEntry> &records,
+            uint64_t end_position, uint32_t features)
+{
+    std::ifstream diff_stream{path, std::ios_base::in | std::ios_base::binary};
+    if (!diff_stream) {
+        throw VerifyError("cannot open diff file");
+    }
+    const int64_t file_size{FileStream::getStreamSize(diff_stream)};
+    if (file_size < 0) {
+        throw VerifyError("cannot get size of the diff file");
+    }
+
+    const std::vector<FormatV3::IndexEntry> index{
+        FormatV3::readIndex(diff_stream, features)};
+    const bool same{std::equal(
+        index.begin(), index.end(), records.begin(), records.end(),
+        [](const FormatV3::IndexEntry &a, const FormatV3::IndexEntry &b) {
+            return (a.offset == b.offset) && (a.size == b.size) &&
+                   (a.position == b.position);
+        })};
+    if (!same) {
+        throw VerifyError("index does not match the records");
+    }
+
+    const uint64_t index_size{FormatV3::getIndexSize(index, features)};
+    if ((end_position + index_size) != static_cast<uint64_t>(file_size)) {
+        throw VerifyError("index does not follow the end record");
+    }
+}
+
+} // namespace
+
+void
+verify(const Options::Verify &opts)
+{
+    const FileStream::Config stream_config{
+        opts.getIoBackend(), opts.getBufferSize(), opts.getQueueDepth()};
+
+    const std::unique_ptr<std::istream> diff_stream{
+        FileStream::openInput(opts.getDiffFilePath(), stream_config)};
+    if (!*diff_stream) {
+        throw VerifyError("cannot open diff file");
+    }
+
+    // The checksums are checked by the reader as the records are read
+    FormatV3::Reader diff_reader(*diff_stream, opts.getBufferSize(),
+                                 opts.getReadAheadCount());
+
+    std::vector<FormatV3::IndexEntry> records;
+    for (;;) {
+        const uint64_t position{diff_reader.getPosition()};
+        const FormatV3::RecordHeader header{diff_reader.readRecordHeader()};
+        if (header.type == FormatV3::RecordType::End) {
+            break;
+        }
+        records.push_back(
+            FormatV3::IndexEntry{header.offset, header.size, position});
+
+        uint64_t data_left{0};
+        if (header.type == FormatV3::RecordType::Data) {
+            data_left = header.size;
+        } else if (header.type == FormatV3::RecordType::Compressed) {
+            data_left = header.compressed_size;
+        }
+        while (data_left > 0) {
+            const FormatV3::RecordData rd{diff_reader.readRecordData(
+                std::min<uint64_t>(data_left, opts.getBufferSize()))};
+            if (rd.size == 0) {
+                throw VerifyError("cannot read all the data of the record");
+            }
+            data_left -= rd.size;
+        }
+    }
+
+    if ((diff_reader.getFeatures() & FormatV3::FeatureIndex) != 0) {
+        verifyIndex(opts.getDiffFilePath(), records,
+                    diff_reader.getPosition(), diff_reader.getFeatures());
+    }
+}
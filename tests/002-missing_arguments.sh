@@ -6,5 +6,9 @@ PROGRAM_EXEC="$1"
 
 assert "Usage" "missing input file" 1 $PROGRAM_EXEC create
 assert "Usage" "missing diff file" 1 $PROGRAM_EXEC restore
+assert "Usage" "missing input file" 1 $PROGRAM_EXEC signature
+assert "Usage" "missing diff file" 1 $PROGRAM_EXEC verify
+assert "Usage" "missing output file" 1 $PROGRAM_EXEC merge
+assert "Usage" "missing offset" 1 $PROGRAM_EXEC extract
 
 exit 0
@@ -7,4 +7,7 @@ PROGRAM_EXEC="$1"
 assert "Usage" "unknown option '-x'" 1 $PROGRAM_EXEC create -x -i in -b base -o out
 assert "Usage" "unknown option '-x'" 1 $PROGRAM_EXEC restore -x -d diff -o out
 
+assert "Usage" "unknown option '--xyz'" 1 $PROGRAM_EXEC create --xyz -i in -b base -o out
+assert "Usage" "unknown option '--xyz'" 1 $PROGRAM_EXEC restore --xyz -d diff -o out
+
 exit 0
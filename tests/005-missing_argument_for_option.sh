@@ -8,4 +8,7 @@ assert "Usage" "missing argument for option '-B'" 1 $PROGRAM_EXEC create -B
 
 assert "Usage" "missing argument for option '-B'" 1 $PROGRAM_EXEC restore -B
 
+assert "Usage" "missing argument for option '--queue-depth'" 1 $PROGRAM_EXEC create --queue-depth
+assert "Usage" "missing argument for option '--queue-depth'" 1 $PROGRAM_EXEC restore --queue-depth
+
 exit 0
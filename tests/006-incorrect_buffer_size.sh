@@ -10,4 +10,7 @@ assert "Usage" "buffer size cannot be 0" 1 $PROGRAM_EXEC create -B 0 -i in -b ba
 assert "Usage" "incorrect buffer size" 1 $PROGRAM_EXEC restore -B abc123 -d diff -o out
 assert "Usage" "buffer size cannot be 0" 1 $PROGRAM_EXEC restore -B 0 -d diff -o out
 
+assert "Usage" "incorrect buffer size" 1 $PROGRAM_EXEC signature -B abc123 -i in -o out
+assert "Usage" "buffer size cannot be 0" 1 $PROGRAM_EXEC signature -B 0 -i in -o out
+
 exit 0
@@ -0,0 +1,13 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+assert "Usage" "incorrect thread count" 1 $PROGRAM_EXEC create -j abc123 -i in -b base -o out
+assert "Usage" "thread count cannot be 0" 1 $PROGRAM_EXEC create -j 0 -i in -b base -o out
+
+assert "Usage" "incorrect thread count" 1 $PROGRAM_EXEC restore -j abc123 -d diff -o out
+assert "Usage" "thread count cannot be 0" 1 $PROGRAM_EXEC restore -j 0 -d diff -o out
+
+exit 0
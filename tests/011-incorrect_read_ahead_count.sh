@@ -0,0 +1,10 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+assert "Usage" "incorrect read-ahead count" 1 $PROGRAM_EXEC create -R abc123 -i in -b base -o out
+assert "Usage" "incorrect read-ahead count" 1 $PROGRAM_EXEC restore -R abc123 -d diff -o out
+
+exit 0
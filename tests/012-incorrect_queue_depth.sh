@@ -0,0 +1,13 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+assert "Usage" "incorrect queue depth" 1 $PROGRAM_EXEC create --io-uring --queue-depth abc123 -i in -b base -o out
+assert "Usage" "queue depth cannot be 0" 1 $PROGRAM_EXEC create --io-uring --queue-depth 0 -i in -b base -o out
+
+assert "Usage" "incorrect queue depth" 1 $PROGRAM_EXEC restore --io-uring --queue-depth abc123 -d diff -o out
+assert "Usage" "queue depth cannot be 0" 1 $PROGRAM_EXEC restore --io-uring --queue-depth 0 -d diff -o out
+
+exit 0
@@ -0,0 +1,15 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+assert "Usage" "--direct cannot be used with --io-uring" 1 $PROGRAM_EXEC create --io-uring --direct -i in -b base -o out
+assert "Usage" "--direct cannot be used with --io-uring" 1 $PROGRAM_EXEC create --direct --io-uring -i in -b base -o out
+
+assert "Usage" "--direct cannot be used with --io-uring" 1 $PROGRAM_EXEC restore --io-uring --direct -d diff -o out
+assert "Usage" "--direct cannot be used with --io-uring" 1 $PROGRAM_EXEC restore --direct --io-uring -d diff -o out
+
+assert "Usage" "-j cannot be used with --io-uring" 1 $PROGRAM_EXEC restore -j 2 --io-uring -d diff -o out
+
+exit 0
@@ -0,0 +1,10 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+assert "Usage" "incorrect block size" 1 $PROGRAM_EXEC signature -s abc123 -i in -o out
+assert "Usage" "block size cannot be 0" 1 $PROGRAM_EXEC signature -s 0 -i in -o out
+
+exit 0
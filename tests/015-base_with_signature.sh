@@ -0,0 +1,9 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+assert "Usage" "base file cannot be used with --signature" 1 $PROGRAM_EXEC create -i in -b base --signature sig -o out
+
+exit 0
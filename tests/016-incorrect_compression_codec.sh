@@ -0,0 +1,9 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+assert "Usage" "unknown compression codec" 1 $PROGRAM_EXEC create --compress abc -i in -b base -o out
+
+exit 0
@@ -0,0 +1,12 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+assert "Usage" "incorrect granularity" 1 $PROGRAM_EXEC create --granularity abc123 -i in -b base -o out
+assert "Usage" "granularity cannot be 0" 1 $PROGRAM_EXEC create --granularity 0 -i in -b base -o out
+assert "Usage" "granularity must be a power of 2" 1 $PROGRAM_EXEC create --granularity 3000 -i in -b base -o out
+assert "Usage" "granularity cannot be used with --signature" 1 $PROGRAM_EXEC create --granularity 4096 -i in --signature sig -o out
+
+exit 0
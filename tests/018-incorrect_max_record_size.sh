@@ -0,0 +1,11 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+assert "Usage" "incorrect maximum record size" 1 $PROGRAM_EXEC create --max-record-size abc123 -i in -b base -o out
+assert "Usage" "maximum record size cannot be 0" 1 $PROGRAM_EXEC create --max-record-size 0 -i in -b base -o out
+assert "Usage" "granularity cannot be larger than the maximum record size" 1 $PROGRAM_EXEC create --granularity 8192 --max-record-size 4096 -i in -b base -o out
+
+exit 0
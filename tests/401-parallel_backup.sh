@@ -0,0 +1,34 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    [ -z "$(diff "$1" "$2")" ]
+}
+
+rm -f input base out out_parallel
+
+# A base file spanning many ranges of the worker threads
+dd if=/dev/zero of=base bs=512 count=64 1>/dev/null 2>&1
+cp base input
+
+# Changes at range boundaries, inside ranges, and in the last sector
+for offset in 0 4095 4096 4097 10000 20479 20480 $(( (512 * 64) - 1 )); do
+    printf '\xFF' | dd of=input bs=1 count=1 seek=$offset conv=notrunc 1>/dev/null 2>&1
+done
+printf '\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF' | dd of=input bs=1 count=8 seek=8190 conv=notrunc 1>/dev/null 2>&1
+
+assert "" "" 0 $PROGRAM_EXEC create -B 512 -i input -b base -o out
+assert "" "" 0 $PROGRAM_EXEC create -B 512 -j 4 -i input -b base -o out_parallel
+
+if ! files_are_the_same out out_parallel; then
+    echo "assert: Parallel backup output differs from the single-threaded one"
+    exit 1
+fi
+
+rm -f input base out out_parallel
+
+exit 0
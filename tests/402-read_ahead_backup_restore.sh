@@ -0,0 +1,48 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    cmp -s "$1" "$2"
+}
+
+rm -f input backedup_input base out out_read_ahead
+
+yes diff-dd | head -c 20000 > base
+cp base input
+
+# A changed range much longer than the buffers, so its record spans many of
+# them, and a change in the last byte
+yes DIFF+DD | tr "\n" _ | head -c 3000 | dd of=input bs=1 seek=1000 conv=notrunc 1>/dev/null 2>&1
+printf '\xFF' | dd of=input bs=1 seek=19999 conv=notrunc 1>/dev/null 2>&1
+
+cp input backedup_input
+
+assert "" "" 0 $PROGRAM_EXEC create -B 64 -i input -b base -o out
+
+# Even with 16 buffers read ahead, the long record does not fit in the
+# buffers read ahead
+for read_ahead_count in 1 2 16; do
+    assert "" "" 0 $PROGRAM_EXEC create -R $read_ahead_count -B 64 -i input -b base -o out_read_ahead
+
+    if ! files_are_the_same out out_read_ahead; then
+        echo "assert: Backup output differs with $read_ahead_count buffers read ahead"
+        exit 1
+    fi
+
+    cp base input
+
+    assert "" "" 0 $PROGRAM_EXEC restore -R $read_ahead_count -B 64 -d out -o input
+
+    if ! files_are_the_same input backedup_input; then
+        echo "assert: Cannot restore the backup with $read_ahead_count buffers read ahead"
+        exit 1
+    fi
+done
+
+rm -f input backedup_input base out out_read_ahead
+
+exit 0
@@ -0,0 +1,48 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    cmp -s "$1" "$2"
+}
+
+rm -f input backedup_input base out out_io_uring
+
+# The size is not a multiple of the buffer size, so the last read is short
+yes diff-dd | head -c $(( (16 * 512) + 100 )) > base
+cp base input
+
+for offset in 0 1500 4095 4096 8000 $(( (16 * 512) + 99 )); do
+    printf '\xFF' | dd of=input bs=1 seek=$offset conv=notrunc 1>/dev/null 2>&1
+done
+
+cp input backedup_input
+
+assert "" "" 0 $PROGRAM_EXEC create -B 512 -i input -b base -o out
+
+# With a depth of 1 the only slot is reused for every read and write. With
+# a depth of 64 more reads are queued than the file has buffers.
+for queue_depth in 1 2 64; do
+    assert "" "" 0 $PROGRAM_EXEC create --io-uring --queue-depth $queue_depth -B 512 -i input -b base -o out_io_uring
+
+    if ! files_are_the_same out out_io_uring; then
+        echo "assert: Backup output differs with a queue depth of $queue_depth"
+        exit 1
+    fi
+
+    cp base input
+
+    assert "" "" 0 $PROGRAM_EXEC restore --io-uring --queue-depth $queue_depth -B 512 -d out_io_uring -o input
+
+    if ! files_are_the_same input backedup_input; then
+        echo "assert: Cannot restore the backup with a queue depth of $queue_depth"
+        exit 1
+    fi
+done
+
+rm -f input backedup_input base out out_io_uring
+
+exit 0
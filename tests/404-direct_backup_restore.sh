@@ -0,0 +1,54 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    cmp -s "$1" "$2"
+}
+
+rm -f input backedup_input base out out_direct
+
+# The image size is not a multiple of the logical block size, so the last
+# block is partial
+yes diff-dd | head -c $(( (5 * 512) + 123 )) > base
+cp base input
+
+# Changes in the middle of a sector, across a sector boundary, and in the
+# partial last block
+printf '\xFF\xFE' | dd of=input bs=1 seek=700 conv=notrunc 1>/dev/null 2>&1
+printf '\xFF\xFE\xFD\xFC' | dd of=input bs=1 seek=1022 conv=notrunc 1>/dev/null 2>&1
+printf '\xFF' | dd of=input bs=1 seek=$(( (5 * 512) + 120 )) conv=notrunc 1>/dev/null 2>&1
+
+cp input backedup_input
+
+# The buffer size not being a multiple of the block size is rounded up
+for buffer_size in 512 1000; do
+    assert "" "" 0 $PROGRAM_EXEC create -B $buffer_size -i input -b base -o out
+    assert "" "" 0 $PROGRAM_EXEC create --direct -B $buffer_size -i input -b base -o out_direct
+
+    # The diff file has an unaligned size too
+    if ! files_are_the_same out out_direct; then
+        echo "assert: Direct backup output differs from the buffered one (-B $buffer_size)"
+        exit 1
+    fi
+
+    # The records start and end inside the blocks, so their writes read the
+    # rest of the blocks from the output file first
+    for restore_options in "--direct" "--direct -j 2"; do
+        cp base input
+
+        assert "" "" 0 $PROGRAM_EXEC restore $restore_options -B $buffer_size -d out_direct -o input
+
+        if ! files_are_the_same input backedup_input; then
+            echo "assert: Cannot restore the backup with $restore_options -B $buffer_size"
+            exit 1
+        fi
+    done
+done
+
+rm -f input backedup_input base out out_direct
+
+exit 0
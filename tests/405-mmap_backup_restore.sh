@@ -0,0 +1,53 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    cmp -s "$1" "$2"
+}
+
+rm -f input backedup_input base out out_mmap
+
+# An empty file, a file shorter than a page and a file whose size is not a
+# multiple of the page size
+for size in 0 100 $(( (3 * 4096) + 77 )); do
+    yes diff-dd | head -c $size > base
+    cp base input
+
+    if [ $size -gt 0 ]; then
+        printf '\xFF' | dd of=input bs=1 seek=$(( size / 2 )) conv=notrunc 1>/dev/null 2>&1
+        printf '\xFF' | dd of=input bs=1 seek=$(( size - 1 )) conv=notrunc 1>/dev/null 2>&1
+    fi
+
+    cp input backedup_input
+
+    # A buffer size of 1000 does not divide the page size, so the parts do
+    # not start at page boundaries
+    for buffer_size in 512 1000; do
+        assert "" "" 0 $PROGRAM_EXEC create -B $buffer_size -i input -b base -o out
+        assert "" "" 0 $PROGRAM_EXEC create --mmap -B $buffer_size -i input -b base -o out_mmap
+
+        if ! files_are_the_same out out_mmap; then
+            echo "assert: Mapped backup output differs for $size bytes (-B $buffer_size)"
+            exit 1
+        fi
+
+        cp base input
+
+        assert "" "" 0 $PROGRAM_EXEC restore -d out_mmap -o input
+
+        if ! files_are_the_same input backedup_input; then
+            echo "assert: Cannot restore the mapped backup of $size bytes"
+            exit 1
+        fi
+
+        cp backedup_input input
+    done
+done
+
+rm -f input backedup_input base out out_mmap
+
+exit 0
@@ -0,0 +1,62 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    [ -z "$(diff "$1" "$2")" ]
+}
+
+rm -f input backedup_input base sig out out_parallel short_input
+
+# Create a four-sector base file (the original file)
+dd if=/dev/zero of=base bs=512 count=4 1>/dev/null 2>&1
+cp base input
+
+# Change the first, third and fourth sectors
+printf '\xFF' | dd of=input bs=1 count=1 seek=0 conv=notrunc  1>/dev/null 2>&1
+printf '\xFF' | dd of=input bs=1 count=1 seek=$(( (512 * 3) - 1 )) conv=notrunc  1>/dev/null 2>&1
+printf '\xFF' | dd of=input bs=1 count=1 seek=$(( (512 * 4) - (512 / 2) )) conv=notrunc  1>/dev/null 2>&1
+
+assert "" "" 0 $PROGRAM_EXEC signature -s 512 -i base -o sig
+
+# The base file is not needed for the backup
+assert "" "" 0 $PROGRAM_EXEC create -B 1024 -i input --signature sig -o out
+assert "" "" 0 $PROGRAM_EXEC create -B 1024 -j 2 -i input --signature sig -o out_parallel
+
+if ! files_are_the_same out out_parallel; then
+    echo "assert: Parallel backup output differs from the single-threaded one"
+    exit 1
+fi
+
+# The changed sectors are backed up whole: the first sector, and the third
+# and fourth sectors in one record. The records and the end record have
+# checksums. The end record is followed by the index. The record headers and
+# the index entries have the varints of the offset deltas, the sizes and the
+# position deltas.
+expected_size=$(( 18 + (1 + 1 + 2) + 512 + (1 + 2 + 2) + 1024 + 1 + (3 * 4) +
+                  (1 + 2 + 1) + (2 + 2 + 2) + 16 ))
+if [ "$(stat -c %s out)" -ne $expected_size ]; then
+    echo "assert: Backup output file does not have the expected size"
+    exit 1
+fi
+
+cp input backedup_input
+cp base input
+
+assert "" "" 0 $PROGRAM_EXEC restore -d out -o input
+
+if ! files_are_the_same input backedup_input; then
+    echo "assert: Cannot restore the backup"
+    exit 1
+fi
+
+# The input file must have the size of the image of the signature
+head -c 1000 input > short_input
+assert "" "input file size does not match the signature" 1 $PROGRAM_EXEC create -i short_input --signature sig -o out
+
+rm -f input backedup_input base sig out out_parallel short_input
+
+exit 0
@@ -0,0 +1,45 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    cmp -s "$1" "$2"
+}
+
+rm -f input backedup_input base out
+
+# Sparse files with data only in a few places
+truncate -s 256M base
+printf '\x01\x02\x03\x04' | dd of=base bs=1 seek=$(( 128 * 1024 * 1024 )) conv=notrunc 1>/dev/null 2>&1
+cp --sparse=always base input
+
+# A change in the data of both files, and a change in a hole of both files
+printf '\xFF' | dd of=input bs=1 count=1 seek=$(( (128 * 1024 * 1024) + 1 )) conv=notrunc 1>/dev/null 2>&1
+printf '\xFF' | dd of=input bs=1 count=1 seek=1000 conv=notrunc 1>/dev/null 2>&1
+
+assert "" "" 0 $PROGRAM_EXEC create -B 512 -i input -b base -o out
+
+# Header, two one-byte records and the end record with their checksums, and
+# the index. The second record is 128 MiB after the first one, so its offset
+# delta has four bytes.
+if [ "$(stat -c %s out)" -ne $(( 18 + (4 + 1) + (6 + 1) + 1 + (3 * 4) + 4 + 6 + 16 )) ]; then
+    echo "assert: Backup output file does not have the expected size"
+    exit 1
+fi
+
+cp --sparse=always input backedup_input
+cp --sparse=always base input
+
+assert "" "" 0 $PROGRAM_EXEC restore -d out -o input
+
+if ! files_are_the_same input backedup_input; then
+    echo "assert: Cannot restore the backup"
+    exit 1
+fi
+
+rm -f input backedup_input base out
+
+exit 0
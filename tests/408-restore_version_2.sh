@@ -0,0 +1,32 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    [ -z "$(diff "$1" "$2")" ]
+}
+
+rm -f expected output
+
+# The backup in the version 2 format of the changes of the four-sector file
+# in test 400
+dd if=/dev/zero of=expected bs=512 count=4 1>/dev/null 2>&1
+printf '\xFF' | dd of=expected bs=1 count=1 seek=0 conv=notrunc  1>/dev/null 2>&1
+printf '\xFF' | dd of=expected bs=1 count=1 seek=$(( (512 * 3) - 1 )) conv=notrunc  1>/dev/null 2>&1
+printf '\xFF' | dd of=expected bs=1 count=1 seek=$(( (512 * 4) - (512 / 2) )) conv=notrunc  1>/dev/null 2>&1
+
+dd if=/dev/zero of=output bs=512 count=4 1>/dev/null 2>&1
+
+assert "" "" 0 $PROGRAM_EXEC restore -d 408-version_2_backup_output.bin -o output
+
+if ! files_are_the_same output expected; then
+    echo "assert: Cannot restore the version 2 backup"
+    exit 1
+fi
+
+rm -f expected output
+
+exit 0
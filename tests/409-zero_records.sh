@@ -0,0 +1,42 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    cmp -s "$1" "$2"
+}
+
+rm -f input backedup_input base out
+
+# A base file without zeros
+yes diff-dd | head -c $(( 64 * 1024 )) > base
+cp base input
+
+# Zero a large range
+dd if=/dev/zero of=input bs=1024 count=16 seek=8 conv=notrunc 1>/dev/null 2>&1
+
+assert "" "" 0 $PROGRAM_EXEC create -i input -b base -o out
+
+# File header, one zero record and the end record with their checksums, and
+# the index
+if [ "$(stat -c %s out)" -ne $(( 18 + 6 + 1 + (2 * 4) + 6 + 16 )) ]; then
+    echo "assert: The zeros are not backed up as a zero record"
+    exit 1
+fi
+
+cp input backedup_input
+cp base input
+
+assert "" "" 0 $PROGRAM_EXEC restore -d out -o input
+
+if ! files_are_the_same input backedup_input; then
+    echo "assert: Cannot restore the backup"
+    exit 1
+fi
+
+rm -f input backedup_input base out
+
+exit 0
@@ -0,0 +1,38 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    [ -z "$(diff "$1" "$2")" ]
+}
+
+rm -f input backedup_input base out
+
+yes diff-dd | head -c $(( 64 * 1024 )) > base
+cp base input
+
+# Many small records, records larger than the buffer, and a zero record
+for offset in 0 1000 4095 4096 10000 20479 $(( (64 * 1024) - 1 )); do
+    printf '\xFF' | dd of=input bs=1 count=1 seek=$offset conv=notrunc 1>/dev/null 2>&1
+done
+head -c 3000 /dev/urandom | dd of=input bs=1 seek=30000 conv=notrunc 1>/dev/null 2>&1
+dd if=/dev/zero of=input bs=1024 count=16 seek=40 conv=notrunc 1>/dev/null 2>&1
+
+assert "" "" 0 $PROGRAM_EXEC create -B 512 -i input -b base -o out
+
+cp input backedup_input
+cp base input
+
+assert "" "" 0 $PROGRAM_EXEC restore -B 512 -j 4 -d out -o input
+
+if ! files_are_the_same input backedup_input; then
+    echo "assert: Cannot restore the backup by multiple threads"
+    exit 1
+fi
+
+rm -f input backedup_input base out
+
+exit 0
@@ -0,0 +1,49 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    [ -z "$(diff "$1" "$2")" ]
+}
+
+rm -f input backedup_input base out out_uncompressed out_parallel
+
+yes diff-dd | head -c $(( 64 * 1024 )) > base
+cp base input
+
+# Compressible changes, an incompressible one, and a one-byte one
+yes compressible | head -c 20000 | dd of=input bs=1 seek=1000 conv=notrunc 1>/dev/null 2>&1
+head -c 3000 /dev/urandom | dd of=input bs=1 seek=30000 conv=notrunc 1>/dev/null 2>&1
+printf '\xFF' | dd of=input bs=1 count=1 seek=50000 conv=notrunc 1>/dev/null 2>&1
+
+assert "" "" 0 $PROGRAM_EXEC create -i input -b base -o out_uncompressed
+assert "" "" 0 $PROGRAM_EXEC create --compress lz -i input -b base -o out
+assert "" "" 0 $PROGRAM_EXEC create --compress lz -B 4096 -j 4 -i input -b base -o out_parallel
+
+if [ "$(stat -c %s out)" -ge $(( $(stat -c %s out_uncompressed) - 10000 )) ]; then
+    echo "assert: The records are not compressed"
+    exit 1
+fi
+
+cp input backedup_input
+
+cp base input
+assert "" "" 0 $PROGRAM_EXEC restore -d out -o input
+if ! files_are_the_same input backedup_input; then
+    echo "assert: Cannot restore the compressed backup"
+    exit 1
+fi
+
+cp base input
+assert "" "" 0 $PROGRAM_EXEC restore -j 4 -d out_parallel -o input
+if ! files_are_the_same input backedup_input; then
+    echo "assert: Cannot restore the compressed backup by multiple threads"
+    exit 1
+fi
+
+rm -f input backedup_input base out out_uncompressed out_parallel
+
+exit 0
@@ -0,0 +1,25 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+rm -f input base out
+
+yes diff-dd | head -c $(( 64 * 1024 )) > base
+cp base input
+head -c 3000 /dev/urandom | dd of=input bs=1 seek=30000 conv=notrunc 1>/dev/null 2>&1
+
+assert "" "" 0 $PROGRAM_EXEC create -i input -b base -o out
+assert "" "" 0 $PROGRAM_EXEC verify -d out
+
+# Damage the data of the only data record. It starts after the file header
+# (18 bytes) and the record header (13 bytes).
+printf '\x00' | dd of=out bs=1 count=1 seek=$(( 18 + 13 + 100 )) conv=notrunc 1>/dev/null 2>&1
+
+assert "" "record checksum mismatch" 1 $PROGRAM_EXEC verify -d out
+assert "" "record checksum mismatch" 1 $PROGRAM_EXEC restore -d out -o base
+
+rm -f input base out
+
+exit 0
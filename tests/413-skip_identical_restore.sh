@@ -0,0 +1,55 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    [ -z "$(diff "$1" "$2")" ]
+}
+
+rm -f input backedup_input base out
+
+yes diff-dd | head -c $(( 64 * 1024 )) > base
+cp base input
+
+head -c 3000 /dev/urandom | dd of=input bs=1 seek=1000 conv=notrunc 1>/dev/null 2>&1
+head -c 3000 /dev/urandom | dd of=input bs=1 seek=30000 conv=notrunc 1>/dev/null 2>&1
+dd if=/dev/zero of=input bs=1024 count=16 seek=40 conv=notrunc 1>/dev/null 2>&1
+
+assert "" "" 0 $PROGRAM_EXEC create -i input -b base -o out
+
+cp input backedup_input
+
+# Partly restored output
+cp base input
+head -c 2000 backedup_input | dd of=input conv=notrunc 1>/dev/null 2>&1
+
+assert "" "" 0 $PROGRAM_EXEC restore --skip-identical -B 512 -d out -o input
+
+if ! files_are_the_same input backedup_input; then
+    echo "assert: Cannot restore the backup skipping the identical data"
+    exit 1
+fi
+
+cp base input
+
+assert "" "" 0 $PROGRAM_EXEC restore --skip-identical -B 512 -j 4 -d out -o input
+
+if ! files_are_the_same input backedup_input; then
+    echo "assert: Cannot restore the backup skipping the identical data by multiple threads"
+    exit 1
+fi
+
+# Nothing is written when the output is already restored
+modified_before=$(stat -c %y input)
+assert "" "" 0 $PROGRAM_EXEC restore --skip-identical -d out -o input
+if [ "$(stat -c %y input)" != "$modified_before" ]; then
+    echo "assert: The restored output was written again"
+    exit 1
+fi
+
+rm -f input backedup_input base out
+
+exit 0
@@ -0,0 +1,46 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    [ -z "$(diff "$1" "$2")" ]
+}
+
+rm -f input base day1 day2 day3 diff1 diff2 diff3 merged
+
+yes diff-dd | head -c $(( 64 * 1024 )) > base
+
+# Each day changes some of the data of the previous day, partly overlapping
+cp base day1
+head -c 5000 /dev/urandom | dd of=day1 bs=1 seek=1000 conv=notrunc 1>/dev/null 2>&1
+head -c 3000 /dev/urandom | dd of=day1 bs=1 seek=30000 conv=notrunc 1>/dev/null 2>&1
+
+cp day1 day2
+head -c 5000 /dev/urandom | dd of=day2 bs=1 seek=4000 conv=notrunc 1>/dev/null 2>&1
+dd if=/dev/zero of=day2 bs=1024 count=16 seek=40 conv=notrunc 1>/dev/null 2>&1
+
+cp day2 day3
+head -c 100 /dev/urandom | dd of=day3 bs=1 seek=45000 conv=notrunc 1>/dev/null 2>&1
+head -c 3000 /dev/urandom | dd of=day3 bs=1 seek=31000 conv=notrunc 1>/dev/null 2>&1
+
+assert "" "" 0 $PROGRAM_EXEC create -B 4096 -i day1 -b base -o diff1
+assert "" "" 0 $PROGRAM_EXEC create -B 4096 -i day2 -b day1 -o diff2
+assert "" "" 0 $PROGRAM_EXEC create -B 4096 -i day3 -b day2 -o diff3
+
+assert "" "" 0 $PROGRAM_EXEC merge -B 4096 -o merged diff1 diff2 diff3
+assert "" "" 0 $PROGRAM_EXEC verify -d merged
+
+cp base input
+assert "" "" 0 $PROGRAM_EXEC restore -d merged -o input
+
+if ! files_are_the_same input day3; then
+    echo "assert: Cannot restore the merged diffs"
+    exit 1
+fi
+
+rm -f input base day1 day2 day3 diff1 diff2 diff3 merged
+
+exit 0
@@ -0,0 +1,47 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    [ -z "$(diff "$1" "$2")" ]
+}
+
+rm -f base day1 day2 diff1 diff2 expected extracted
+
+yes diff-dd | head -c $(( 64 * 1024 )) > base
+
+cp base day1
+head -c 5000 /dev/urandom | dd of=day1 bs=1 seek=1000 conv=notrunc 1>/dev/null 2>&1
+head -c 3000 /dev/urandom | dd of=day1 bs=1 seek=30000 conv=notrunc 1>/dev/null 2>&1
+
+cp day1 day2
+head -c 5000 /dev/urandom | dd of=day2 bs=1 seek=4000 conv=notrunc 1>/dev/null 2>&1
+dd if=/dev/zero of=day2 bs=1024 count=16 seek=40 conv=notrunc 1>/dev/null 2>&1
+
+assert "" "" 0 $PROGRAM_EXEC create -B 4096 -i day1 -b base -o diff1
+assert "" "" 0 $PROGRAM_EXEC create -B 4096 -i day2 -b day1 -o diff2
+
+# The range covers the base file, both diffs, and the zero record
+dd if=day2 of=expected bs=1 skip=500 count=50000 1>/dev/null 2>&1
+$PROGRAM_EXEC extract --offset 500 --length 50000 -b base diff1 diff2 > extracted
+
+if ! files_are_the_same extracted expected; then
+    echo "assert: Cannot extract the range"
+    exit 1
+fi
+
+# The range inside a data record, only its part is read
+dd if=day1 of=expected bs=1 skip=2000 count=100 1>/dev/null 2>&1
+$PROGRAM_EXEC extract --offset 2000 --length 100 -b base diff1 > extracted
+
+if ! files_are_the_same extracted expected; then
+    echo "assert: Cannot extract the range inside a record"
+    exit 1
+fi
+
+rm -f base day1 day2 diff1 diff2 expected extracted
+
+exit 0
@@ -0,0 +1,63 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    [ -z "$(diff "$1" "$2")" ]
+}
+
+function json_value()
+{
+    grep -o "\"$2\": [0-9.]*" "$1" | cut -d ' ' -f 2
+}
+
+rm -f input backedup_input base out stats.json
+
+yes diff-dd | head -c $(( 64 * 1024 )) > base
+cp base input
+
+head -c 3000 /dev/zero | tr '\0' X | dd of=input bs=1 seek=1000 conv=notrunc 1>/dev/null 2>&1
+head -c 3000 /dev/zero | tr '\0' X | dd of=input bs=1 seek=30000 conv=notrunc 1>/dev/null 2>&1
+
+assert "" "" 0 $PROGRAM_EXEC create --stats-json stats.json -i input -b base -o out
+
+if [ "$(json_value stats.json input_bytes_read)" != $(( 64 * 1024 )) ] ||
+   [ "$(json_value stats.json bytes_compared)" != $(( 64 * 1024 )) ] ||
+   [ "$(json_value stats.json records)" != 2 ] ||
+   [ "$(json_value stats.json bytes_written)" != "$(stat -c %s out)" ]; then
+    echo "assert: Incorrect statistics of create"
+    exit 1
+fi
+
+cp input backedup_input
+cp base input
+
+assert "" "" 0 $PROGRAM_EXEC restore --stats-json stats.json -j 2 -d out -o input
+
+if ! files_are_the_same input backedup_input; then
+    echo "assert: Cannot restore the backup with the statistics"
+    exit 1
+fi
+
+if [ "$(json_value stats.json records)" != 2 ] ||
+   [ "$(json_value stats.json bytes_written)" != 6000 ]; then
+    echo "assert: Incorrect statistics of restore"
+    exit 1
+fi
+
+# The times can be in the exponent notation. The I/O of the threads overlapping
+# in time is counted once.
+wall_seconds="$(grep -o '"wall_seconds": [0-9.e+-]*' stats.json | cut -d ' ' -f 2)"
+io_seconds="$(grep -o '"io_seconds": [0-9.e+-]*' stats.json | cut -d ' ' -f 2)"
+if ! grep -q '"compute_seconds": ' stats.json ||
+   ! awk "BEGIN { exit !($io_seconds <= $wall_seconds) }"; then
+    echo "assert: Incorrect times of restore"
+    exit 1
+fi
+
+rm -f input backedup_input base out stats.json
+
+exit 0
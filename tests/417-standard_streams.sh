@@ -0,0 +1,48 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    [ -z "$(diff "$1" "$2")" ]
+}
+
+rm -f input backedup_input base out out_pipe
+
+yes diff-dd | head -c $(( 256 * 1024 )) > base
+cp base input
+
+head -c 3000 /dev/urandom | dd of=input bs=1 seek=1000 conv=notrunc 1>/dev/null 2>&1
+head -c 3000 /dev/urandom | dd of=input bs=1 seek=130000 conv=notrunc 1>/dev/null 2>&1
+
+assert "" "" 0 $PROGRAM_EXEC create -B 4096 -i input -b base -o out
+
+# Standard output redirected to a file
+$PROGRAM_EXEC create -B 4096 -i input -b base -o - > out_pipe
+if ! files_are_the_same out out_pipe; then
+    echo "assert: Cannot create the backup to the standard output"
+    exit 1
+fi
+
+# Standard output to a pipe
+$PROGRAM_EXEC create -B 4096 -i input -b base -o - | cat > out_pipe
+if ! files_are_the_same out out_pipe; then
+    echo "assert: Cannot create the backup to a pipe"
+    exit 1
+fi
+
+cp input backedup_input
+cp base input
+
+$PROGRAM_EXEC create -B 4096 -i backedup_input -b base -o - | \
+    $PROGRAM_EXEC restore -d - -o input
+if ! files_are_the_same input backedup_input; then
+    echo "assert: Cannot restore the backup from the standard input"
+    exit 1
+fi
+
+rm -f input backedup_input base out out_pipe
+
+exit 0
@@ -0,0 +1,47 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    cmp -s "$1" "$2"
+}
+
+rm -f input backedup_input base out
+
+# Data in the first half, a hole in the second one
+yes diff-dd | head -c $(( 512 * 1024 )) > base
+truncate -s 1M base
+cp base input
+
+# Small changes with the gaps of data and of the hole between them
+for offset in 100 900 5000 30000 30010 200000 600000 600100 700000 1048000; do
+    printf '\xFF\xFE' | dd of=input bs=1 seek=$offset conv=notrunc 1>/dev/null 2>&1
+done
+
+assert "" "" 0 $PROGRAM_EXEC create -B 512 -i input -b base -o out
+
+cp input backedup_input
+
+for buffer_size in 512 4096 65536; do
+    cp --sparse=always base input
+
+    assert "" "" 0 $PROGRAM_EXEC restore -B $buffer_size -d out -o input
+
+    if ! files_are_the_same input backedup_input; then
+        echo "assert: Cannot restore the backup in batches of $buffer_size bytes"
+        exit 1
+    fi
+
+    # The gaps filled between the writes to the hole do not allocate it
+    if [ "$(du -k input | cut -f 1)" -gt 600 ]; then
+        echo "assert: The hole is allocated by the batches of $buffer_size bytes"
+        exit 1
+    fi
+done
+
+rm -f input backedup_input base out
+
+exit 0
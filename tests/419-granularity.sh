@@ -0,0 +1,52 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    cmp -s "$1" "$2"
+}
+
+rm -f input backedup_input base out
+
+yes diff-dd | head -c $(( 1024 * 1024 + 1000 )) > base
+cp base input
+
+# Small changes inside the blocks and across the block boundaries
+for offset in 100 5000 8190 30000 200000 600000 1048000 1049500; do
+    printf '\xFF\xFE' | dd of=input bs=1 seek=$offset conv=notrunc 1>/dev/null 2>&1
+done
+dd if=/dev/zero of=input bs=1 seek=300000 count=20000 conv=notrunc 1>/dev/null 2>&1
+
+cp input backedup_input
+
+for granularity in 512 4096 65536; do
+    assert "" "" 0 $PROGRAM_EXEC create --granularity $granularity -i input -b base -o out
+
+    for restore_options in "" "-j 2" "-j 2 --direct" "--direct"; do
+        cp base input
+
+        assert "" "" 0 $PROGRAM_EXEC restore $restore_options -d out -o input
+
+        if ! files_are_the_same input backedup_input; then
+            echo "assert: Cannot restore the backup with the granularity of $granularity bytes ($restore_options)"
+            exit 1
+        fi
+    done
+
+    assert "" "" 0 $PROGRAM_EXEC verify -d out
+done
+
+# The granularity in the file header changed from 512 to 1024 bytes. The
+# record at offset 4608 is not aligned to it, so all the readers reject it.
+assert "" "" 0 $PROGRAM_EXEC create --granularity 512 -i input -b base -o out
+printf '\x04' | dd of=out bs=1 seek=20 conv=notrunc 1>/dev/null 2>&1
+
+assert "" "record not aligned to the granularity" 1 $PROGRAM_EXEC restore -d out -o input
+assert "" "record not aligned to the granularity" 1 $PROGRAM_EXEC extract --offset 4608 --length 512 -b base out
+
+rm -f input backedup_input base out
+
+exit 0
@@ -0,0 +1,48 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+function files_are_the_same()
+{
+    cmp -s "$1" "$2"
+}
+
+rm -f input backedup_input base out
+
+yes diff-dd | head -c $(( 256 * 1024 )) > base
+cp base input
+
+# A range of 64 KiB with all the bytes changed, spanning many buffers
+yes DIFF+DD | tr "\n" _ | head -c $(( 64 * 1024 )) | dd of=input bs=4096 seek=1 conv=notrunc 1>/dev/null 2>&1
+
+cp input backedup_input
+
+# The range is in one record, although the buffers are smaller. The offset
+# delta, the size and the position delta take two, three and one bytes.
+assert "" "" 0 $PROGRAM_EXEC create -B 512 -i input -b base -o out
+if [ "$(stat -c %s out)" -ne $(( 18 + (1 + 2 + 3) + 65536 + 4 + 1 + 4 + (2 + 3 + 1) + 16 )) ]; then
+    echo "assert: The changed range is not backed up as one record"
+    exit 1
+fi
+
+for create_options in "-B 512" "-B 512 -j 2" "-B 512 --max-record-size 8589934592" "--max-record-size 1000" "-B 4096 --max-record-size 16384 --compress lz"; do
+    assert "" "" 0 $PROGRAM_EXEC create $create_options -i input -b base -o out
+    assert "" "" 0 $PROGRAM_EXEC verify -d out
+
+    for restore_options in "" "-j 2"; do
+        cp base input
+
+        assert "" "" 0 $PROGRAM_EXEC restore $restore_options -d out -o input
+
+        if ! files_are_the_same input backedup_input; then
+            echo "assert: Cannot restore the backup created with $create_options ($restore_options)"
+            exit 1
+        fi
+    done
+done
+
+rm -f input backedup_input base out
+
+exit 0
@@ -0,0 +1,56 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+rm -f input base out corrupted restored merged
+
+yes diff-dd | head -c $(( 64 * 1024 )) > base
+cp base input
+
+head -c 3000 /dev/zero | tr '\0' X | dd of=input bs=1 conv=notrunc 1>/dev/null 2>&1
+
+# The first record is compressed. Its header starts after the 18 bytes of the
+# file header with the type, the offset delta, the two-byte size, and the
+# codec, followed by the one-byte size of the compressed data.
+assert "" "" 0 $PROGRAM_EXEC create --compress lz -i input -b base -o out
+
+# The size of the compressed data changed to 2^45 bytes. The size of the file
+# stays the same, so the index still points to the record.
+cp out corrupted
+printf '\x80\x80\x80\x80\x80\x80\x08' | dd of=corrupted bs=1 seek=23 conv=notrunc 1>/dev/null 2>&1
+
+for restore_options in "" "-j 2"; do
+    cp base restored
+    assert "" "wrong size of compressed record data" 1 $PROGRAM_EXEC restore $restore_options -d corrupted -o restored
+done
+assert "" "wrong size of compressed record data" 1 $PROGRAM_EXEC merge -o merged corrupted
+assert "" "wrong size of compressed record data" 1 $PROGRAM_EXEC extract --offset 0 --length 100 -b base corrupted
+
+# A compressed record of 2^45 bytes, with the codec and a one-byte size of the
+# compressed data
+cp out corrupted
+printf '\x03\x00\x80\x80\x80\x80\x80\x80\x08\x01\x11' | dd of=corrupted bs=1 seek=18 conv=notrunc 1>/dev/null 2>&1
+
+for restore_options in "" "-j 2"; do
+    cp base restored
+    assert "" "record too large" 1 $PROGRAM_EXEC restore $restore_options -d corrupted -o restored
+done
+assert "" "record too large" 1 $PROGRAM_EXEC merge -o merged corrupted
+assert "" "record too large" 1 $PROGRAM_EXEC extract --offset 0 --length 100 -b base corrupted
+
+# A data record of 2^45 bytes is read in parts, so only its end is missing
+cp out corrupted
+printf '\x01\x00\x80\x80\x80\x80\x80\x80\x08' | dd of=corrupted bs=1 seek=18 conv=notrunc 1>/dev/null 2>&1
+
+for restore_options in "" "-j 2"; do
+    cp base restored
+    assert "" "cannot read all the data of the record" 1 $PROGRAM_EXEC restore $restore_options -d corrupted -o restored
+done
+assert "" "cannot read all the data of the record" 1 $PROGRAM_EXEC merge -o merged corrupted
+assert "" "cannot read all the data of the record" 1 $PROGRAM_EXEC extract --offset 0 --length 100 -b base corrupted
+
+rm -f input base out corrupted restored merged
+
+exit 0
@@ -0,0 +1,32 @@
+#!/bin/bash
+
+source ./assert.sh
+
+PROGRAM_EXEC="$1"
+
+rm -f input base out
+
+yes diff-dd | head -c $(( 8 * 1024 * 1024 )) > base
+cp base input
+
+# A small change written with the end record, and a large one written by the
+# gather writes
+printf '\xFF' | dd of=input bs=1 seek=100 conv=notrunc 1>/dev/null 2>&1
+head -c $(( 3 * 1024 * 1024 )) /dev/urandom | dd of=input bs=1M seek=2 conv=notrunc 1>/dev/null 2>&1
+
+# The writes to /dev/full fail with ENOSPC
+assert "" "ERROR:" 1 $PROGRAM_EXEC create -i input -b base -o /dev/full
+assert "" "ERROR:" 1 $PROGRAM_EXEC create -j 2 -i input -b base -o /dev/full
+
+assert "" "" 0 $PROGRAM_EXEC create -i input -b base -o out
+assert "" "ERROR:" 1 $PROGRAM_EXEC merge -o /dev/full out
+
+# The digests of a small image and of a large one with the small blocks fit in
+# the buffer, so they are written only at the end
+head -c 4096 input > base
+assert "" "cannot write to output file" 1 $PROGRAM_EXEC signature -i base -o /dev/full
+assert "" "cannot write to output file" 1 $PROGRAM_EXEC signature -s 512 -i input -o /dev/full
+
+rm -f input base out
+
+exit 0
@@ -5,6 +5,7 @@ function print_assert_out_error()
     echo "assert: $1 does not contain expected string"
     echo "      actual: $2"
     echo "    expected: $3"
+    test_error=1
 }
 
 function assert_retval()
@@ -24,7 +25,7 @@ function assert_out()
     elif [ -n "$2" -a -z "$3" ]; then
         print_assert_out_error $1 "$2" "$3"
     else
-        is_stderr_expected="$(echo "$2" | grep -i "$3")"
+        is_stderr_expected="$(echo "$2" | grep -i -- "$3")"
         if [ -z "$is_stderr_expected" ]; then
             print_assert_out_error $1 "$2" "$3"
         fi